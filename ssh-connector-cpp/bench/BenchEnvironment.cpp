@@ -0,0 +1,149 @@
+#include "BenchEnvironment.h"
+#include "BenchSocket.h"
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <libssh/libssh.h>
+
+namespace fs = std::filesystem;
+
+namespace sshconn {
+namespace bench {
+
+BenchEnvironment::~BenchEnvironment()
+{
+    tearDown();
+}
+
+bool BenchEnvironment::createClientKey(std::string& error)
+{
+    ssh_key key = nullptr;
+    if (ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &key) != SSH_OK) {
+        error = "Failed to generate client key";
+        return false;
+    }
+
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    m_keyPath = (fs::temp_directory_path() / ("ssh-connector-bench-" + std::to_string(stamp) + ".key")).string();
+    int rc = ssh_pki_export_privkey_file(key, nullptr, nullptr, nullptr, m_keyPath.c_str());
+    ssh_key_free(key);
+    if (rc != SSH_OK) {
+        error = "Failed to write client key: " + m_keyPath;
+        return false;
+    }
+    return true;
+}
+
+bool BenchEnvironment::setUp(std::string& error)
+{
+    if (!m_relay.start()) {
+        error = "Failed to start relay stand-in";
+        return false;
+    }
+    if (!m_service.start()) {
+        error = "Failed to start loopback service";
+        return false;
+    }
+    if (!createClientKey(error)) {
+        return false;
+    }
+
+    ServerEndpoint endpoint;
+    endpoint.host = "127.0.0.1";
+    endpoint.port = m_relay.port();
+    endpoint.user = "bench";
+    endpoint.keyPath = m_keyPath;
+
+    m_client = std::make_unique<SSHClient>();
+    m_client->setEndpoint(endpoint);
+    m_client->setRekeyPolicy(m_rekey);
+    m_client->connect();
+    if (!m_client->isConnected()) {
+        error = "SSH connect to relay stand-in failed: " + m_client->errorMessage();
+        return false;
+    }
+
+    if (m_probeInterval > 0) {
+        ProbeConfig probe;
+        probe.enabled = true;
+        probe.remotePort = freeLoopbackPort();
+        probe.interval = m_probeInterval;
+        m_client->setProbe(probe);
+    }
+
+    TunnelConfig tunnel;
+    tunnel.type = m_tunnelType;
+    m_tunnelPort = freeLoopbackPort();
+    if (m_tunnelType == TunnelType::Remote) {
+        tunnel.localPort = m_service.port();
+        tunnel.remotePort = m_tunnelPort;
+    } else {
+        // Listens here; the relay connects each channel to the service
+        tunnel.localPort = m_tunnelPort;
+        tunnel.remotePort = m_service.port();
+    }
+    if (m_tunnelPort <= 0 || !m_client->startTunnel(tunnel)) {
+        error = "Failed to start tunnel";
+        return false;
+    }
+
+    bool bound = false;
+    if (m_tunnelType == TunnelType::Remote) {
+        bound = m_relay.waitForForward(m_tunnelPort, std::chrono::seconds(10));
+    } else {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!(bound = m_client->isForwarding({m_tunnelType, m_tunnelPort})) && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if (!bound) {
+        error = m_tunnelType == TunnelType::Remote ? "Relay stand-in never saw the tcpip-forward request"
+                                                   : "Tunnel never started listening";
+        return false;
+    }
+    return true;
+}
+
+int BenchEnvironment::connectClient(int timeoutMs) const
+{
+    int sock = connectLoopback(m_tunnelPort, timeoutMs);
+    if (sock < 0 || m_tunnelType != TunnelType::Dynamic) {
+        return sock;
+    }
+
+    // No authentication, then CONNECT 127.0.0.1:service
+    const unsigned char greeting[3] = {0x05, 0x01, 0x00};
+    unsigned char request[10] = {0x05, 0x01, 0x00, 0x01, 127, 0, 0, 1, 0, 0};
+    request[8] = static_cast<unsigned char>(m_service.port() >> 8);
+    request[9] = static_cast<unsigned char>(m_service.port() & 0xff);
+    char method[2];
+    char reply[10];
+    bool ok = sendAll(sock, reinterpret_cast<const char*>(greeting), sizeof(greeting)) &&
+              recvAll(sock, method, sizeof(method)) && method[1] == 0x00 &&
+              sendAll(sock, reinterpret_cast<const char*>(request), sizeof(request)) &&
+              recvAll(sock, reply, sizeof(reply)) && reply[1] == 0x00;
+    if (!ok) {
+        closeSocket(sock);
+        return -1;
+    }
+    return sock;
+}
+
+void BenchEnvironment::tearDown()
+{
+    if (m_client) {
+        m_client->disconnect();
+        m_client.reset();
+    }
+    m_service.stop();
+    m_relay.stop();
+    if (!m_keyPath.empty()) {
+        std::error_code ec;
+        fs::remove(m_keyPath, ec);
+        m_keyPath.clear();
+    }
+}
+
+} // namespace bench
+} // namespace sshconn
@@ -0,0 +1,63 @@
+#ifndef BENCH_ENVIRONMENT_H
+#define BENCH_ENVIRONMENT_H
+
+#include "LoopbackService.h"
+#include "RelayStandIn.h"
+#include "core/SSHClient.h"
+
+#include <memory>
+#include <string>
+
+namespace sshconn {
+namespace bench {
+
+// Relay stand-in + local service + a connected SSHClient with one tunnel to
+// the service. A reverse tunnel listens on the relay, a local or dynamic one
+// in the client; either way tunnelPort() is the loopback port to connect to,
+// and traffic through connectClient() takes the same path as production
+// traffic.
+class BenchEnvironment {
+public:
+    BenchEnvironment() = default;
+    ~BenchEnvironment();
+
+    // Prevent copying
+    BenchEnvironment(const BenchEnvironment&) = delete;
+    BenchEnvironment& operator=(const BenchEnvironment&) = delete;
+
+    // Apply to the session and tunnel opened by setUp
+    void setRekeyPolicy(const RekeyConfig& policy) { m_rekey = policy; }
+    void setTunnelType(TunnelType type) { m_tunnelType = type; }
+    // Probe through the relay every `seconds`; 0 (the default) leaves it off
+    void setProbeInterval(double seconds) { m_probeInterval = seconds; }
+
+    bool setUp(std::string& error);
+    void tearDown();
+
+    // Where clients connect; also the tunnel's metrics label
+    int tunnelPort() const { return m_tunnelPort; }
+    TunnelType tunnelType() const { return m_tunnelType; }
+    // A client connection through the tunnel, with the SOCKS5 CONNECT to the
+    // service already done for dynamic tunnels; -1 on failure
+    int connectClient(int timeoutMs) const;
+    RelayStandIn& relay() { return m_relay; }
+    LoopbackService& service() { return m_service; }
+    SSHClient& client() { return *m_client; }
+
+private:
+    bool createClientKey(std::string& error);
+
+    RelayStandIn m_relay;
+    LoopbackService m_service;
+    std::unique_ptr<SSHClient> m_client;
+    std::string m_keyPath;
+    int m_tunnelPort = 0;
+    RekeyConfig m_rekey;
+    TunnelType m_tunnelType = TunnelType::Remote;
+    double m_probeInterval = 0.0;
+};
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // BENCH_ENVIRONMENT_H
@@ -0,0 +1,164 @@
+#ifndef BENCH_SOCKET_H
+#define BENCH_SOCKET_H
+
+#include <cstddef>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace sshconn {
+namespace bench {
+
+inline void closeSocket(int sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+inline void setNonBlocking(int sock, bool enabled)
+{
+#ifdef _WIN32
+    u_long mode = enabled ? 1 : 0;
+    ioctlsocket(sock, FIONBIO, &mode);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+inline void setTimeouts(int sock, int timeoutMs)
+{
+#ifdef _WIN32
+    DWORD tv = static_cast<DWORD>(timeoutMs);
+#else
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+}
+
+inline void setNoDelay(int sock)
+{
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+}
+
+// Close with RST instead of FIN so the closing side leaves no TIME_WAIT entry;
+// needed to sustain thousands of loopback connections per second
+inline void setAbortiveClose(int sock)
+{
+    struct linger lg;
+    lg.l_onoff = 1;
+    lg.l_linger = 0;
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&lg), sizeof(lg));
+}
+
+// Listen on 127.0.0.1:port (0 = ephemeral); returns the socket and the bound port
+inline int listenLoopback(int port, int& boundPort, int backlog = 128)
+{
+    int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (sock < 0) {
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(sock, backlog) < 0) {
+        closeSocket(sock);
+        return -1;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    boundPort = ntohs(addr.sin_port);
+    return sock;
+}
+
+// Find a currently unused loopback port
+inline int freeLoopbackPort()
+{
+    int port = 0;
+    int sock = listenLoopback(0, port);
+    if (sock < 0) {
+        return -1;
+    }
+    closeSocket(sock);
+    return port;
+}
+
+inline int connectLoopback(int port, int timeoutMs)
+{
+    int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<unsigned short>(port));
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (::connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        closeSocket(sock);
+        return -1;
+    }
+
+    setTimeouts(sock, timeoutMs);
+    setNoDelay(sock);
+    return sock;
+}
+
+inline bool sendAll(int sock, const char* data, std::size_t len)
+{
+    std::size_t total = 0;
+    while (total < len) {
+        int sent = send(sock, data + total, static_cast<int>(len - total), 0);
+        if (sent <= 0) {
+            return false;
+        }
+        total += static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+inline bool recvAll(int sock, char* data, std::size_t len)
+{
+    std::size_t total = 0;
+    while (total < len) {
+        int received = recv(sock, data + total, static_cast<int>(len - total), 0);
+        if (received <= 0) {
+            return false;
+        }
+        total += static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // BENCH_SOCKET_H
@@ -0,0 +1,238 @@
+#include "ChurnBench.h"
+#include "BenchEnvironment.h"
+#include "BenchSocket.h"
+#include "LoopbackService.h"
+#include "ProcessStats.h"
+#include "core/Metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr int CONNECT_TIMEOUT_MS = 5000;
+constexpr int WARMUP_CONNECTIONS = 200;
+
+// Relay channels that have been opened but not yet closed
+std::int64_t openRelayChannels(RelayStandIn& relay)
+{
+    return static_cast<std::int64_t>(relay.channelsOpened()) - static_cast<std::int64_t>(relay.channelsClosed());
+}
+
+enum class ChurnResult { Ok, ConnectFailed, EchoFailed };
+
+// One connect + 1-byte echo + close; `elapsed` covers connect through the echoed byte
+ChurnResult churnOnce(const BenchEnvironment& environment, Clock::duration& elapsed)
+{
+    static const char request[6] = {LoopbackService::CMD_ECHO, 0, 0, 0, 1, 'c'};
+
+    auto startedAt = Clock::now();
+    int sock = environment.connectClient(CONNECT_TIMEOUT_MS);
+    if (sock < 0) {
+        return ChurnResult::ConnectFailed;
+    }
+    setAbortiveClose(sock);
+
+    char reply = 0;
+    bool ok = sendAll(sock, request, sizeof(request)) && recvAll(sock, &reply, 1);
+    elapsed = Clock::now() - startedAt;
+    closeSocket(sock);
+    return ok ? ChurnResult::Ok : ChurnResult::EchoFailed;
+}
+
+json latencySummary(const Histogram& histogram)
+{
+    return {
+        {"samples", histogram.count()},
+        {"p50_us", histogram.percentile(0.50)},
+        {"p90_us", histogram.percentile(0.90)},
+        {"p99_us", histogram.percentile(0.99)},
+        {"p999_us", histogram.percentile(0.999)},
+        {"max_us", histogram.percentile(1.0)},
+    };
+}
+
+// Wait until every connection opened during the run has been torn down on
+// all three hops, so whatever is still open afterwards is a leak
+bool waitForSettle(BenchEnvironment& environment, const TunnelMetrics& tunnel,
+                   std::int64_t baselineChannels, double settleSeconds)
+{
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(settleSeconds));
+    while (true) {
+        bool settled = openRelayChannels(environment.relay()) <= baselineChannels &&
+                       tunnel.activeConnections.value() == 0 &&
+                       environment.service().openConnections() == 0;
+        if (settled) {
+            return true;
+        }
+        if (Clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
+} // namespace
+
+json runChurn(BenchEnvironment& environment, const ChurnOptions& options)
+{
+    auto tunnel = MetricsRegistry::instance().tunnel(
+        tunnelKeyName({environment.tunnelType(), environment.tunnelPort()}));
+
+    // Warm up so lazily allocated buffers and thread stacks are not counted as growth
+    Clock::duration ignored{};
+    for (int i = 0; i < WARMUP_CONNECTIONS; ++i) {
+        churnOnce(environment, ignored);
+    }
+    waitForSettle(environment, *tunnel, 0, options.settleSeconds);
+
+    const std::int64_t baselineChannels = openRelayChannels(environment.relay());
+    const long baselineFds = openDescriptorCount();
+    const std::uint64_t baselineRss = residentBytes();
+    const std::uint64_t baselineHandled = tunnel->connectionsTotal.value();
+    const std::uint64_t baselineLocalFailures = tunnel->localConnectFailures.value();
+    const std::uint64_t baselineOpenFailures = tunnel->channelOpenFailures.value();
+
+    // One histogram per sample interval plus the overall one
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.sampleSeconds));
+    const std::size_t intervalCount = static_cast<std::size_t>(
+        std::ceil(options.soakSeconds / options.sampleSeconds)) + 1;
+    std::vector<std::unique_ptr<Histogram>> intervalLatency;
+    for (std::size_t i = 0; i < intervalCount; ++i) {
+        intervalLatency.push_back(std::make_unique<Histogram>());
+    }
+    Histogram latency;
+
+    std::atomic<std::uint64_t> ticket{0};
+    std::atomic<std::uint64_t> completed{0};
+    std::atomic<std::uint64_t> connectErrors{0};
+    std::atomic<std::uint64_t> echoErrors{0};
+    std::atomic<bool> finished{false};
+
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.soakSeconds));
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.clients; ++i) {
+        workers.emplace_back([&] {
+            while (true) {
+                // Open-loop pacing: each ticket has a fixed start time, so a
+                // slow tunnel shows up as latency rather than a lower offered rate
+                if (options.ratePerSecond > 0) {
+                    auto slot = start + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double>(static_cast<double>(ticket.fetch_add(1)) / options.ratePerSecond));
+                    if (slot >= deadline) {
+                        break;
+                    }
+                    std::this_thread::sleep_until(slot);
+                } else if (Clock::now() >= deadline) {
+                    break;
+                }
+
+                auto startedAt = Clock::now();
+                Clock::duration elapsed{};
+                switch (churnOnce(environment, elapsed)) {
+                case ChurnResult::Ok: {
+                    std::size_t slotIndex = static_cast<std::size_t>((startedAt - start) / interval);
+                    latency.record(elapsed);
+                    intervalLatency[slotIndex < intervalCount ? slotIndex : intervalCount - 1]->record(elapsed);
+                    completed.fetch_add(1);
+                    break;
+                }
+                case ChurnResult::ConnectFailed:
+                    connectErrors.fetch_add(1);
+                    break;
+                case ChurnResult::EchoFailed:
+                    echoErrors.fetch_add(1);
+                    break;
+                }
+            }
+        });
+    }
+
+    // Sample process growth while the workers run
+    json samples = json::array();
+    std::thread sampler([&] {
+        std::uint64_t lastCompleted = 0;
+        for (std::size_t i = 1; !finished.load(); ++i) {
+            auto sampleAt = start + interval * static_cast<long>(i);
+            while (Clock::now() < sampleAt && !finished.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (finished.load()) {
+                break;
+            }
+
+            std::uint64_t done = completed.load();
+            const Histogram& window = *intervalLatency[i - 1 < intervalCount ? i - 1 : intervalCount - 1];
+            samples.push_back({
+                {"elapsed_sec", std::chrono::duration<double>(Clock::now() - start).count()},
+                {"connections", done},
+                {"connections_per_sec", static_cast<double>(done - lastCompleted) / options.sampleSeconds},
+                {"p50_us", window.percentile(0.50)},
+                {"p99_us", window.percentile(0.99)},
+                {"open_fds", openDescriptorCount()},
+                {"open_relay_channels", openRelayChannels(environment.relay())},
+                {"rss_bytes", residentBytes()},
+            });
+            lastCompleted = done;
+            std::cerr << "churn: " << done << " connections, rss "
+                      << residentBytes() / 1024 << " KiB, fds " << openDescriptorCount() << std::endl;
+        }
+    });
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    finished.store(true);
+    sampler.join();
+
+    bool settled = waitForSettle(environment, *tunnel, baselineChannels, options.settleSeconds);
+    const long finalFds = openDescriptorCount();
+    const std::uint64_t finalRss = residentBytes();
+
+    json result = latencySummary(latency);
+    result["clients"] = options.clients;
+    result["target_rate_per_sec"] = options.ratePerSecond;
+    result["soak_sec"] = elapsed;
+    result["connections"] = completed.load();
+    result["connections_per_sec"] = elapsed > 0 ? static_cast<double>(completed.load()) / elapsed : 0.0;
+    result["connect_errors"] = connectErrors.load();
+    result["echo_errors"] = echoErrors.load();
+    result["tunnel_handled"] = tunnel->connectionsTotal.value() - baselineHandled;
+    result["tunnel_local_connect_failures"] = tunnel->localConnectFailures.value() - baselineLocalFailures;
+    result["tunnel_channel_open_failures"] = tunnel->channelOpenFailures.value() - baselineOpenFailures;
+    result["settled"] = settled;
+    result["leaks"] = {
+        {"fds", baselineFds >= 0 && finalFds >= 0 ? finalFds - baselineFds : 0},
+        {"relay_channels", openRelayChannels(environment.relay()) - baselineChannels},
+        {"tunnel_active_connections", tunnel->activeConnections.value()},
+        {"service_connections", environment.service().openConnections()},
+    };
+    result["rss"] = {
+        {"baseline_bytes", baselineRss},
+        {"final_bytes", finalRss},
+        {"growth_bytes", static_cast<std::int64_t>(finalRss) - static_cast<std::int64_t>(baselineRss)},
+    };
+    result["samples"] = samples;
+    return result;
+}
+
+} // namespace bench
+} // namespace sshconn
@@ -0,0 +1,27 @@
+#ifndef CHURN_BENCH_H
+#define CHURN_BENCH_H
+
+#include <nlohmann/json.hpp>
+
+namespace sshconn {
+namespace bench {
+
+class BenchEnvironment;
+
+struct ChurnOptions {
+    int clients = 8;               // Concurrent connection loops
+    double ratePerSecond = 0.0;    // Target opens per second across all clients, 0 = as fast as possible
+    double soakSeconds = 60.0;     // Total churn duration
+    double sampleSeconds = 10.0;   // Interval between RSS / fd / latency samples
+    double settleSeconds = 5.0;    // Max wait for in-flight connections to drain before counting leaks
+};
+
+// Open, use and close short-lived connections through the tunnel for the
+// soak period, then report accept latency percentiles, leaked descriptors and
+// channels, and RSS growth (overall and per sample interval).
+nlohmann::json runChurn(BenchEnvironment& environment, const ChurnOptions& options);
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // CHURN_BENCH_H
@@ -0,0 +1,140 @@
+#include "LoopbackService.h"
+#include "BenchSocket.h"
+
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr std::size_t IO_CHUNK = 65536;
+
+std::uint64_t readBigEndian(const unsigned char* data, int bytes)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+} // namespace
+
+LoopbackService::~LoopbackService()
+{
+    stop();
+}
+
+bool LoopbackService::start()
+{
+    m_listenSocket = listenLoopback(0, m_port);
+    if (m_listenSocket < 0) {
+        return false;
+    }
+    m_stopRequested.store(false);
+    m_acceptThread = std::thread(&LoopbackService::acceptLoop, this);
+    return true;
+}
+
+void LoopbackService::stop()
+{
+    m_stopRequested.store(true);
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+    if (m_listenSocket >= 0) {
+        closeSocket(m_listenSocket);
+        m_listenSocket = -1;
+    }
+
+    // Unblock connection threads and wait for them to finish
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (int sock : m_clients) {
+        shutdown(sock, 2);
+    }
+    m_idle.wait(lock, [this] { return m_clients.empty(); });
+}
+
+std::size_t LoopbackService::openConnections() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_clients.size();
+}
+
+void LoopbackService::acceptLoop()
+{
+    while (!m_stopRequested.load()) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(m_listenSocket, &readSet);
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100 * 1000;
+        if (select(m_listenSocket + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+            continue;
+        }
+
+        int client = static_cast<int>(accept(m_listenSocket, nullptr, nullptr));
+        if (client < 0) {
+            continue;
+        }
+        setNoDelay(client);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clients.insert(client);
+        }
+        std::thread(&LoopbackService::serve, this, client).detach();
+    }
+}
+
+void LoopbackService::serve(int sock)
+{
+    std::vector<char> buffer(IO_CHUNK);
+    unsigned char header[8];
+    char command = 0;
+
+    while (recvAll(sock, &command, 1)) {
+        if (command == CMD_ECHO) {
+            if (!recvAll(sock, reinterpret_cast<char*>(header), 4)) break;
+            std::uint64_t remaining = readBigEndian(header, 4);
+            bool ok = true;
+            while (ok && remaining > 0) {
+                std::size_t chunk = remaining < IO_CHUNK ? static_cast<std::size_t>(remaining) : IO_CHUNK;
+                ok = recvAll(sock, buffer.data(), chunk) && sendAll(sock, buffer.data(), chunk);
+                remaining -= chunk;
+            }
+            if (!ok) break;
+        } else if (command == CMD_SINK) {
+            if (!recvAll(sock, reinterpret_cast<char*>(header), 8)) break;
+            std::uint64_t remaining = readBigEndian(header, 8);
+            bool ok = true;
+            while (ok && remaining > 0) {
+                std::size_t chunk = remaining < IO_CHUNK ? static_cast<std::size_t>(remaining) : IO_CHUNK;
+                ok = recvAll(sock, buffer.data(), chunk);
+                remaining -= chunk;
+            }
+            if (!ok || !sendAll(sock, &SINK_ACK, 1)) break;
+        } else {
+            break;
+        }
+    }
+
+    m_connectionsServed.fetch_add(1);
+
+    // Close under the lock so a reused fd number cannot be confused with this one
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients.erase(sock);
+    closeSocket(sock);
+    if (m_clients.empty()) {
+        m_idle.notify_all();
+    }
+}
+
+} // namespace bench
+} // namespace sshconn
@@ -0,0 +1,59 @@
+#ifndef LOOPBACK_SERVICE_H
+#define LOOPBACK_SERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace sshconn {
+namespace bench {
+
+// Local TCP service standing in for the forwarded application.
+//
+// Each connection carries a sequence of commands:
+//   'E' <u32 length> <payload>  -> payload echoed back
+//   'S' <u64 length> <payload>  -> payload discarded, single 'K' returned
+// Both lengths are big-endian. The connection ends when the peer closes it.
+class LoopbackService {
+public:
+    static constexpr char CMD_ECHO = 'E';
+    static constexpr char CMD_SINK = 'S';
+    static constexpr char SINK_ACK = 'K';
+
+    LoopbackService() = default;
+    ~LoopbackService();
+
+    // Prevent copying
+    LoopbackService(const LoopbackService&) = delete;
+    LoopbackService& operator=(const LoopbackService&) = delete;
+
+    bool start();
+    void stop();
+    int port() const { return m_port; }
+
+    std::uint64_t connectionsServed() const { return m_connectionsServed.load(); }
+    std::size_t openConnections() const;
+
+private:
+    void acceptLoop();
+    void serve(int sock);
+
+    int m_listenSocket = -1;
+    int m_port = 0;
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_acceptThread;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::set<int> m_clients;
+    std::atomic<std::uint64_t> m_connectionsServed{0};
+};
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // LOOPBACK_SERVICE_H
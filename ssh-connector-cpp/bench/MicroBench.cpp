@@ -0,0 +1,153 @@
+#include "MicroBench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <utility>
+
+using json = nlohmann::json;
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr std::uint64_t MAX_ITERATIONS = 1000000000ull;
+
+std::vector<std::pair<std::string, MicroBenchFunction>>& registry()
+{
+    static std::vector<std::pair<std::string, MicroBenchFunction>> benchmarks;
+    return benchmarks;
+}
+
+MicroState runOnce(const MicroBenchFunction& function, std::uint64_t iterations)
+{
+    MicroState state(iterations);
+    function(state);
+    return state;
+}
+
+// Grow the iteration count until one run lasts at least minSeconds
+std::uint64_t calibrate(const MicroBenchFunction& function, double minSeconds, std::string& skipReason)
+{
+    std::uint64_t iterations = 1;
+    while (true) {
+        MicroState state = runOnce(function, iterations);
+        if (!state.skipReason().empty()) {
+            skipReason = state.skipReason();
+            return 0;
+        }
+        double seconds = std::chrono::duration<double>(state.elapsed()).count();
+        if (seconds >= minSeconds || iterations >= MAX_ITERATIONS) {
+            return iterations;
+        }
+
+        // Aim 40 % past the target, growing at least 2x and at most 100x per step
+        double factor = seconds > 0 ? (minSeconds * 1.4) / seconds : 100.0;
+        factor = std::min(100.0, std::max(2.0, factor));
+        iterations = std::min(MAX_ITERATIONS, static_cast<std::uint64_t>(static_cast<double>(iterations) * factor));
+    }
+}
+
+} // namespace
+
+bool registerMicroBenchmark(const std::string& name, MicroBenchFunction function)
+{
+    registry().emplace_back(name, std::move(function));
+    return true;
+}
+
+json runMicroBenchmarks(const MicroRunOptions& options)
+{
+    json results = json::array();
+    for (const auto& entry : registry()) {
+        const std::string& name = entry.first;
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        std::string skipReason;
+        std::uint64_t iterations = calibrate(entry.second, options.minSeconds, skipReason);
+        if (iterations == 0) {
+            std::cerr << name << ": skipped (" << skipReason << ")" << std::endl;
+            results.push_back({{"name", name}, {"skipped", skipReason}});
+            continue;
+        }
+
+        std::vector<double> nsPerIteration;
+        std::uint64_t bytesPerIteration = 0;
+        double itemsPerIteration = 0.0;
+        for (int rep = 0; rep < options.repetitions; ++rep) {
+            MicroState state = runOnce(entry.second, iterations);
+            nsPerIteration.push_back(static_cast<double>(state.elapsed().count()) / static_cast<double>(iterations));
+            bytesPerIteration = state.bytesPerIteration();
+            itemsPerIteration = state.itemsPerIteration();
+        }
+        std::sort(nsPerIteration.begin(), nsPerIteration.end());
+        double median = nsPerIteration[nsPerIteration.size() / 2];
+
+        json result = {
+            {"name", name},
+            {"iterations", iterations},
+            {"repetitions", options.repetitions},
+            {"median_ns", median},
+            {"min_ns", nsPerIteration.front()},
+            {"max_ns", nsPerIteration.back()},
+        };
+        if (bytesPerIteration > 0 && median > 0) {
+            result["bytes_per_sec"] = static_cast<double>(bytesPerIteration) * 1e9 / median;
+        }
+        if (itemsPerIteration > 0 && median > 0) {
+            result["items_per_sec"] = itemsPerIteration * 1e9 / median;
+        }
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-44s %14.1f ns/op  (min %.1f, max %.1f, %llu iterations)",
+                      name.c_str(), median, nsPerIteration.front(), nsPerIteration.back(),
+                      static_cast<unsigned long long>(iterations));
+        std::cerr << line << std::endl;
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::vector<std::string> compareWithBaseline(const json& current, const json& baseline, double threshold)
+{
+    std::map<std::string, double> baselineMedians;
+    for (const auto& entry : baseline) {
+        if (entry.contains("median_ns")) {
+            baselineMedians[entry["name"].get<std::string>()] = entry["median_ns"].get<double>();
+        }
+    }
+
+    std::vector<std::string> regressions;
+    std::cerr << "\nComparison with baseline (threshold " << threshold * 100 << " %):" << std::endl;
+    for (const auto& entry : current) {
+        if (!entry.contains("median_ns")) {
+            continue;
+        }
+        std::string name = entry["name"].get<std::string>();
+        auto it = baselineMedians.find(name);
+        if (it == baselineMedians.end() || it->second <= 0) {
+            std::cerr << "  " << name << ": no baseline" << std::endl;
+            continue;
+        }
+
+        double now = entry["median_ns"].get<double>();
+        double change = (now - it->second) / it->second;
+        bool regressed = change > threshold;
+        if (regressed) {
+            regressions.push_back(name);
+        }
+
+        char line[200];
+        std::snprintf(line, sizeof(line), "  %-44s %14.1f -> %14.1f ns/op  %+7.1f %%%s",
+                      name.c_str(), it->second, now, change * 100.0, regressed ? "  REGRESSION" : "");
+        std::cerr << line << std::endl;
+    }
+    return regressions;
+}
+
+} // namespace bench
+} // namespace sshconn
@@ -0,0 +1,91 @@
+#ifndef MICRO_BENCH_H
+#define MICRO_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace sshconn {
+namespace bench {
+
+// Timing state handed to a microbenchmark body. The body does its setup,
+// then loops `while (state.next()) { ... }`; only the loop is timed.
+class MicroState {
+public:
+    explicit MicroState(std::uint64_t iterations) : m_remaining(iterations), m_iterations(iterations) {}
+
+    bool next()
+    {
+        if (!m_started) {
+            m_started = true;
+            m_start = Clock::now();
+        }
+        if (m_remaining == 0) {
+            m_elapsed += Clock::now() - m_start;
+            return false;
+        }
+        --m_remaining;
+        return true;
+    }
+
+    // Exclude per-iteration bookkeeping from the measurement
+    void pauseTiming() { m_elapsed += Clock::now() - m_start; }
+    void resumeTiming() { m_start = Clock::now(); }
+
+    void setBytesPerIteration(std::uint64_t bytes) { m_bytesPerIteration = bytes; }
+    void setItemsPerIteration(double items) { m_itemsPerIteration = items; }
+    void skip(const std::string& reason) { m_skipReason = reason; m_remaining = 0; }
+
+    std::uint64_t iterations() const { return m_iterations; }
+    std::chrono::nanoseconds elapsed() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(m_elapsed); }
+    std::uint64_t bytesPerIteration() const { return m_bytesPerIteration; }
+    double itemsPerIteration() const { return m_itemsPerIteration; }
+    const std::string& skipReason() const { return m_skipReason; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::uint64_t m_remaining;
+    std::uint64_t m_iterations;
+    bool m_started = false;
+    Clock::time_point m_start;
+    Clock::duration m_elapsed{0};
+    std::uint64_t m_bytesPerIteration = 0;
+    double m_itemsPerIteration = 0.0;
+    std::string m_skipReason;
+};
+
+using MicroBenchFunction = std::function<void(MicroState&)>;
+
+struct MicroRunOptions {
+    std::string filter;          // Substring match on benchmark name
+    double minSeconds = 0.5;     // Minimum timed duration per repetition
+    int repetitions = 5;
+};
+
+// Register a benchmark; used through SSHCONN_MICROBENCH
+bool registerMicroBenchmark(const std::string& name, MicroBenchFunction function);
+
+// Run all registered benchmarks matching the filter. Each result holds
+// name, iterations, median/min/max ns per iteration and, when set,
+// bytes_per_sec / items_per_sec derived from the median.
+nlohmann::json runMicroBenchmarks(const MicroRunOptions& options);
+
+// Print a current-vs-baseline table to stderr. Returns the names whose
+// median ns/op grew by more than `threshold` (0.10 = 10 %).
+std::vector<std::string> compareWithBaseline(const nlohmann::json& current, const nlohmann::json& baseline,
+                                             double threshold);
+
+} // namespace bench
+} // namespace sshconn
+
+#define SSHCONN_MICROBENCH_CONCAT_(a, b) a##b
+#define SSHCONN_MICROBENCH_CONCAT(a, b) SSHCONN_MICROBENCH_CONCAT_(a, b)
+#define SSHCONN_MICROBENCH(name, function) \
+    static const bool SSHCONN_MICROBENCH_CONCAT(s_microbench_, __LINE__) = \
+        ::sshconn::bench::registerMicroBenchmark(name, function)
+
+#endif // MICRO_BENCH_H
@@ -0,0 +1,456 @@
+#include "MockLibssh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// Definitions of the opaque libssh handle types, private to the mock.
+//
+// Like libssh, any call on a session first moves what the channel sockets
+// hold into the channels' buffers (up to a window's worth each). The session
+// "socket" is an edge-triggered epoll set over the channel sockets, so it
+// polls readable only when data arrived that nobody has looked at yet.
+struct ssh_session_struct {
+    bool connected = false;
+    bool blocking = true;
+    int pollFd = -1;
+    std::mutex mutex;
+    std::condition_variable pendingChanged;
+    std::deque<ssh_channel> pending;
+    std::deque<ssh_channel> opened; // direct-tcpip, peer not yet claimed
+    std::vector<ssh_channel> channels;
+    std::uint64_t wakeGeneration = 0;
+};
+
+struct ssh_channel_struct {
+    ssh_session session = nullptr;
+    int fd = -1;
+    int remotePort = 0;
+    bool open = true;
+    int peerFd = -1;          // until claimed by openedChannel
+    int openCalls = 0;
+    std::string targetHost;
+    bool remoteEof = false;   // peer closed its end
+    std::vector<char> buffer; // received; bytes before readOffset already read
+    std::size_t readOffset = 0;
+
+    std::size_t buffered() const { return buffer.size() - readOffset; }
+};
+
+struct ssh_key_struct {
+};
+
+namespace {
+
+std::atomic<std::uint32_t> g_windowSize{1280000};
+std::atomic<bool> g_refuseOpens{false};
+
+// Per-channel buffer limit, standing in for the local channel window
+constexpr std::size_t CHANNEL_BUFFER_LIMIT = 256 * 1024;
+
+void watch(ssh_session session, ssh_channel channel)
+{
+#ifdef __linux__
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLET;
+    epoll_ctl(session->pollFd, EPOLL_CTL_ADD, channel->fd, &event);
+#else
+    (void)session;
+    (void)channel;
+#endif
+}
+
+// Move what the peers have written into channel buffers
+void pump(ssh_session session)
+{
+    std::lock_guard<std::mutex> lock(session->mutex);
+#ifdef __linux__
+    // Consume the edges; every channel is looked at below anyway
+    struct epoll_event events[64];
+    while (epoll_wait(session->pollFd, events, 64, 0) == 64) {
+    }
+#endif
+    char chunk[65536];
+    for (ssh_channel channel : session->channels) {
+        while (!channel->remoteEof && channel->buffered() < CHANNEL_BUFFER_LIMIT) {
+            std::size_t room = std::min(sizeof(chunk), CHANNEL_BUFFER_LIMIT - channel->buffered());
+            ssize_t received = recv(channel->fd, chunk, room, MSG_DONTWAIT);
+            if (received > 0) {
+                channel->buffer.insert(channel->buffer.end(), chunk, chunk + received);
+                continue;
+            }
+            if (received == 0) {
+                channel->remoteEof = true;
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+namespace sshconn {
+namespace bench {
+namespace mock {
+
+int incomingChannel(ssh_session session, int remotePort)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        return -1;
+    }
+
+    auto* channel = new ssh_channel_struct;
+    channel->session = session;
+    channel->fd = fds[0];
+    channel->remotePort = remotePort;
+    watch(session, channel);
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->pending.push_back(channel);
+        session->channels.push_back(channel);
+    }
+    session->pendingChanged.notify_all();
+    return fds[1];
+}
+
+int openedChannel(ssh_session session, int timeoutMs, std::string* host, int* port)
+{
+    std::unique_lock<std::mutex> lock(session->mutex);
+    session->pendingChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] {
+        return !session->opened.empty();
+    });
+    if (session->opened.empty()) {
+        return -1;
+    }
+    ssh_channel channel = session->opened.front();
+    session->opened.pop_front();
+    if (host != nullptr) {
+        *host = channel->targetHost;
+    }
+    if (port != nullptr) {
+        *port = channel->remotePort;
+    }
+    int peer = channel->peerFd;
+    channel->peerFd = -1;
+    return peer;
+}
+
+void refuseOpens(bool refuse)
+{
+    g_refuseOpens.store(refuse);
+}
+
+void wakeAcceptors(ssh_session session)
+{
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        ++session->wakeGeneration;
+    }
+    session->pendingChanged.notify_all();
+}
+
+void setWindowSize(std::uint32_t bytes)
+{
+    g_windowSize.store(bytes);
+}
+
+} // namespace mock
+} // namespace bench
+} // namespace sshconn
+
+// Session
+
+ssh_session ssh_new(void)
+{
+    auto* session = new ssh_session_struct;
+#ifdef __linux__
+    session->pollFd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    return session;
+}
+
+void ssh_free(ssh_session session)
+{
+    if (session == nullptr) {
+        return;
+    }
+    std::deque<ssh_channel> pending;
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        pending.swap(session->pending);
+        for (ssh_channel channel : session->opened) {
+            close(channel->peerFd);
+            channel->peerFd = -1;
+        }
+        session->opened.clear();
+    }
+    for (ssh_channel channel : pending) {
+        ssh_channel_free(channel);
+    }
+    if (session->pollFd >= 0) {
+        close(session->pollFd);
+    }
+    delete session;
+}
+
+void ssh_set_blocking(ssh_session session, int blocking)
+{
+    session->blocking = blocking != 0;
+}
+
+socket_t ssh_get_fd(ssh_session session)
+{
+    return session->pollFd;
+}
+
+int ssh_options_set(ssh_session /*session*/, enum ssh_options_e /*type*/, const void* /*value*/)
+{
+    return SSH_OK;
+}
+
+int ssh_connect(ssh_session session)
+{
+    session->connected = true;
+    return SSH_OK;
+}
+
+void ssh_disconnect(ssh_session session)
+{
+    session->connected = false;
+}
+
+int ssh_is_connected(ssh_session session)
+{
+    return session->connected ? 1 : 0;
+}
+
+const char* ssh_get_error(void* /*error*/)
+{
+    return "mock libssh";
+}
+
+int ssh_send_keepalive(ssh_session /*session*/)
+{
+    return SSH_OK;
+}
+
+// Keys and authentication
+
+int ssh_pki_import_privkey_file(const char* /*filename*/, const char* /*passphrase*/,
+                                ssh_auth_callback /*auth_fn*/, void* /*auth_data*/, ssh_key* pkey)
+{
+    *pkey = new ssh_key_struct;
+    return SSH_OK;
+}
+
+void ssh_key_free(ssh_key key)
+{
+    delete key;
+}
+
+int ssh_userauth_publickey(ssh_session /*session*/, const char* /*username*/, const ssh_key /*privkey*/)
+{
+    return SSH_AUTH_SUCCESS;
+}
+
+// Port forwarding
+
+int ssh_channel_listen_forward(ssh_session /*session*/, const char* /*address*/, int port, int* bound_port)
+{
+    if (bound_port != nullptr) {
+        *bound_port = port;
+    }
+    return SSH_OK;
+}
+
+int ssh_channel_cancel_forward(ssh_session /*session*/, const char* /*address*/, int /*port*/)
+{
+    return SSH_OK;
+}
+
+ssh_channel ssh_channel_accept_forward(ssh_session session, int timeout_ms, int* destination_port)
+{
+    pump(session);
+
+    std::unique_lock<std::mutex> lock(session->mutex);
+    std::uint64_t generation = session->wakeGeneration;
+    session->pendingChanged.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] {
+        return !session->pending.empty() || session->wakeGeneration != generation;
+    });
+    if (session->pending.empty()) {
+        return nullptr;
+    }
+
+    ssh_channel channel = session->pending.front();
+    session->pending.pop_front();
+    if (destination_port != nullptr) {
+        *destination_port = channel->remotePort;
+    }
+    return channel;
+}
+
+// Channels
+
+ssh_channel ssh_channel_new(ssh_session session)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        return nullptr;
+    }
+    auto* channel = new ssh_channel_struct;
+    channel->session = session;
+    channel->fd = fds[0];
+    channel->peerFd = fds[1];
+    channel->open = false;
+    return channel;
+}
+
+int ssh_channel_open_forward(ssh_channel channel, const char* remotehost, int remoteport,
+                             const char* /*sourcehost*/, int /*localport*/)
+{
+    ssh_session session = channel->session;
+    if (!session->blocking && channel->openCalls++ == 0) {
+        return SSH_AGAIN; // Server's answer not in yet
+    }
+    if (g_refuseOpens.load()) {
+        return SSH_ERROR;
+    }
+
+    channel->open = true;
+    channel->targetHost = remotehost;
+    channel->remotePort = remoteport;
+    watch(session, channel);
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        session->channels.push_back(channel);
+        session->opened.push_back(channel);
+    }
+    session->pendingChanged.notify_all();
+    return SSH_OK;
+}
+
+int ssh_channel_read_nonblocking(ssh_channel channel, void* dest, uint32_t count, int /*is_stderr*/)
+{
+    pump(channel->session);
+    if (channel->buffered() == 0) {
+        return channel->remoteEof ? SSH_EOF : 0;
+    }
+    std::size_t n = std::min<std::size_t>(count, channel->buffered());
+    std::memcpy(dest, channel->buffer.data() + channel->readOffset, n);
+    channel->readOffset += n;
+    if (channel->readOffset == channel->buffer.size()) {
+        channel->buffer.clear();
+        channel->readOffset = 0;
+    } else if (channel->readOffset > channel->buffer.size() / 2) {
+        channel->buffer.erase(channel->buffer.begin(),
+                              channel->buffer.begin() + static_cast<std::ptrdiff_t>(channel->readOffset));
+        channel->readOffset = 0;
+    }
+    return static_cast<int>(n);
+}
+
+int ssh_channel_poll(ssh_channel channel, int /*is_stderr*/)
+{
+    pump(channel->session);
+    if (channel->buffered() == 0 && channel->remoteEof) {
+        return SSH_EOF;
+    }
+    return static_cast<int>(channel->buffered());
+}
+
+int ssh_channel_write(ssh_channel channel, const void* data, uint32_t len)
+{
+    const char* bytes = static_cast<const char*>(data);
+    uint32_t total = 0;
+    while (total < len) {
+        ssize_t sent = send(channel->fd, bytes + total, len - total, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return SSH_ERROR;
+        }
+        total += static_cast<uint32_t>(sent);
+    }
+    return static_cast<int>(len);
+}
+
+uint32_t ssh_channel_window_size(ssh_channel /*channel*/)
+{
+    return g_windowSize.load();
+}
+
+int ssh_channel_is_open(ssh_channel channel)
+{
+    return channel->open ? 1 : 0;
+}
+
+int ssh_channel_is_closed(ssh_channel channel)
+{
+    // Both directions shut, as after the peer closed its end; a peer that
+    // only half-closed leaves the channel open
+    if (!channel->open) {
+        return 1;
+    }
+    struct pollfd pfd;
+    pfd.fd = channel->fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLHUP) != 0 ? 1 : 0;
+}
+
+int ssh_channel_is_eof(ssh_channel channel)
+{
+    // Like libssh, EOF is only reported once buffered data has been read
+    pump(channel->session);
+    return channel->buffered() == 0 && channel->remoteEof ? 1 : 0;
+}
+
+int ssh_channel_send_eof(ssh_channel channel)
+{
+    shutdown(channel->fd, SHUT_WR);
+    return SSH_OK;
+}
+
+int ssh_channel_close(ssh_channel channel)
+{
+    if (channel->open) {
+        channel->open = false;
+        shutdown(channel->fd, SHUT_RDWR);
+    }
+    return SSH_OK;
+}
+
+void ssh_channel_free(ssh_channel channel)
+{
+    if (channel == nullptr) {
+        return;
+    }
+    {
+        ssh_session session = channel->session;
+        std::lock_guard<std::mutex> lock(session->mutex);
+        auto& channels = session->channels;
+        channels.erase(std::remove(channels.begin(), channels.end(), channel), channels.end());
+        auto& opened = session->opened;
+        opened.erase(std::remove(opened.begin(), opened.end(), channel), opened.end());
+    }
+    // Closing the descriptor also drops it from the session's epoll set
+    close(channel->fd);
+    if (channel->peerFd >= 0) {
+        close(channel->peerFd); // Opened but never claimed, or never opened
+    }
+    delete channel;
+}
@@ -0,0 +1,43 @@
+#ifndef MOCK_LIBSSH_H
+#define MOCK_LIBSSH_H
+
+#include <cstdint>
+#include <string>
+#include <libssh/libssh.h>
+
+// In-memory replacement for the libssh client calls made by SSHClient and
+// TunnelHandler. ssh-connector-microbench links this instead of libssh, so
+// sessions always connect and authenticate, and every forwarded or opened
+// channel is one end of a socketpair whose other end belongs to the benchmark.
+
+namespace sshconn {
+namespace bench {
+namespace mock {
+
+// Queue a forwarded channel for ssh_channel_accept_forward on `session` and
+// return the peer descriptor: bytes written to it are read from the channel,
+// closing it delivers channel EOF. `remotePort` is reported as the
+// destination port (0 = unknown, as with servers that omit it).
+int incomingChannel(ssh_session session, int remotePort = 0);
+
+// Wait up to `timeoutMs` for a direct-tcpip channel opened on `session` with
+// ssh_channel_open_forward and return its peer descriptor (-1 on timeout);
+// `host` and `port` receive the requested target. Opens on a non-blocking
+// session first return SSH_AGAIN once, like a server that has not answered.
+int openedChannel(ssh_session session, int timeoutMs, std::string* host = nullptr, int* port = nullptr);
+
+// Make ssh_channel_open_forward fail, as for a target the server cannot reach
+void refuseOpens(bool refuse);
+
+// Make every ssh_channel_accept_forward blocked on `session` return nullptr
+// now, so a stopping TunnelHandler does not wait out its accept timeout
+void wakeAcceptors(ssh_session session);
+
+// Value reported by ssh_channel_window_size for all channels
+void setWindowSize(std::uint32_t bytes);
+
+} // namespace mock
+} // namespace bench
+} // namespace sshconn
+
+#endif // MOCK_LIBSSH_H
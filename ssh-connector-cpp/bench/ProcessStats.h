@@ -0,0 +1,81 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <dirent.h>
+#include <mach/mach.h>
+#else
+#include <dirent.h>
+#include <fstream>
+#include <unistd.h>
+#endif
+
+namespace sshconn {
+namespace bench {
+
+// Number of open descriptors (handles on Windows) in this process, -1 if unknown
+inline long openDescriptorCount()
+{
+#ifdef _WIN32
+    DWORD count = 0;
+    if (!GetProcessHandleCount(GetCurrentProcess(), &count)) {
+        return -1;
+    }
+    return static_cast<long>(count);
+#else
+#ifdef __APPLE__
+    DIR* dir = opendir("/dev/fd");
+#else
+    DIR* dir = opendir("/proc/self/fd");
+#endif
+    if (!dir) {
+        return -1;
+    }
+    long count = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            ++count;
+        }
+    }
+    closedir(dir);
+    return count - 1; // The directory stream itself
+#endif
+}
+
+// Resident set size of this process in bytes, 0 if unknown
+inline std::uint64_t residentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                  reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+#else
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t sizePages = 0;
+    std::uint64_t residentPages = 0;
+    if (!(statm >> sizePages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // PROCESS_STATS_H
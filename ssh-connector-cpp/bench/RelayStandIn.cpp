@@ -0,0 +1,537 @@
+#include "RelayStandIn.h"
+#include "BenchSocket.h"
+
+#include <libssh/callbacks.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <poll.h>
+#include <sys/select.h>
+#endif
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr int EVENT_POLL_MS = 10;
+constexpr std::size_t IO_CHUNK = 32768;
+
+bool wouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// Send on a non-blocking socket, waiting for writability as needed
+bool sendAllWaiting(int sock, const char* data, std::size_t len)
+{
+    std::size_t total = 0;
+    while (total < len) {
+        int sent = send(sock, data + total, static_cast<int>(len - total), 0);
+        if (sent > 0) {
+            total += static_cast<std::size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && wouldBlock()) {
+            fd_set writeSet;
+            FD_ZERO(&writeSet);
+            FD_SET(sock, &writeSet);
+            struct timeval tv;
+            tv.tv_sec = 5;
+            tv.tv_usec = 0;
+            if (select(sock + 1, nullptr, &writeSet, nullptr, &tv) <= 0) {
+                return false;
+            }
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Connect to a direct-tcpip target. Blocking, which is fine for the loopback
+// services the benchmark points tunnels at: the connect completes at once.
+int connectTarget(const char* host, int port)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+    int sock = -1;
+    for (struct addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        sock = static_cast<int>(socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+        if (sock < 0) {
+            continue;
+        }
+        if (::connect(sock, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0) {
+            break;
+        }
+        closeSocket(sock);
+        sock = -1;
+    }
+    freeaddrinfo(result);
+    return sock;
+}
+
+} // namespace
+
+struct RelayStandIn::Listener {
+    SessionContext* context = nullptr;
+    int socket = -1;
+    int port = 0;
+    bool registered = false;
+};
+
+// One relayed connection: a forwarded-tcpip channel the stand-in opens for a
+// connection to a listener, or a direct-tcpip channel the client opened
+struct RelayStandIn::Relay {
+    enum class State { Opening, Open, Done };
+
+    SessionContext* context = nullptr;
+    State state = State::Opening;
+    int socket = -1;
+    int forwardPort = 0;
+    int peerPort = 0;
+    ssh_channel channel = nullptr;
+    ssh_channel_callbacks_struct callbacks{};
+    std::string toChannel;  // read from the socket, not yet accepted by the channel
+    bool registered = false;
+    bool opened = false;
+    bool socketEof = false;
+    bool eofSent = false;
+    bool channelEof = false;
+    bool channelClosed = false;
+};
+
+struct RelayStandIn::SessionContext {
+    RelayStandIn* owner = nullptr;
+    ssh_session session = nullptr;
+    ssh_event event = nullptr;
+    std::map<int, std::unique_ptr<Listener>> listeners; // by bound port
+    std::vector<int> cancelledPorts;
+    std::vector<std::unique_ptr<Relay>> relays;
+};
+
+RelayStandIn::~RelayStandIn()
+{
+    stop();
+}
+
+bool RelayStandIn::start()
+{
+    // Ephemeral host key; the client does not verify host keys
+    ssh_key hostKey = nullptr;
+    if (ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &hostKey) != SSH_OK) {
+        return false;
+    }
+
+    m_port = freeLoopbackPort();
+    m_bind = ssh_bind_new();
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_BINDADDR, "127.0.0.1");
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_BINDPORT, &m_port);
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_IMPORT_KEY, hostKey); // owned by the bind from here on
+
+    if (m_port <= 0 || ssh_bind_listen(m_bind) != SSH_OK) {
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+        return false;
+    }
+
+    m_stopRequested.store(false);
+    m_acceptThread = std::thread(&RelayStandIn::acceptLoop, this);
+    return true;
+}
+
+void RelayStandIn::stop()
+{
+    m_stopRequested.store(true);
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+
+    std::vector<std::thread> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sessions.swap(m_sessionThreads);
+    }
+    for (auto& thread : sessions) {
+        thread.join();
+    }
+
+    if (m_bind != nullptr) {
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+    }
+}
+
+bool RelayStandIn::waitForForward(int remotePort, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_forwardsChanged.wait_for(lock, timeout, [&] {
+        return m_boundForwards.count(remotePort) > 0;
+    });
+}
+
+void RelayStandIn::forwardBound(int remotePort)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_boundForwards.insert(remotePort);
+    m_forwardsChanged.notify_all();
+}
+
+void RelayStandIn::forwardReleased(int remotePort)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_boundForwards.find(remotePort);
+    if (it != m_boundForwards.end()) {
+        m_boundForwards.erase(it);
+    }
+    m_forwardsChanged.notify_all();
+}
+
+void RelayStandIn::acceptLoop()
+{
+    int bindSocket = static_cast<int>(ssh_bind_get_fd(m_bind));
+
+    while (!m_stopRequested.load()) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(bindSocket, &readSet);
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100 * 1000;
+        if (select(bindSocket + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+            continue;
+        }
+
+        ssh_session session = ssh_new();
+        if (ssh_bind_accept(m_bind, session) != SSH_OK) {
+            ssh_free(session);
+            continue;
+        }
+
+        m_sessionsAccepted.fetch_add(1);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessionThreads.emplace_back(&RelayStandIn::runSession, this, session);
+    }
+}
+
+void RelayStandIn::runSession(ssh_session session)
+{
+    if (ssh_handle_key_exchange(session) != SSH_OK) {
+        ssh_disconnect(session);
+        ssh_free(session);
+        return;
+    }
+
+    SessionContext context;
+    context.owner = this;
+    context.session = session;
+    context.event = ssh_event_new();
+
+    // From here on every libssh call on this session must not block: the same
+    // thread services all relays, and a blocking channel open would wait on a
+    // client that is itself waiting for relay traffic.
+    ssh_set_blocking(session, 0);
+    ssh_set_message_callback(session, &RelayStandIn::onMessage, &context);
+    ssh_event_add_session(context.event, session);
+
+    while (!m_stopRequested.load() && ssh_is_connected(session)) {
+        if (ssh_event_dopoll(context.event, EVENT_POLL_MS) == SSH_ERROR) {
+            break;
+        }
+
+        // Listener registration changes are deferred out of the poll callbacks
+        for (int port : context.cancelledPorts) {
+            auto it = context.listeners.find(port);
+            if (it == context.listeners.end()) continue;
+            if (it->second->registered) {
+                ssh_event_remove_fd(context.event, it->second->socket);
+            }
+            closeSocket(it->second->socket);
+            context.listeners.erase(it);
+            forwardReleased(port);
+        }
+        context.cancelledPorts.clear();
+
+        for (auto& [port, listener] : context.listeners) {
+            if (!listener->registered) {
+                ssh_event_add_fd(context.event, listener->socket, POLLIN, &RelayStandIn::onListenerReadable, listener.get());
+                listener->registered = true;
+                forwardBound(port);
+            }
+        }
+
+        for (auto& relay : context.relays) {
+            if (relay->state == Relay::State::Opening) {
+                int rc = ssh_channel_open_reverse_forward(relay->channel, "127.0.0.1", relay->forwardPort,
+                                                          "127.0.0.1", relay->peerPort);
+                if (rc == SSH_AGAIN) {
+                    continue;
+                }
+                if (rc != SSH_OK) {
+                    relay->state = Relay::State::Done;
+                } else {
+                    watchChannel(*relay);
+                }
+            }
+
+            if (relay->state == Relay::State::Open) {
+                // Push buffered socket data into the channel as its window allows
+                if (!relay->toChannel.empty()) {
+                    int written = ssh_channel_write(relay->channel, relay->toChannel.data(),
+                                                    static_cast<uint32_t>(relay->toChannel.size()));
+                    if (written == SSH_ERROR) {
+                        relay->state = Relay::State::Done;
+                    } else if (written > 0) {
+                        relay->toChannel.erase(0, static_cast<std::size_t>(written));
+                    }
+                }
+                if (relay->socketEof && relay->toChannel.empty() && !relay->eofSent && !relay->channelClosed) {
+                    ssh_channel_send_eof(relay->channel);
+                    relay->eofSent = true;
+                }
+                if (relay->channelClosed || (relay->channelEof && relay->socketEof && relay->toChannel.empty())) {
+                    relay->state = Relay::State::Done;
+                }
+            }
+
+            bool wantRead = relay->state == Relay::State::Open && !relay->socketEof && relay->toChannel.empty();
+            if (wantRead != relay->registered) {
+                if (wantRead) {
+                    ssh_event_add_fd(context.event, relay->socket, POLLIN, &RelayStandIn::onSocketReadable, relay.get());
+                } else {
+                    ssh_event_remove_fd(context.event, relay->socket);
+                }
+                relay->registered = wantRead;
+            }
+        }
+
+        // Tear down finished relays
+        auto done = std::remove_if(context.relays.begin(), context.relays.end(), [this, &context](const std::unique_ptr<Relay>& relay) {
+            if (relay->state != Relay::State::Done) {
+                return false;
+            }
+            if (relay->registered) {
+                ssh_event_remove_fd(context.event, relay->socket);
+            }
+            if (relay->opened && !relay->channelClosed) {
+                ssh_channel_close(relay->channel);
+            }
+            ssh_channel_free(relay->channel);
+            if (relay->opened) {
+                m_channelsClosed.fetch_add(1);
+            }
+            closeSocket(relay->socket);
+            return true;
+        });
+        context.relays.erase(done, context.relays.end());
+    }
+
+    for (auto& relay : context.relays) {
+        if (relay->registered) {
+            ssh_event_remove_fd(context.event, relay->socket);
+        }
+        ssh_channel_free(relay->channel);
+        if (relay->opened) {
+            m_channelsClosed.fetch_add(1);
+        }
+        closeSocket(relay->socket);
+    }
+    for (auto& [port, listener] : context.listeners) {
+        if (listener->registered) {
+            ssh_event_remove_fd(context.event, listener->socket);
+            forwardReleased(port);
+        }
+        closeSocket(listener->socket);
+    }
+
+    ssh_event_remove_session(context.event, session);
+    ssh_event_free(context.event);
+    ssh_disconnect(session);
+    ssh_free(session);
+}
+
+int RelayStandIn::onMessage(ssh_session /*session*/, ssh_message message, void* userdata)
+{
+    auto* context = static_cast<SessionContext*>(userdata);
+
+    switch (ssh_message_type(message)) {
+        case SSH_REQUEST_AUTH:
+            if (ssh_message_subtype(message) == SSH_AUTH_METHOD_PUBLICKEY) {
+                // Any key is accepted; signature validity is still checked by libssh
+                if (ssh_message_auth_publickey_state(message) == SSH_PUBLICKEY_STATE_VALID) {
+                    ssh_message_auth_reply_success(message, 0);
+                } else {
+                    ssh_message_auth_reply_pk_ok_simple(message);
+                }
+                return 0;
+            }
+            ssh_message_auth_set_methods(message, SSH_AUTH_METHOD_PUBLICKEY);
+            return 1;
+
+        case SSH_REQUEST_CHANNEL_OPEN:
+            if (ssh_message_subtype(message) == SSH_CHANNEL_DIRECT_TCPIP) {
+                return acceptDirect(context, message) ? 0 : 1;
+            }
+            return 1;
+
+        case SSH_REQUEST_GLOBAL:
+            if (ssh_message_subtype(message) == SSH_GLOBAL_REQUEST_TCPIP_FORWARD) {
+                int requested = ssh_message_global_request_port(message);
+                auto listener = std::make_unique<Listener>();
+                listener->context = context;
+                listener->socket = listenLoopback(requested, listener->port);
+                if (listener->socket < 0) {
+                    return 1; // Default reply refuses the request
+                }
+                setNonBlocking(listener->socket, true);
+                ssh_message_global_request_reply_success(message, static_cast<uint16_t>(listener->port));
+                context->listeners[listener->port] = std::move(listener);
+                return 0;
+            }
+            if (ssh_message_subtype(message) == SSH_GLOBAL_REQUEST_CANCEL_TCPIP_FORWARD) {
+                // Like sshd, refuse to cancel what was never bound
+                int port = ssh_message_global_request_port(message);
+                if (context->listeners.count(port) == 0) {
+                    return 1;
+                }
+                context->cancelledPorts.push_back(port);
+                ssh_message_global_request_reply_success(message, 0);
+                return 0;
+            }
+            return 1;
+
+        default:
+            return 1;
+    }
+}
+
+bool RelayStandIn::acceptDirect(SessionContext* context, ssh_message message)
+{
+    // Connect first, so an unreachable target is refused like sshd refuses it
+    int sock = connectTarget(ssh_message_channel_request_open_destination(message),
+                             ssh_message_channel_request_open_destination_port(message));
+    if (sock < 0) {
+        context->owner->m_directOpensRefused.fetch_add(1);
+        return false;
+    }
+    ssh_channel channel = ssh_message_channel_request_open_reply_accept(message);
+    if (channel == nullptr) {
+        closeSocket(sock);
+        return true; // Already answered
+    }
+    setNonBlocking(sock, true);
+    setNoDelay(sock);
+
+    auto relay = std::make_unique<Relay>();
+    relay->context = context;
+    relay->socket = sock;
+    relay->channel = channel;
+    watchChannel(*relay);
+    context->relays.push_back(std::move(relay));
+    return true;
+}
+
+void RelayStandIn::watchChannel(Relay& relay)
+{
+    ssh_callbacks_init(&relay.callbacks);
+    relay.callbacks.userdata = &relay;
+    relay.callbacks.channel_data_function = &RelayStandIn::onChannelData;
+    relay.callbacks.channel_eof_function = &RelayStandIn::onChannelEof;
+    relay.callbacks.channel_close_function = &RelayStandIn::onChannelClose;
+    ssh_set_channel_callbacks(relay.channel, &relay.callbacks);
+    relay.state = Relay::State::Open;
+    relay.opened = true;
+    relay.context->owner->m_channelsOpened.fetch_add(1);
+}
+
+int RelayStandIn::onListenerReadable(socket_t /*fd*/, int /*revents*/, void* userdata)
+{
+    auto* listener = static_cast<Listener*>(userdata);
+    SessionContext* context = listener->context;
+
+    for (;;) {
+        struct sockaddr_in peer;
+        socklen_t peerLen = sizeof(peer);
+        int client = static_cast<int>(accept(listener->socket, reinterpret_cast<struct sockaddr*>(&peer), &peerLen));
+        if (client < 0) {
+            break;
+        }
+        setNonBlocking(client, true);
+        setNoDelay(client);
+
+        auto relay = std::make_unique<Relay>();
+        relay->context = context;
+        relay->socket = client;
+        relay->forwardPort = listener->port;
+        relay->peerPort = ntohs(peer.sin_port);
+        relay->channel = ssh_channel_new(context->session);
+        if (relay->channel == nullptr) {
+            closeSocket(client);
+            continue;
+        }
+        context->relays.push_back(std::move(relay));
+    }
+    return 0;
+}
+
+int RelayStandIn::onSocketReadable(socket_t /*fd*/, int /*revents*/, void* userdata)
+{
+    auto* relay = static_cast<Relay*>(userdata);
+    if (!relay->toChannel.empty() || relay->socketEof) {
+        return 0; // Back-pressure: wait until the channel has taken the previous chunk
+    }
+
+    char buffer[IO_CHUNK];
+    int received = recv(relay->socket, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+        relay->toChannel.assign(buffer, static_cast<std::size_t>(received));
+    } else if (received == 0 || !wouldBlock()) {
+        relay->socketEof = true;
+    }
+    return 0;
+}
+
+int RelayStandIn::onChannelData(ssh_session /*session*/, ssh_channel /*channel*/, void* data,
+                                uint32_t len, int /*isStderr*/, void* userdata)
+{
+    auto* relay = static_cast<Relay*>(userdata);
+    if (!sendAllWaiting(relay->socket, static_cast<const char*>(data), len)) {
+        relay->state = Relay::State::Done;
+    }
+    return static_cast<int>(len);
+}
+
+void RelayStandIn::onChannelEof(ssh_session /*session*/, ssh_channel /*channel*/, void* userdata)
+{
+    auto* relay = static_cast<Relay*>(userdata);
+    relay->channelEof = true;
+    shutdown(relay->socket, 1); // SHUT_WR / SD_SEND
+}
+
+void RelayStandIn::onChannelClose(ssh_session /*session*/, ssh_channel /*channel*/, void* userdata)
+{
+    auto* relay = static_cast<Relay*>(userdata);
+    relay->channelClosed = true;
+}
+
+} // namespace bench
+} // namespace sshconn
@@ -0,0 +1,87 @@
+#ifndef RELAY_STAND_IN_H
+#define RELAY_STAND_IN_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <libssh/libssh.h>
+#include <libssh/server.h>
+
+namespace sshconn {
+namespace bench {
+
+// In-process SSH server on loopback that plays the relay's role: it accepts
+// any public key, honours tcpip-forward requests by listening on the requested
+// loopback port, and opens a forwarded-tcpip channel back to the client for
+// every TCP connection made to that port. direct-tcpip channels the client
+// opens (local and dynamic tunnels, the end-to-end probe) are connected to the
+// requested host and port and relayed the same way.
+class RelayStandIn {
+public:
+    RelayStandIn() = default;
+    ~RelayStandIn();
+
+    // Prevent copying
+    RelayStandIn(const RelayStandIn&) = delete;
+    RelayStandIn& operator=(const RelayStandIn&) = delete;
+
+    bool start();
+    void stop();
+    int port() const { return m_port; }
+
+    // Block until some session has bound a remote forward on `remotePort`
+    bool waitForForward(int remotePort, std::chrono::milliseconds timeout);
+
+    // Channels of both directions
+    std::uint64_t channelsOpened() const { return m_channelsOpened.load(); }
+    std::uint64_t channelsClosed() const { return m_channelsClosed.load(); }
+    std::uint64_t sessionsAccepted() const { return m_sessionsAccepted.load(); }
+    std::uint64_t directOpensRefused() const { return m_directOpensRefused.load(); }
+
+private:
+    struct SessionContext;
+    struct Listener;
+    struct Relay;
+
+    void acceptLoop();
+    void runSession(ssh_session session);
+
+    void forwardBound(int remotePort);
+    void forwardReleased(int remotePort);
+
+    static int onMessage(ssh_session session, ssh_message message, void* userdata);
+    static bool acceptDirect(SessionContext* context, ssh_message message);
+    static void watchChannel(Relay& relay);
+    static int onListenerReadable(socket_t fd, int revents, void* userdata);
+    static int onSocketReadable(socket_t fd, int revents, void* userdata);
+    static int onChannelData(ssh_session session, ssh_channel channel, void* data,
+                             uint32_t len, int isStderr, void* userdata);
+    static void onChannelEof(ssh_session session, ssh_channel channel, void* userdata);
+    static void onChannelClose(ssh_session session, ssh_channel channel, void* userdata);
+
+    ssh_bind m_bind = nullptr;
+    int m_port = 0;
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_acceptThread;
+
+    std::mutex m_mutex;
+    std::condition_variable m_forwardsChanged;
+    std::multiset<int> m_boundForwards;
+    std::vector<std::thread> m_sessionThreads;
+
+    std::atomic<std::uint64_t> m_channelsOpened{0};
+    std::atomic<std::uint64_t> m_channelsClosed{0};
+    std::atomic<std::uint64_t> m_sessionsAccepted{0};
+    std::atomic<std::uint64_t> m_directOpensRefused{0};
+};
+
+} // namespace bench
+} // namespace sshconn
+
+#endif // RELAY_STAND_IN_H
@@ -0,0 +1,465 @@
+#include "BenchEnvironment.h"
+#include "BenchSocket.h"
+#include "ChurnBench.h"
+#include "LoopbackService.h"
+#include "core/Logger.h"
+#include "core/Metrics.h"
+
+#include <libssh/libssh.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr int SOCKET_TIMEOUT_MS = 30000;
+constexpr std::size_t BULK_CHUNK = 65536;
+
+struct BenchOptions {
+    std::string mode = "sweep";
+    int maxClients = 8;
+    double durationSeconds = 5.0;
+    std::uint64_t bulkBytes = 64ull * 1024 * 1024;
+    std::uint32_t echoSize = 64;
+    RekeyConfig rekey;
+    std::vector<std::int64_t> rekeySweepMb{64, 256, 1024};
+    TunnelType tunnelType = TunnelType::Remote;
+    double probeSeconds = 0.0;
+    std::string outputPath;
+    ChurnOptions churn;
+};
+
+void writeBigEndian(unsigned char* out, std::uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = static_cast<unsigned char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+json latencySummary(const Histogram& histogram)
+{
+    return {
+        {"samples", histogram.count()},
+        {"p50_us", histogram.percentile(0.50)},
+        {"p90_us", histogram.percentile(0.90)},
+        {"p99_us", histogram.percentile(0.99)},
+        {"p999_us", histogram.percentile(0.999)},
+        {"max_us", histogram.percentile(1.0)},
+    };
+}
+
+// Run `clients` copies of `body` in parallel, released together
+template <typename Body>
+double runParallel(int clients, Body body)
+{
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&go, &body, i] {
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            body(i);
+        });
+    }
+
+    auto start = Clock::now();
+    go.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Each client pushes its share of bulkBytes into the sink and waits for the ack
+json runThroughput(const BenchEnvironment& environment, int clients, const BenchOptions& options)
+{
+    std::atomic<int> errors{0};
+    std::uint64_t perClient = options.bulkBytes / static_cast<std::uint64_t>(clients);
+
+    double elapsed = runParallel(clients, [&](int) {
+        int sock = environment.connectClient(SOCKET_TIMEOUT_MS);
+        if (sock < 0) {
+            errors.fetch_add(1);
+            return;
+        }
+
+        std::vector<char> chunk(BULK_CHUNK, 'x');
+        unsigned char header[9];
+        header[0] = LoopbackService::CMD_SINK;
+        writeBigEndian(header + 1, perClient, 8);
+        bool ok = sendAll(sock, reinterpret_cast<char*>(header), sizeof(header));
+
+        std::uint64_t remaining = perClient;
+        while (ok && remaining > 0) {
+            std::size_t len = remaining < BULK_CHUNK ? static_cast<std::size_t>(remaining) : BULK_CHUNK;
+            ok = sendAll(sock, chunk.data(), len);
+            remaining -= len;
+        }
+
+        char ack = 0;
+        if (!ok || !recvAll(sock, &ack, 1) || ack != LoopbackService::SINK_ACK) {
+            errors.fetch_add(1);
+        }
+        closeSocket(sock);
+    });
+
+    double megabytes = static_cast<double>(perClient * static_cast<std::uint64_t>(clients)) / (1024.0 * 1024.0);
+    return {
+        {"bytes", perClient * static_cast<std::uint64_t>(clients)},
+        {"seconds", elapsed},
+        {"mb_per_sec", elapsed > 0 ? megabytes / elapsed : 0.0},
+        {"errors", errors.load()},
+    };
+}
+
+// Each client keeps one connection and issues back-to-back echo requests
+json runLatency(const BenchEnvironment& environment, int clients, const BenchOptions& options)
+{
+    Histogram rtt;
+    std::atomic<int> errors{0};
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.durationSeconds));
+
+    double elapsed = runParallel(clients, [&](int) {
+        int sock = environment.connectClient(SOCKET_TIMEOUT_MS);
+        if (sock < 0) {
+            errors.fetch_add(1);
+            return;
+        }
+
+        std::vector<char> request(5 + options.echoSize, 'e');
+        std::vector<char> response(options.echoSize);
+        request[0] = LoopbackService::CMD_ECHO;
+        writeBigEndian(reinterpret_cast<unsigned char*>(request.data()) + 1, options.echoSize, 4);
+
+        while (Clock::now() < deadline) {
+            auto sentAt = Clock::now();
+            if (!sendAll(sock, request.data(), request.size()) ||
+                !recvAll(sock, response.data(), response.size())) {
+                errors.fetch_add(1);
+                break;
+            }
+            rtt.record(Clock::now() - sentAt);
+        }
+        closeSocket(sock);
+    });
+
+    json result = latencySummary(rtt);
+    result["requests_per_sec"] = elapsed > 0 ? static_cast<double>(rtt.count()) / elapsed : 0.0;
+    result["errors"] = errors.load();
+    return result;
+}
+
+// Each client opens a connection, does one 1-byte echo and closes, repeatedly
+json runConnectionRate(const BenchEnvironment& environment, int clients, const BenchOptions& options)
+{
+    Histogram setup;
+    std::atomic<std::uint64_t> completed{0};
+    std::atomic<int> errors{0};
+    auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.durationSeconds));
+
+    double elapsed = runParallel(clients, [&](int) {
+        const char request[6] = {LoopbackService::CMD_ECHO, 0, 0, 0, 1, 'c'};
+        while (Clock::now() < deadline) {
+            auto startedAt = Clock::now();
+            int sock = environment.connectClient(SOCKET_TIMEOUT_MS);
+            if (sock < 0) {
+                errors.fetch_add(1);
+                continue;
+            }
+            char reply = 0;
+            if (sendAll(sock, request, sizeof(request)) && recvAll(sock, &reply, 1)) {
+                setup.record(Clock::now() - startedAt);
+                completed.fetch_add(1);
+            } else {
+                errors.fetch_add(1);
+            }
+            closeSocket(sock);
+        }
+    });
+
+    json result = latencySummary(setup);
+    result["connections"] = completed.load();
+    result["connections_per_sec"] = elapsed > 0 ? static_cast<double>(completed.load()) / elapsed : 0.0;
+    result["errors"] = errors.load();
+    return result;
+}
+
+void printUsage()
+{
+    std::cout << "Usage: ssh-connector-bench [options]\n"
+              << "  --mode MODE       sweep (throughput/latency/connection rate), churn or rekey,\n"
+              << "                    default sweep\n"
+              << "  --clients N       sweep: highest concurrency level (1, 2, 4, ... N)\n"
+              << "                    churn: concurrent connection loops; default 8\n"
+              << "  --duration S      seconds per latency / connection-rate run, default 5\n"
+              << "  --bulk-mb M       megabytes pushed per throughput run, default 64\n"
+              << "  --echo-size B     request size for the latency run, default 64\n"
+              << "  --rekey-mb M      rekey after M megabytes per direction, 0 = cipher limit, default 1024\n"
+              << "  --rekey-sec S     rekey after S seconds, 0 = never, default 3600\n"
+              << "  --rekey-sweep L   rekey mode: data limits in megabytes, comma-separated,\n"
+              << "                    default 64,256,1024\n"
+              << "  --tunnel TYPE     remote, local or dynamic (SOCKS5), default remote\n"
+              << "  --probe-sec S     run the end-to-end probe every S seconds, 0 = off, default 0\n"
+              << "  --rate R          churn: target connections/sec, 0 = unthrottled, default 0\n"
+              << "  --soak S          churn: soak period in seconds, default 60\n"
+              << "  --sample-every S  churn: RSS / fd / latency sample interval, default 10\n"
+              << "  --output FILE     write JSON results to FILE instead of stdout\n";
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--mode" && hasValue) {
+            options.mode = argv[++i];
+        } else if (arg == "--clients" && hasValue) {
+            options.maxClients = std::atoi(argv[++i]);
+        } else if (arg == "--duration" && hasValue) {
+            options.durationSeconds = std::atof(argv[++i]);
+        } else if (arg == "--bulk-mb" && hasValue) {
+            options.bulkBytes = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--echo-size" && hasValue) {
+            options.echoSize = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--rekey-mb" && hasValue) {
+            options.rekey.dataBytes = std::strtoll(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--rekey-sec" && hasValue) {
+            options.rekey.timeSeconds = std::atoi(argv[++i]);
+        } else if (arg == "--rekey-sweep" && hasValue) {
+            options.rekeySweepMb.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                options.rekeySweepMb.push_back(std::strtoll(item.c_str(), nullptr, 10));
+            }
+        } else if (arg == "--tunnel" && hasValue) {
+            if (!tunnelTypeFromString(argv[++i], options.tunnelType)) {
+                return false;
+            }
+        } else if (arg == "--probe-sec" && hasValue) {
+            options.probeSeconds = std::atof(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            options.churn.ratePerSecond = std::atof(argv[++i]);
+        } else if (arg == "--soak" && hasValue) {
+            options.churn.soakSeconds = std::atof(argv[++i]);
+        } else if (arg == "--sample-every" && hasValue) {
+            options.churn.sampleSeconds = std::atof(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    options.churn.clients = options.maxClients;
+    for (std::int64_t megabytes : options.rekeySweepMb) {
+        if (megabytes < 0) {
+            return false;
+        }
+    }
+    return (options.mode == "sweep" || options.mode == "churn" || options.mode == "rekey") &&
+           !options.rekeySweepMb.empty() &&
+           options.maxClients > 0 && options.durationSeconds > 0 && options.echoSize > 0 && options.probeSeconds >= 0 &&
+           options.rekey.dataBytes >= 0 && options.rekey.timeSeconds >= 0 && options.churn.ratePerSecond >= 0 && options.churn.soakSeconds > 0 && options.churn.sampleSeconds > 0;
+}
+
+void runSweep(BenchEnvironment& environment, const BenchOptions& options, json& report)
+{
+    std::vector<int> levels;
+    for (int clients = 1; clients < options.maxClients; clients *= 2) {
+        levels.push_back(clients);
+    }
+    levels.push_back(options.maxClients);
+
+    for (int clients : levels) {
+        std::cerr << "Running with " << clients << " concurrent client(s)..." << std::endl;
+        json run;
+        run["clients"] = clients;
+        run["throughput"] = runThroughput(environment, clients, options);
+        run["latency"] = runLatency(environment, clients, options);
+        run["connection_rate"] = runConnectionRate(environment, clients, options);
+        report["runs"].push_back(run);
+    }
+}
+
+int writeReport(const json& report, const std::string& path)
+{
+    std::string output = report.dump(2);
+    if (path.empty()) {
+        std::cout << output << std::endl;
+        return 0;
+    }
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return 1;
+    }
+    file << output << "\n";
+    return 0;
+}
+
+// One session per data limit, each pushing bulkBytes through the tunnel with
+// the probe running, so the rekeys' cost can be compared across limits
+json runRekeySweep(const BenchOptions& options)
+{
+    json runs = json::array();
+    SessionMetrics& session = MetricsRegistry::instance().session();
+    for (std::int64_t megabytes : options.rekeySweepMb) {
+        std::cerr << "Running with a rekey every " << megabytes << " MB..." << std::endl;
+        RekeyConfig rekey;
+        rekey.dataBytes = megabytes * 1024 * 1024;
+        rekey.timeSeconds = 0;
+
+        BenchEnvironment environment;
+        environment.setRekeyPolicy(rekey);
+        environment.setTunnelType(options.tunnelType);
+        environment.setProbeInterval(options.probeSeconds > 0 ? options.probeSeconds : 1.0);
+        std::string error;
+        if (!environment.setUp(error)) {
+            runs.push_back({{"data_mb", megabytes}, {"error", error}});
+            continue;
+        }
+
+        // The session series are process-wide: count this run's share
+        std::uint64_t rekeysBefore = session.rekeys.value();
+        std::uint64_t probesBefore = session.rekeyProbeLatency.count();
+        std::uint64_t probeMicrosBefore = session.rekeyProbeLatency.sum();
+        session.lastRekeyThroughputPermille.store(0, std::memory_order_relaxed);
+
+        json run;
+        run["data_mb"] = megabytes;
+        run["throughput"] = runThroughput(environment, options.maxClients, options);
+        std::uint64_t probes = session.rekeyProbeLatency.count() - probesBefore;
+        run["rekeys"] = session.rekeys.value() - rekeysBefore;
+        run["last_throughput_ratio"] = session.lastRekeyThroughputPermille.load() / 1000.0;
+        run["rekey_probes"] = probes;
+        run["rekey_probe_mean_us"] = probes > 0 ? (session.rekeyProbeLatency.sum() - probeMicrosBefore) / probes : 0;
+        environment.tearDown();
+        runs.push_back(run);
+    }
+    return runs;
+}
+
+int runBenchmarks(const BenchOptions& options)
+{
+    if (options.mode == "rekey") {
+        json report;
+        report["libssh_version"] = ssh_version(0);
+        report["mode"] = options.mode;
+        report["tunnel_type"] = tunnelTypeToString(options.tunnelType);
+        report["options"] = {
+            {"clients", options.maxClients},
+            {"bulk_bytes", options.bulkBytes},
+            {"probe_sec", options.probeSeconds > 0 ? options.probeSeconds : 1.0},
+        };
+        report["rekey_sweep"] = runRekeySweep(options);
+        return writeReport(report, options.outputPath);
+    }
+
+    BenchEnvironment environment;
+    environment.setRekeyPolicy(options.rekey);
+    environment.setTunnelType(options.tunnelType);
+    environment.setProbeInterval(options.probeSeconds);
+    std::string error;
+    if (!environment.setUp(error)) {
+        std::cerr << "Benchmark setup failed: " << error << std::endl;
+        return 1;
+    }
+
+    json report;
+    report["libssh_version"] = ssh_version(0);
+    report["mode"] = options.mode;
+    report["tunnel_type"] = tunnelTypeToString(options.tunnelType);
+    if (options.mode == "churn") {
+        report["options"] = {
+            {"clients", options.churn.clients},
+            {"rate_per_sec", options.churn.ratePerSecond},
+            {"soak_sec", options.churn.soakSeconds},
+            {"sample_sec", options.churn.sampleSeconds},
+        };
+        report["churn"] = runChurn(environment, options.churn);
+    } else {
+        report["options"] = {
+            {"max_clients", options.maxClients},
+            {"duration_sec", options.durationSeconds},
+            {"bulk_bytes", options.bulkBytes},
+            {"echo_size", options.echoSize},
+        };
+        runSweep(environment, options, report);
+    }
+
+    // Rekeys seen during the run, to weigh the limits against their cost
+    SessionMetrics& session = MetricsRegistry::instance().session();
+    report["rekey"] = {
+        {"data_bytes", options.rekey.dataBytes},
+        {"time_sec", options.rekey.timeSeconds},
+        {"rekeys", session.rekeys.value()},
+        {"probe_latency", latencySummary(session.rekeyProbeLatency)},
+        {"last_throughput_ratio", session.lastRekeyThroughputPermille.load() / 1000.0},
+    };
+
+    if (options.probeSeconds > 0) {
+        report["probe"] = {
+            {"interval_sec", options.probeSeconds},
+            {"probes", session.probes.value()},
+            {"failures", session.probeFailures.value()},
+            {"latency", latencySummary(session.probeLatency)},
+        };
+    }
+
+    // Setup of the benchmark's session(s) and forwards against the relay
+    json phases = json::object();
+    for (std::size_t i = 0; i < CONNECT_PHASE_COUNT; ++i) {
+        auto phase = static_cast<ConnectPhase>(i);
+        phases[connectPhaseName(phase)] = latencySummary(session.connectPhase(phase));
+    }
+    report["connect_phases"] = phases;
+
+    environment.tearDown();
+    return writeReport(report, options.outputPath);
+}
+
+} // namespace
+
+} // namespace bench
+} // namespace sshconn
+
+int main(int argc, char* argv[])
+{
+    sshconn::bench::BenchOptions options;
+    if (!sshconn::bench::parseOptions(argc, argv, options)) {
+        sshconn::bench::printUsage();
+        return 2;
+    }
+
+    // Keep per-connection logging off the measured path
+    sshconn::Logger::instance().setLevel(sshconn::LogLevel::Warning);
+
+    if (ssh_init() != SSH_OK) {
+        std::cerr << "libssh initialization failed" << std::endl;
+        return 1;
+    }
+
+    int result = sshconn::bench::runBenchmarks(options);
+
+    ssh_finalize();
+    sshconn::Logger::instance().shutdown();
+    return result;
+}
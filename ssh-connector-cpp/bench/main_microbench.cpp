@@ -0,0 +1,442 @@
+#include "BenchSocket.h"
+#include "MicroBench.h"
+#include "MockLibssh.h"
+#include "config/ConfigManager.h"
+#include "config/ConfigPersister.h"
+#include "config/PathResolver.h"
+#include "core/Logger.h"
+#include "core/SSHClient.h"
+#include "core/TunnelHandler.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace sshconn {
+namespace bench {
+
+namespace {
+
+constexpr int FIXTURE_REMOTE_PORT = 22000;
+constexpr int SOCKET_TIMEOUT_MS = 5000;
+constexpr std::size_t BULK_CHUNK = 65536;
+
+// Scratch directory for config and key files, removed on exit
+const fs::path& workDir()
+{
+    static const fs::path dir = [] {
+        auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        fs::path path = fs::temp_directory_path() / ("ssh-connector-microbench-" + std::to_string(stamp));
+        fs::create_directories(path);
+        return path;
+    }();
+    return dir;
+}
+
+// TunnelHandler on a mock session, forwarding to a loopback listener owned by
+// the benchmark. Each connection pairs a mock channel peer with the accepted
+// local socket, so both ends of the forwarding loop are under test control.
+class ForwardingFixture {
+public:
+    ~ForwardingFixture() { tearDown(); }
+
+    bool setUp()
+    {
+        int localPort = 0;
+        m_listener = listenLoopback(0, localPort);
+        if (m_listener < 0) {
+            return false;
+        }
+        setTimeouts(m_listener, SOCKET_TIMEOUT_MS);
+
+        m_session = ssh_new();
+        ssh_connect(m_session);
+        TunnelConfig tunnel;
+        tunnel.localPort = localPort;
+        tunnel.remotePort = FIXTURE_REMOTE_PORT;
+        m_handler = std::make_unique<TunnelHandler>(m_session, tunnel);
+        m_handler->start();
+        return true;
+    }
+
+    // Returns false if the handler never connected to the local listener
+    bool openConnection(int& peer, int& local)
+    {
+        peer = mock::incomingChannel(m_session, FIXTURE_REMOTE_PORT);
+        local = static_cast<int>(accept(m_listener, nullptr, nullptr));
+        if (peer < 0 || local < 0) {
+            return false;
+        }
+        setTimeouts(peer, SOCKET_TIMEOUT_MS);
+        setTimeouts(local, SOCKET_TIMEOUT_MS);
+        setNoDelay(local);
+        return true;
+    }
+
+    void tearDown()
+    {
+        if (m_handler) {
+            m_handler->stop();
+            mock::wakeAcceptors(m_session);
+            m_handler->join();
+            m_handler.reset();
+        }
+        if (m_session) {
+            ssh_free(m_session);
+            m_session = nullptr;
+        }
+        if (m_listener >= 0) {
+            closeSocket(m_listener);
+            m_listener = -1;
+        }
+    }
+
+private:
+    int m_listener = -1;
+    ssh_session m_session = nullptr;
+    std::unique_ptr<TunnelHandler> m_handler;
+};
+
+// Runs `body(state, peer, local)` over one forwarded connection
+template <typename Body>
+void withForwardedConnection(MicroState& state, Body body)
+{
+    ForwardingFixture fixture;
+    int peer = -1;
+    int local = -1;
+    if (!fixture.setUp() || !fixture.openConnection(peer, local)) {
+        state.skip("forwarding fixture setup failed");
+    } else {
+        body(state, peer, local);
+    }
+    if (peer >= 0) {
+        closeSocket(peer);
+    }
+    if (local >= 0) {
+        closeSocket(local);
+    }
+}
+
+void benchChannelToLocal(MicroState& state)
+{
+    withForwardedConnection(state, [](MicroState& s, int peer, int local) {
+        std::vector<char> chunk(BULK_CHUNK, 'r');
+        std::vector<char> sink(BULK_CHUNK);
+        s.setBytesPerIteration(BULK_CHUNK);
+        while (s.next()) {
+            if (!sendAll(peer, chunk.data(), chunk.size()) || !recvAll(local, sink.data(), sink.size())) {
+                s.skip("channel -> local transfer failed");
+            }
+        }
+    });
+}
+
+void benchLocalToChannel(MicroState& state)
+{
+    withForwardedConnection(state, [](MicroState& s, int peer, int local) {
+        std::vector<char> chunk(BULK_CHUNK, 'l');
+        std::vector<char> sink(BULK_CHUNK);
+        s.setBytesPerIteration(BULK_CHUNK);
+        while (s.next()) {
+            if (!sendAll(local, chunk.data(), chunk.size()) || !recvAll(peer, sink.data(), sink.size())) {
+                s.skip("local -> channel transfer failed");
+            }
+        }
+    });
+}
+
+// One byte each way: dominated by how quickly the loop notices new data
+void benchPingPong(MicroState& state)
+{
+    withForwardedConnection(state, [](MicroState& s, int peer, int local) {
+        char byte = 'p';
+        s.setItemsPerIteration(1);
+        while (s.next()) {
+            if (!sendAll(peer, &byte, 1) || !recvAll(local, &byte, 1) ||
+                !sendAll(local, &byte, 1) || !recvAll(peer, &byte, 1)) {
+                s.skip("ping-pong failed");
+            }
+        }
+    });
+}
+
+// Accept, local connect, forward start and teardown after the remote side closes
+void benchConnectionSetupTeardown(MicroState& state)
+{
+    ForwardingFixture fixture;
+    if (!fixture.setUp()) {
+        state.skip("forwarding fixture setup failed");
+        return;
+    }
+    state.setItemsPerIteration(1);
+    while (state.next()) {
+        int peer = -1;
+        int local = -1;
+        if (!fixture.openConnection(peer, local)) {
+            state.skip("connection setup failed");
+        }
+        if (peer >= 0) {
+            closeSocket(peer);
+        }
+        if (local >= 0) {
+            char byte;
+            recv(local, &byte, 1, 0); // Returns 0 once the handler has torn the connection down
+            closeSocket(local);
+        }
+    }
+}
+
+void benchConfigLoad(MicroState& state)
+{
+    fs::path dir = workDir() / "load";
+    {
+        ConfigManager writer(dir.string());
+        writer.config().primaryTunnel().enabled = true;
+        writer.config().metrics.enabled = true;
+        writer.save();
+    }
+    while (state.next()) {
+        ConfigManager manager(dir.string());
+        AppConfig config = manager.load();
+        if (!config.primaryTunnel().enabled) {
+            state.skip("config did not round-trip");
+        }
+    }
+}
+
+void benchConfigSave(MicroState& state)
+{
+    ConfigManager manager((workDir() / "save").string());
+    manager.config().primaryTunnel().enabled = true;
+    while (state.next()) {
+        manager.save();
+    }
+}
+
+// What the UI pays when the config it persists has not changed
+void benchConfigPersistUnchanged(MicroState& state)
+{
+    ConfigManager manager((workDir() / "persist").string());
+    manager.config().primaryTunnel().enabled = true;
+    manager.save();
+
+    ConfigPersister persister(manager);
+    while (state.next()) {
+        persister.schedule(manager.config());
+        if (!persister.flush()) {
+            state.skip("config write failed");
+        }
+    }
+}
+
+void benchFindKeyFileConfigDirHit(MicroState& state)
+{
+    fs::path dir = workDir() / "key-hit";
+    fs::create_directories(dir);
+    std::ofstream(dir / "tunnel_key") << "key";
+    ConfigManager::setExecutableDir((workDir() / "exe").string());
+
+    ConfigManager manager(dir.string());
+    while (state.next()) {
+        if (manager.sshKeyPath().empty()) {
+            state.skip("key lookup failed");
+        }
+    }
+}
+
+// Every probe misses and the lookup falls back to ~/.ssh/tunnel_key
+void benchFindKeyFileMiss(MicroState& state)
+{
+    fs::path dir = workDir() / "key-miss";
+    fs::create_directories(dir);
+    ConfigManager::setExecutableDir((workDir() / "exe").string());
+
+    ConfigManager manager(dir.string());
+    while (state.next()) {
+        if (manager.sshKeyPath().empty()) {
+            state.skip("key lookup failed");
+        }
+    }
+}
+
+// Default config directory: served from the shared PathResolver snapshot
+void benchResolvedKeyPath(MicroState& state)
+{
+    ConfigManager::setExecutableDir((workDir() / "exe").string());
+    PathResolver::instance().refresh();
+
+    ConfigManager manager;
+    while (state.next()) {
+        if (manager.sshKeyPath().empty()) {
+            state.skip("key lookup failed");
+        }
+    }
+}
+
+// connect() + disconnect() against the mock session: three state transitions
+// (Connecting, Connected, Disconnected). Compare with and without a callback
+// to isolate the dispatch cost.
+void runConnectCycle(MicroState& state, bool withCallback)
+{
+    fs::path keyPath = workDir() / "client_key";
+    std::ofstream(keyPath) << "key";
+
+    ServerEndpoint endpoint;
+    endpoint.host = "127.0.0.1";
+    endpoint.keyPath = keyPath.string();
+
+    SSHClient client;
+    client.setEndpoint(endpoint);
+
+    std::uint64_t dispatched = 0;
+    if (withCallback) {
+        client.setStateCallback([&dispatched](ConnectionState, const std::string&) {
+            ++dispatched;
+        });
+    }
+
+    while (state.next()) {
+        client.connect();
+        client.disconnect();
+    }
+    if (withCallback && state.iterations() > 0) {
+        state.setItemsPerIteration(static_cast<double>(dispatched) / static_cast<double>(state.iterations()));
+    }
+}
+
+void benchConnectCycle(MicroState& state)
+{
+    runConnectCycle(state, false);
+}
+
+void benchConnectCycleWithStateCallback(MicroState& state)
+{
+    runConnectCycle(state, true);
+}
+
+SSHCONN_MICROBENCH("Forwarding/ChannelToLocal/64KiB", benchChannelToLocal);
+SSHCONN_MICROBENCH("Forwarding/LocalToChannel/64KiB", benchLocalToChannel);
+SSHCONN_MICROBENCH("Forwarding/PingPong/1B", benchPingPong);
+SSHCONN_MICROBENCH("Forwarding/ConnectionSetupTeardown", benchConnectionSetupTeardown);
+SSHCONN_MICROBENCH("Config/Load", benchConfigLoad);
+SSHCONN_MICROBENCH("Config/Save", benchConfigSave);
+SSHCONN_MICROBENCH("Config/Persist/Unchanged", benchConfigPersistUnchanged);
+SSHCONN_MICROBENCH("Config/FindKeyFile/ConfigDirHit", benchFindKeyFileConfigDirHit);
+SSHCONN_MICROBENCH("Config/FindKeyFile/Miss", benchFindKeyFileMiss);
+SSHCONN_MICROBENCH("Config/FindKeyFile/Resolved", benchResolvedKeyPath);
+SSHCONN_MICROBENCH("SSHClient/ConnectDisconnect", benchConnectCycle);
+SSHCONN_MICROBENCH("SSHClient/ConnectDisconnect/StateCallback", benchConnectCycleWithStateCallback);
+
+struct MicroOptions {
+    MicroRunOptions run;
+    std::string outputPath;
+    std::string baselinePath;
+    double threshold = 0.10;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: ssh-connector-microbench [options]\n"
+              << "  --filter TEXT      only run benchmarks whose name contains TEXT\n"
+              << "  --min-time S       minimum timed seconds per repetition, default 0.5\n"
+              << "  --repetitions N    repetitions per benchmark (median is reported), default 5\n"
+              << "  --output FILE      write JSON results to FILE\n"
+              << "  --baseline FILE    compare against a previous --output file\n"
+              << "  --threshold F      fail when median ns/op grows by more than F, default 0.10\n";
+}
+
+bool parseOptions(int argc, char* argv[], MicroOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            options.run.filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            options.run.minSeconds = std::atof(argv[++i]);
+        } else if (arg == "--repetitions" && hasValue) {
+            options.run.repetitions = std::atoi(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            options.baselinePath = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            options.threshold = std::atof(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return options.run.minSeconds > 0 && options.run.repetitions > 0 && options.threshold >= 0;
+}
+
+int runMicro(const MicroOptions& options)
+{
+    json baseline;
+    if (!options.baselinePath.empty()) {
+        std::ifstream file(options.baselinePath);
+        if (!file.is_open()) {
+            std::cerr << "Failed to read baseline " << options.baselinePath << std::endl;
+            return 2;
+        }
+        try {
+            baseline = json::parse(file)["benchmarks"];
+        } catch (const json::exception& e) {
+            std::cerr << "Invalid baseline " << options.baselinePath << ": " << e.what() << std::endl;
+            return 2;
+        }
+    }
+
+    json report;
+    report["benchmarks"] = runMicroBenchmarks(options.run);
+
+    if (!options.outputPath.empty()) {
+        std::ofstream file(options.outputPath);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write " << options.outputPath << std::endl;
+            return 2;
+        }
+        file << report.dump(2) << "\n";
+    }
+
+    if (!baseline.is_null()) {
+        std::vector<std::string> regressions = compareWithBaseline(report["benchmarks"], baseline, options.threshold);
+        if (!regressions.empty()) {
+            std::cerr << regressions.size() << " benchmark(s) regressed" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+} // namespace bench
+} // namespace sshconn
+
+int main(int argc, char* argv[])
+{
+    sshconn::bench::MicroOptions options;
+    if (!sshconn::bench::parseOptions(argc, argv, options)) {
+        sshconn::bench::printUsage();
+        return 2;
+    }
+
+    sshconn::Logger::instance().setLevel(sshconn::LogLevel::Warning);
+
+    int result = sshconn::bench::runMicro(options);
+
+    std::error_code ec;
+    fs::remove_all(sshconn::bench::workDir(), ec);
+    sshconn::Logger::instance().shutdown();
+    return result;
+}
@@ -1,3 +1,119 @@
 #include "Config.h"
 
-// Config structs are header-only, but we keep this file for potential future extensions
+#include <map>
+
+namespace sshconn {
+
+const char* tunnelTypeToString(TunnelType type)
+{
+    switch (type) {
+        case TunnelType::Remote: return "remote";
+        case TunnelType::Local: return "local";
+        case TunnelType::Dynamic: return "dynamic";
+    }
+    return "remote";
+}
+
+bool tunnelTypeFromString(const std::string& name, TunnelType& type)
+{
+    if (name == "remote") {
+        type = TunnelType::Remote;
+    } else if (name == "local") {
+        type = TunnelType::Local;
+    } else if (name == "dynamic") {
+        type = TunnelType::Dynamic;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string tunnelKeyName(const TunnelKey& key)
+{
+    if (key.type == TunnelType::Remote) {
+        return std::to_string(key.port);
+    }
+    return std::string(tunnelTypeToString(key.type)) + ":" + std::to_string(key.port);
+}
+
+const char* bufferProfileToString(BufferProfile profile)
+{
+    switch (profile) {
+        case BufferProfile::Interactive: return "interactive";
+        case BufferProfile::Default: return "default";
+        case BufferProfile::Bulk: return "bulk";
+    }
+    return "default";
+}
+
+bool bufferProfileFromString(const std::string& name, BufferProfile& profile)
+{
+    if (name == "interactive") {
+        profile = BufferProfile::Interactive;
+    } else if (name == "default") {
+        profile = BufferProfile::Default;
+    } else if (name == "bulk") {
+        profile = BufferProfile::Bulk;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int bufferProfileChunkSize(BufferProfile profile)
+{
+    switch (profile) {
+        case BufferProfile::Interactive: return 8 * 1024;
+        case BufferProfile::Default: return 32 * 1024;
+        case BufferProfile::Bulk: return 128 * 1024;
+    }
+    return 32 * 1024;
+}
+
+std::vector<TunnelConfig> AppConfig::activeTunnels() const
+{
+    std::vector<TunnelConfig> active;
+    for (std::size_t i = 0; i < tunnels.size(); ++i) {
+        if (i == 0 || tunnels[i].enabled) {
+            active.push_back(tunnels[i]);
+        }
+    }
+    return active;
+}
+
+ConfigDelta diffConfig(const AppConfig& current, const AppConfig& updated)
+{
+    ConfigDelta delta;
+
+    std::map<TunnelKey, TunnelConfig> before;
+    for (const TunnelConfig& tunnel : current.activeTunnels()) {
+        before[tunnel.key()] = tunnel;
+    }
+    std::map<TunnelKey, TunnelConfig> after;
+    for (const TunnelConfig& tunnel : updated.activeTunnels()) {
+        after[tunnel.key()] = tunnel;
+    }
+
+    for (const auto& entry : after) {
+        auto it = before.find(entry.first);
+        if (it == before.end() || !(it->second == entry.second)) {
+            delta.tunnelsAdded.push_back(entry.second);
+        }
+    }
+    for (const auto& entry : before) {
+        if (after.find(entry.first) == after.end()) {
+            delta.tunnelsRemoved.push_back(entry.first);
+        }
+    }
+
+    delta.drainTimeoutChanged = current.drainTimeout != updated.drainTimeout;
+    delta.rekeyChanged = !(current.rekey == updated.rekey);
+    delta.rateLimitChanged = !(current.rateLimit == updated.rateLimit);
+    delta.metricsChanged = !(current.metrics == updated.metrics);
+    delta.loggingChanged = !(current.logging == updated.logging);
+    delta.traceChanged = !(current.trace == updated.trace);
+    delta.probeChanged = !(current.probe == updated.probe);
+    return delta;
+}
+
+} // namespace sshconn
@@ -2,6 +2,8 @@
 #define CONFIG_H
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 namespace sshconn {
 
@@ -15,6 +17,14 @@ namespace ServerConfig {
     inline const int KEEPALIVE_COUNT_MAX = 3;
 }
 
+// SSH server endpoint; defaults to the fixed ServerConfig values
+struct ServerEndpoint {
+    std::string host = ServerConfig::SSH_HOST;
+    int port = ServerConfig::SSH_PORT;
+    std::string user = ServerConfig::SSH_USER;
+    std::string keyPath; // empty: discovered by ConfigManager
+};
+
 // Remote port range constraints
 namespace PortRange {
     constexpr int REMOTE_PORT_MIN = 12000;
@@ -23,34 +33,221 @@ namespace PortRange {
     constexpr int LOCAL_PORT_MAX = 65535;
 }
 
+// Per-tunnel socket buffer sizing
+enum class BufferProfile {
+    Interactive, // Small reads, lowest latency for shells and RPC
+    Default,
+    Bulk         // Large reads for file transfer and streaming
+};
+
+const char* bufferProfileToString(BufferProfile profile);
+bool bufferProfileFromString(const std::string& name, BufferProfile& profile);
+int bufferProfileChunkSize(BufferProfile profile);
+
+// Token-bucket limit in bytes per second, applied to each direction
+// separately; 0 = unlimited
+struct RateLimitConfig {
+    std::int64_t bytesPerSecond = 0;
+    std::int64_t burstBytes = 0; // 0: one second's worth
+
+    bool operator==(const RateLimitConfig& other) const {
+        return bytesPerSecond == other.bytesPerSecond &&
+               burstBytes == other.burstBytes;
+    }
+};
+
+// Session key renegotiation limits (RFC 4253 section 9); whichever is reached
+// first starts a rekey. The defaults are the RFC's suggestion of 1 GB or one
+// hour, not values measured for this application.
+struct RekeyConfig {
+    std::int64_t dataBytes = 1024ll * 1024 * 1024; // Per direction; 0 = the cipher's own limit
+    int timeSeconds = 3600;                        // 0 = no time limit
+
+    bool operator==(const RekeyConfig& other) const {
+        return dataBytes == other.dataBytes &&
+               timeSeconds == other.timeSeconds;
+    }
+};
+
+// Direction of a tunnel
+enum class TunnelType {
+    Remote, // Server listens on remote_port, connections go to local_host:local_port (ssh -R)
+    Local,  // We listen on local_port, connections go to remote_host:remote_port (ssh -L)
+    Dynamic // We listen on local_port as a SOCKS5 proxy, connections go where each asks (ssh -D)
+};
+
+const char* tunnelTypeToString(TunnelType type);
+bool tunnelTypeFromString(const std::string& name, TunnelType& type);
+
+// Identifies a tunnel: its type and listen port. Remote tunnels listen on the
+// relay and the others here, so one port number can serve one of each.
+struct TunnelKey {
+    TunnelType type = TunnelType::Remote;
+    int port = 0;
+
+    bool operator==(const TunnelKey& other) const { return type == other.type && port == other.port; }
+    bool operator<(const TunnelKey& other) const {
+        return type != other.type ? type < other.type : port < other.port;
+    }
+};
+
+// Name of a tunnel in logs and metric labels: the bare port for Remote
+// tunnels, "local:<port>" or "dynamic:<port>" for the others
+std::string tunnelKeyName(const TunnelKey& key);
+
 // Tunnel configuration
 struct TunnelConfig {
+    TunnelType type = TunnelType::Remote;
     int localPort = 80;
     int remotePort = 12000;
     bool enabled = false;
+    std::string localHost = "127.0.0.1";          // Remote: target the forwarded connections go to
+    std::string remoteBindAddress = "127.0.0.1";  // Remote: address the server listens on
+    std::string localBindAddress = "127.0.0.1";   // Local, Dynamic: address we listen on
+    std::string remoteHost = "127.0.0.1";         // Local: target, as resolved by the server
+    bool resolveLocally = false;                  // Dynamic: resolve hostnames here, not on the server
+    int maxConnections = 0;                       // Concurrent connections, 0 = unlimited
+    BufferProfile bufferProfile = BufferProfile::Default;
+    RateLimitConfig rateLimit;
+    int priority = 1;                             // Relative share under contention, 1-100
 
     bool operator==(const TunnelConfig& other) const {
-        return localPort == other.localPort &&
+        return type == other.type &&
+               localPort == other.localPort &&
                remotePort == other.remotePort &&
-               enabled == other.enabled;
+               enabled == other.enabled &&
+               localHost == other.localHost &&
+               remoteBindAddress == other.remoteBindAddress &&
+               localBindAddress == other.localBindAddress &&
+               remoteHost == other.remoteHost &&
+               resolveLocally == other.resolveLocally &&
+               maxConnections == other.maxConnections &&
+               bufferProfile == other.bufferProfile &&
+               rateLimit == other.rateLimit &&
+               priority == other.priority;
+    }
+
+    bool listensLocally() const { return type != TunnelType::Remote; }
+
+    // The port the tunnel listens on: remote for Remote, local otherwise
+    int listenPort() const { return listensLocally() ? localPort : remotePort; }
+    // Identifies the tunnel; unique among the configured tunnels
+    TunnelKey key() const { return {type, listenPort()}; }
+};
+
+// Per-tunnel limits
+namespace TunnelLimits {
+    constexpr int PRIORITY_MIN = 1;
+    constexpr int PRIORITY_MAX = 100;
+}
+
+// Metrics exposition endpoint (served on 127.0.0.1 only)
+struct MetricsEndpointConfig {
+    bool enabled = false;
+    int port = 9464;
+
+    bool operator==(const MetricsEndpointConfig& other) const {
+        return enabled == other.enabled &&
+               port == other.port;
+    }
+};
+
+// Logging output
+struct LoggingConfig {
+    std::string level = "info";   // debug, info, warning, error
+    std::string format = "text";  // text or json
+
+    bool operator==(const LoggingConfig& other) const {
+        return level == other.level &&
+               format == other.format;
+    }
+};
+
+// Per-connection lifecycle tracing; the last `capacity` closed connections
+// are kept in memory
+struct TraceConfig {
+    bool enabled = false;
+    int capacity = 4096;
+
+    bool operator==(const TraceConfig& other) const {
+        return enabled == other.enabled &&
+               capacity == other.capacity;
+    }
+};
+
+// Synthetic end-to-end probe: every `interval` seconds a channel is opened
+// through the relay to `remote_port`, which is forwarded back to a built-in
+// echo responder, and a small echo is timed
+struct ProbeConfig {
+    bool enabled = false;
+    int remotePort = 0;
+    double interval = 10.0;
+    double timeout = 5.0; // Seconds before a probe counts as failed
+
+    bool operator==(const ProbeConfig& other) const {
+        return enabled == other.enabled &&
+               remotePort == other.remotePort &&
+               interval == other.interval &&
+               timeout == other.timeout;
     }
 };
 
 // Application configuration
 struct AppConfig {
-    TunnelConfig tunnel;
+    // The first tunnel is the one edited in the main window and is always
+    // started on connect; the others start when enabled
+    std::vector<TunnelConfig> tunnels{TunnelConfig()};
     bool autoReconnect = true;
     double reconnectDelay = 5.0;
     double maxReconnectDelay = 300.0;
+    double drainTimeout = 30.0;   // Seconds open connections get to finish on disconnect
+    RekeyConfig rekey;
+    RateLimitConfig rateLimit;    // All tunnels combined, per direction
+    MetricsEndpointConfig metrics;
+    LoggingConfig logging;
+    TraceConfig trace;
+    ProbeConfig probe;
 
     bool operator==(const AppConfig& other) const {
-        return tunnel == other.tunnel &&
+        return tunnels == other.tunnels &&
                autoReconnect == other.autoReconnect &&
                reconnectDelay == other.reconnectDelay &&
-               maxReconnectDelay == other.maxReconnectDelay;
+               maxReconnectDelay == other.maxReconnectDelay &&
+               drainTimeout == other.drainTimeout &&
+               rekey == other.rekey &&
+               rateLimit == other.rateLimit &&
+               metrics == other.metrics &&
+               logging == other.logging &&
+               trace == other.trace &&
+               probe == other.probe;
     }
+
+    TunnelConfig& primaryTunnel() { return tunnels.front(); }
+    const TunnelConfig& primaryTunnel() const { return tunnels.front(); }
+
+    // Tunnels to run on a connected session
+    std::vector<TunnelConfig> activeTunnels() const;
+};
+
+// What changed between two configurations, in the terms a live session
+// applies it. Tunnels are keyed by type and listen port: one whose key is
+// unchanged but whose target differs is only in tunnelsAdded (retargeted).
+struct ConfigDelta {
+    std::vector<TunnelConfig> tunnelsAdded;
+    std::vector<TunnelKey> tunnelsRemoved;
+    bool drainTimeoutChanged = false;
+    bool rekeyChanged = false;
+    bool rateLimitChanged = false;
+    bool metricsChanged = false;
+    bool loggingChanged = false;
+    bool traceChanged = false;
+    bool probeChanged = false;
+
+    bool tunnelsChanged() const { return !tunnelsAdded.empty() || !tunnelsRemoved.empty(); }
 };
 
+ConfigDelta diffConfig(const AppConfig& current, const AppConfig& updated);
+
 } // namespace sshconn
 
 #endif // CONFIG_H
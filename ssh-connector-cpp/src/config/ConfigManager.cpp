@@ -1,185 +1,533 @@
 #include "ConfigManager.h"
+#include "PathResolver.h"
+#include "../core/Logger.h"
 
 #include <nlohmann/json.hpp>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
-#include <cstdlib>
+#include <set>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
 namespace sshconn {
 
-// Static member initialization
-std::string ConfigManager::s_executableDir;
+namespace {
 
-void ConfigManager::setExecutableDir(const std::string& dir)
+bool validPort(int port)
 {
-    s_executableDir = dir;
+    return port >= 1 && port <= 65535;
 }
 
-std::string ConfigManager::executableDir()
+bool validRateLimit(const RateLimitConfig& limit)
 {
-    return s_executableDir;
+    return limit.bytesPerSecond >= 0 && limit.burstBytes >= 0;
 }
 
-ConfigManager::ConfigManager(const std::string& configDir)
-    : m_configDir(configDir.empty() ? findConfigDir() : configDir)
-    , m_configPath(m_configDir + "/" + CONFIG_FILENAME)
+void parseRateLimit(const json& rateObj, RateLimitConfig& limit)
 {
-}
-
-std::string ConfigManager::findConfigDir() const
-{
-    // 1. Check executable directory first (for portable deployment)
-    if (!s_executableDir.empty()) {
-        fs::path exeConfig = fs::path(s_executableDir) / CONFIG_FILENAME;
-        if (fs::exists(exeConfig)) {
-            std::cout << "Using portable config from executable directory" << std::endl;
-            return s_executableDir;
-        }
+    if (rateObj.contains("bytes_per_sec")) {
+        limit.bytesPerSecond = rateObj["bytes_per_sec"].get<std::int64_t>();
     }
-
-    // 2. Check current working directory
-    fs::path cwdConfig = fs::current_path() / CONFIG_FILENAME;
-    if (fs::exists(cwdConfig)) {
-        std::cout << "Using config from current directory" << std::endl;
-        return fs::current_path().string();
+    if (rateObj.contains("burst_bytes")) {
+        limit.burstBytes = rateObj["burst_bytes"].get<std::int64_t>();
     }
+}
 
-    // 3. Fall back to platform-specific default
-    return getDefaultConfigDir();
+json rateLimitToJson(const RateLimitConfig& limit)
+{
+    json rateObj;
+    rateObj["bytes_per_sec"] = limit.bytesPerSecond;
+    rateObj["burst_bytes"] = limit.burstBytes;
+    return rateObj;
 }
 
-std::string ConfigManager::getDefaultConfigDir() const
+bool parseTunnel(const json& tunnelObj, TunnelConfig& tunnel, std::string& error)
 {
-#ifdef _WIN32
-    const char* appdata = std::getenv("APPDATA");
-    if (appdata) {
-        return std::string(appdata) + "/ssh-connector";
+    if (!tunnelObj.is_object()) {
+        error = "tunnel entry is not an object";
+        return false;
     }
-    return "./ssh-connector";
-#elif defined(__APPLE__)
-    const char* home = std::getenv("HOME");
-    if (home) {
-        return std::string(home) + "/Library/Application Support/ssh-connector";
+    if (tunnelObj.contains("type")) {
+        std::string type = tunnelObj["type"].get<std::string>();
+        if (!tunnelTypeFromString(type, tunnel.type)) {
+            error = "unknown tunnel type \"" + type + "\"";
+            return false;
+        }
     }
-    return "./ssh-connector";
-#else
-    // Linux - use XDG_CONFIG_HOME or fallback to ~/.config
-    const char* xdg = std::getenv("XDG_CONFIG_HOME");
-    if (xdg) {
-        return std::string(xdg) + "/ssh-connector";
+    if (tunnelObj.contains("local_port")) {
+        tunnel.localPort = tunnelObj["local_port"].get<int>();
     }
-    const char* home = std::getenv("HOME");
-    if (home) {
-        return std::string(home) + "/.config/ssh-connector";
+    if (tunnelObj.contains("remote_port")) {
+        tunnel.remotePort = tunnelObj["remote_port"].get<int>();
     }
-    return "./ssh-connector";
-#endif
+    if (tunnelObj.contains("enabled")) {
+        tunnel.enabled = tunnelObj["enabled"].get<bool>();
+    }
+    if (tunnelObj.contains("local_host")) {
+        tunnel.localHost = tunnelObj["local_host"].get<std::string>();
+    }
+    if (tunnelObj.contains("remote_bind_address")) {
+        tunnel.remoteBindAddress = tunnelObj["remote_bind_address"].get<std::string>();
+    }
+    if (tunnelObj.contains("local_bind_address")) {
+        tunnel.localBindAddress = tunnelObj["local_bind_address"].get<std::string>();
+    }
+    if (tunnelObj.contains("remote_host")) {
+        tunnel.remoteHost = tunnelObj["remote_host"].get<std::string>();
+    }
+    if (tunnelObj.contains("resolve_locally")) {
+        tunnel.resolveLocally = tunnelObj["resolve_locally"].get<bool>();
+    }
+    if (tunnelObj.contains("max_connections")) {
+        tunnel.maxConnections = tunnelObj["max_connections"].get<int>();
+    }
+    if (tunnelObj.contains("buffer_profile")) {
+        std::string profile = tunnelObj["buffer_profile"].get<std::string>();
+        if (!bufferProfileFromString(profile, tunnel.bufferProfile)) {
+            error = "unknown buffer_profile \"" + profile + "\"";
+            return false;
+        }
+    }
+    if (tunnelObj.contains("rate_limit")) {
+        parseRateLimit(tunnelObj["rate_limit"], tunnel.rateLimit);
+    }
+    if (tunnelObj.contains("priority")) {
+        tunnel.priority = tunnelObj["priority"].get<int>();
+    }
+    return true;
 }
 
-std::string ConfigManager::expandPath(const std::string& path) const
+json tunnelToJson(const TunnelConfig& tunnel)
 {
-    if (path.empty() || path[0] != '~') {
-        return path;
-    }
-    const char* home = std::getenv("HOME");
-#ifdef _WIN32
-    if (!home) {
-        home = std::getenv("USERPROFILE");
-    }
-#endif
-    if (home) {
-        return std::string(home) + path.substr(1);
+    json tunnelObj;
+    tunnelObj["type"] = tunnelTypeToString(tunnel.type);
+    tunnelObj["local_port"] = tunnel.localPort;
+    tunnelObj["remote_port"] = tunnel.remotePort;
+    tunnelObj["enabled"] = tunnel.enabled;
+    if (tunnel.type == TunnelType::Local) {
+        tunnelObj["local_bind_address"] = tunnel.localBindAddress;
+        tunnelObj["remote_host"] = tunnel.remoteHost;
+    } else if (tunnel.type == TunnelType::Dynamic) {
+        tunnelObj["local_bind_address"] = tunnel.localBindAddress;
+        tunnelObj["resolve_locally"] = tunnel.resolveLocally;
+    } else {
+        tunnelObj["local_host"] = tunnel.localHost;
+        tunnelObj["remote_bind_address"] = tunnel.remoteBindAddress;
     }
-    return path;
+    tunnelObj["max_connections"] = tunnel.maxConnections;
+    tunnelObj["buffer_profile"] = bufferProfileToString(tunnel.bufferProfile);
+    tunnelObj["rate_limit"] = rateLimitToJson(tunnel.rateLimit);
+    tunnelObj["priority"] = tunnel.priority;
+    return tunnelObj;
 }
 
-std::string ConfigManager::findKeyFile() const
+// Write `contents` to a temp file next to `path`, flush it to disk and rename
+// it over `path`, so readers and a power cut see either the old file or the
+// new one, never a truncated mix
+bool replaceFile(const std::string& path, const std::string& contents, std::string& error)
 {
-    const char* keyName = "tunnel_key";
+    std::string tempPath = path + ".tmp";
 
-    // 1. Check executable directory first (for portable deployment)
-    if (!s_executableDir.empty()) {
-        fs::path exeKey = fs::path(s_executableDir) / keyName;
-        if (fs::exists(exeKey)) {
-            std::cout << "Found SSH key in executable directory: " << exeKey.string() << std::endl;
-            return exeKey.string();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "cannot create " + tempPath;
+        return false;
+    }
+    DWORD written = 0;
+    bool ok = WriteFile(file, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+              written == contents.size() && FlushFileBuffers(file);
+    CloseHandle(file);
+    if (!ok || !MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        error = "write failed (error " + std::to_string(GetLastError()) + ")";
+        DeleteFileA(tempPath.c_str());
+        return false;
+    }
+    return true;
+#else
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+
+    const char* data = contents.data();
+    std::size_t remaining = contents.size();
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
         }
+        data += written;
+        remaining -= static_cast<std::size_t>(written);
     }
+    if (remaining > 0 || fsync(fd) != 0) {
+        error = std::strerror(errno);
+        close(fd);
+        unlink(tempPath.c_str());
+        return false;
+    }
+    close(fd);
 
-    // 2. Check current working directory
-    fs::path cwdKey = fs::current_path() / keyName;
-    if (fs::exists(cwdKey)) {
-        std::cout << "Found SSH key in current directory: " << cwdKey.string() << std::endl;
-        return cwdKey.string();
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        error = std::strerror(errno);
+        unlink(tempPath.c_str());
+        return false;
     }
 
-    // 3. Check config directory
-    fs::path configKey = fs::path(m_configDir) / keyName;
-    if (fs::exists(configKey)) {
-        std::cout << "Found SSH key in config directory: " << configKey.string() << std::endl;
-        return configKey.string();
+    // Persist the rename itself
+    std::string directory = fs::path(path).parent_path().string();
+    int dirFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
     }
+    return true;
+#endif
+}
+
+} // namespace
 
-    // 4. Fall back to default path (~/.ssh/tunnel_key)
-    return expandPath(ServerConfig::SSH_KEY_PATH);
+void ConfigManager::setExecutableDir(const std::string& dir)
+{
+    PathResolver::instance().setExecutableDir(dir);
+}
+
+std::string ConfigManager::executableDir()
+{
+    return PathResolver::instance().executableDir();
+}
+
+ConfigManager::ConfigManager(const std::string& configDir)
+    : m_configDir(configDir.empty() ? PathResolver::instance().paths()->configDir : configDir)
+    , m_configPath(m_configDir + "/" + CONFIG_FILENAME)
+{
 }
 
 std::string ConfigManager::sshKeyPath() const
 {
-    return findKeyFile();
+    std::shared_ptr<const ResolvedPaths> paths = PathResolver::instance().paths();
+    if (paths->configDir == m_configDir) {
+        return paths->keyPath;
+    }
+    // A config directory given explicitly is not covered by the shared snapshot
+    return PathResolver::instance().discover(m_configDir).keyPath;
 }
 
 AppConfig ConfigManager::load()
 {
-    if (!fs::exists(m_configPath)) {
-        return m_config;
+    AppConfig parsed = m_config;
+    if (fs::exists(m_configPath) && parseFile(parsed)) {
+        m_config = parsed;
     }
+    return m_config;
+}
+
+bool ConfigManager::readConfig(AppConfig& config) const
+{
+    AppConfig parsed;
+    if (!fs::exists(m_configPath) || !parseFile(parsed)) {
+        return false;
+    }
+    config = parsed;
+    return true;
+}
 
+bool ConfigManager::parseFile(AppConfig& config) const
+{
     std::ifstream file(m_configPath);
     if (!file.is_open()) {
-        std::cerr << "Failed to open config file: " << m_configPath << std::endl;
-        return m_config;
+        logError("config", "Failed to open config file: " + m_configPath);
+        return false;
     }
 
     try {
         json root = json::parse(file);
 
-        // Load tunnel config
-        if (root.contains("tunnel")) {
-            const auto& tunnelObj = root["tunnel"];
-            if (tunnelObj.contains("local_port")) {
-                m_config.tunnel.localPort = tunnelObj["local_port"].get<int>();
-            }
-            if (tunnelObj.contains("remote_port")) {
-                m_config.tunnel.remotePort = tunnelObj["remote_port"].get<int>();
+        // Load tunnels: a "tunnels" array, or the original single "tunnel" object
+        std::string error;
+        if (root.contains("tunnels")) {
+            config.tunnels.clear();
+            for (const auto& tunnelObj : root["tunnels"]) {
+                TunnelConfig tunnel;
+                tunnel.enabled = true; // Listing a tunnel enables it unless it says otherwise
+                if (!parseTunnel(tunnelObj, tunnel, error)) {
+                    logError("config", "Invalid tunnel in " + m_configPath + ": " + error);
+                    return false;
+                }
+                config.tunnels.push_back(tunnel);
             }
-            if (tunnelObj.contains("enabled")) {
-                m_config.tunnel.enabled = tunnelObj["enabled"].get<bool>();
+        } else if (root.contains("tunnel")) {
+            if (!parseTunnel(root["tunnel"], config.primaryTunnel(), error)) {
+                logError("config", "Invalid tunnel in " + m_configPath + ": " + error);
+                return false;
             }
         }
 
         // Load reconnect settings
         if (root.contains("auto_reconnect")) {
-            m_config.autoReconnect = root["auto_reconnect"].get<bool>();
+            config.autoReconnect = root["auto_reconnect"].get<bool>();
         }
         if (root.contains("reconnect_delay")) {
-            m_config.reconnectDelay = root["reconnect_delay"].get<double>();
+            config.reconnectDelay = root["reconnect_delay"].get<double>();
         }
         if (root.contains("max_reconnect_delay")) {
-            m_config.maxReconnectDelay = root["max_reconnect_delay"].get<double>();
+            config.maxReconnectDelay = root["max_reconnect_delay"].get<double>();
+        }
+        if (root.contains("drain_timeout")) {
+            config.drainTimeout = root["drain_timeout"].get<double>();
+        }
+
+        // Load session rekey limits
+        if (root.contains("rekey")) {
+            const auto& rekeyObj = root["rekey"];
+            if (rekeyObj.contains("data_bytes")) {
+                config.rekey.dataBytes = rekeyObj["data_bytes"].get<std::int64_t>();
+            }
+            if (rekeyObj.contains("time_seconds")) {
+                config.rekey.timeSeconds = rekeyObj["time_seconds"].get<int>();
+            }
+        }
+
+        // Load the limit shared by all tunnels
+        if (root.contains("rate_limit")) {
+            parseRateLimit(root["rate_limit"], config.rateLimit);
+        }
+
+        // Load logging settings
+        if (root.contains("logging")) {
+            const auto& loggingObj = root["logging"];
+            if (loggingObj.contains("level")) {
+                config.logging.level = loggingObj["level"].get<std::string>();
+            }
+            if (loggingObj.contains("format")) {
+                config.logging.format = loggingObj["format"].get<std::string>();
+            }
+        }
+
+        // Load metrics endpoint settings
+        if (root.contains("metrics")) {
+            const auto& metricsObj = root["metrics"];
+            if (metricsObj.contains("enabled")) {
+                config.metrics.enabled = metricsObj["enabled"].get<bool>();
+            }
+            if (metricsObj.contains("port")) {
+                config.metrics.port = metricsObj["port"].get<int>();
+            }
+        }
+
+        // Load connection tracing settings
+        if (root.contains("trace")) {
+            const auto& traceObj = root["trace"];
+            if (traceObj.contains("enabled")) {
+                config.trace.enabled = traceObj["enabled"].get<bool>();
+            }
+            if (traceObj.contains("capacity")) {
+                config.trace.capacity = traceObj["capacity"].get<int>();
+            }
+        }
+
+        // Load end-to-end probe settings
+        if (root.contains("probe")) {
+            const auto& probeObj = root["probe"];
+            if (probeObj.contains("enabled")) {
+                config.probe.enabled = probeObj["enabled"].get<bool>();
+            }
+            if (probeObj.contains("remote_port")) {
+                config.probe.remotePort = probeObj["remote_port"].get<int>();
+            }
+            if (probeObj.contains("interval")) {
+                config.probe.interval = probeObj["interval"].get<double>();
+            }
+            if (probeObj.contains("timeout")) {
+                config.probe.timeout = probeObj["timeout"].get<double>();
+            }
         }
     } catch (const json::exception& e) {
-        std::cerr << "JSON parse error: " << e.what() << std::endl;
+        logError("config", std::string("JSON parse error: ") + e.what());
+        return false;
     }
 
-    return m_config;
+    std::string error;
+    if (!validate(config, error)) {
+        logError("config", "Invalid configuration in " + m_configPath + ": " + error);
+        return false;
+    }
+    return true;
+}
+
+bool ConfigManager::validate(const AppConfig& config, std::string& error)
+{
+    if (config.tunnels.empty()) {
+        error = "at least one tunnel is required";
+        return false;
+    }
+
+    // The window edits the first tunnel's remote port
+    if (config.primaryTunnel().type != TunnelType::Remote) {
+        error = "the first tunnel must be of type \"remote\"";
+        return false;
+    }
+
+    // Remote tunnels listen on the relay, the others here: a port number
+    // must be unique on each side, not across both
+    std::set<int> remoteListenPorts;
+    std::set<int> localListenPorts;
+    for (const TunnelConfig& tunnel : config.tunnels) {
+        std::string where = std::string("tunnel ") + tunnelTypeToString(tunnel.type) + ":" +
+                            std::to_string(tunnel.listenPort()) + ": ";
+        if (!validPort(tunnel.localPort) || !validPort(tunnel.remotePort)) {
+            error = where + "ports must be between 1 and 65535";
+            return false;
+        }
+        if (tunnel.type == TunnelType::Remote &&
+            (tunnel.remotePort < PortRange::REMOTE_PORT_MIN || tunnel.remotePort > PortRange::REMOTE_PORT_MAX)) {
+            error = where + "remote_port must be between " + std::to_string(PortRange::REMOTE_PORT_MIN) +
+                    " and " + std::to_string(PortRange::REMOTE_PORT_MAX);
+            return false;
+        }
+        std::set<int>& listenPorts = tunnel.listensLocally() ? localListenPorts : remoteListenPorts;
+        if (!listenPorts.insert(tunnel.listenPort()).second) {
+            error = where + "listen port used by more than one tunnel";
+            return false;
+        }
+        if (tunnel.type == TunnelType::Remote && (tunnel.localHost.empty() || tunnel.remoteBindAddress.empty())) {
+            error = where + "local_host and remote_bind_address must not be empty";
+            return false;
+        }
+        if (tunnel.type == TunnelType::Local && (tunnel.localBindAddress.empty() || tunnel.remoteHost.empty())) {
+            error = where + "local_bind_address and remote_host must not be empty";
+            return false;
+        }
+        if (tunnel.type == TunnelType::Dynamic && tunnel.localBindAddress.empty()) {
+            error = where + "local_bind_address must not be empty";
+            return false;
+        }
+        if (tunnel.maxConnections < 0) {
+            error = where + "max_connections must not be negative";
+            return false;
+        }
+        if (!validRateLimit(tunnel.rateLimit)) {
+            error = where + "rate_limit bytes_per_sec and burst_bytes must not be negative";
+            return false;
+        }
+        if (tunnel.priority < TunnelLimits::PRIORITY_MIN || tunnel.priority > TunnelLimits::PRIORITY_MAX) {
+            error = where + "priority must be between " + std::to_string(TunnelLimits::PRIORITY_MIN) +
+                    " and " + std::to_string(TunnelLimits::PRIORITY_MAX);
+            return false;
+        }
+    }
+
+    if (config.drainTimeout < 0) {
+        error = "drain_timeout must not be negative";
+        return false;
+    }
+    if (!validRateLimit(config.rateLimit)) {
+        error = "rate_limit bytes_per_sec and burst_bytes must not be negative";
+        return false;
+    }
+    if (config.rekey.dataBytes < 0 || config.rekey.timeSeconds < 0) {
+        error = "rekey data_bytes and time_seconds must not be negative";
+        return false;
+    }
+    if (!validPort(config.metrics.port)) {
+        error = "metrics port must be between 1 and 65535";
+        return false;
+    }
+    if (config.trace.capacity <= 0) {
+        error = "trace capacity must be positive";
+        return false;
+    }
+    if (config.probe.enabled) {
+        if (!validPort(config.probe.remotePort)) {
+            error = "probe remote_port must be between 1 and 65535";
+            return false;
+        }
+        for (const TunnelConfig& tunnel : config.tunnels) {
+            if (tunnel.type == TunnelType::Remote && tunnel.remotePort == config.probe.remotePort) {
+                error = "probe remote_port is used by a tunnel";
+                return false;
+            }
+        }
+        if (config.probe.interval <= 0 || config.probe.timeout <= 0) {
+            error = "probe interval and timeout must be positive";
+            return false;
+        }
+    }
+    return true;
 }
 
 void ConfigManager::save()
+{
+    writeConfig(m_config);
+}
+
+std::string ConfigManager::serialize(const AppConfig& config)
+{
+    json tunnelsArray = json::array();
+    for (const TunnelConfig& tunnel : config.tunnels) {
+        tunnelsArray.push_back(tunnelToJson(tunnel));
+    }
+
+    json metricsObj;
+    metricsObj["enabled"] = config.metrics.enabled;
+    metricsObj["port"] = config.metrics.port;
+
+    json rekeyObj;
+    rekeyObj["data_bytes"] = config.rekey.dataBytes;
+    rekeyObj["time_seconds"] = config.rekey.timeSeconds;
+
+    json loggingObj;
+    loggingObj["level"] = config.logging.level;
+    loggingObj["format"] = config.logging.format;
+
+    json traceObj;
+    traceObj["enabled"] = config.trace.enabled;
+    traceObj["capacity"] = config.trace.capacity;
+
+    json probeObj;
+    probeObj["enabled"] = config.probe.enabled;
+    probeObj["remote_port"] = config.probe.remotePort;
+    probeObj["interval"] = config.probe.interval;
+    probeObj["timeout"] = config.probe.timeout;
+
+    json root;
+    root["tunnels"] = tunnelsArray;
+    root["auto_reconnect"] = config.autoReconnect;
+    root["reconnect_delay"] = config.reconnectDelay;
+    root["max_reconnect_delay"] = config.maxReconnectDelay;
+    root["drain_timeout"] = config.drainTimeout;
+    root["rate_limit"] = rateLimitToJson(config.rateLimit);
+    root["rekey"] = rekeyObj;
+    root["metrics"] = metricsObj;
+    root["logging"] = loggingObj;
+    root["trace"] = traceObj;
+    root["probe"] = probeObj;
+
+    return root.dump(4);
+}
+
+bool ConfigManager::writeConfig(const AppConfig& config) const
+{
+    return writeContents(serialize(config));
+}
+
+bool ConfigManager::writeContents(const std::string& contents) const
 {
     // Ensure config directory exists
     fs::path dirPath(m_configDir);
@@ -187,29 +535,28 @@ void ConfigManager::save()
         std::error_code ec;
         fs::create_directories(dirPath, ec);
         if (ec) {
-            std::cerr << "Failed to create config directory: " << m_configDir << std::endl;
-            return;
+            logError("config", "Failed to create config directory: " + m_configDir);
+            return false;
         }
     }
 
-    json tunnelObj;
-    tunnelObj["local_port"] = m_config.tunnel.localPort;
-    tunnelObj["remote_port"] = m_config.tunnel.remotePort;
-    tunnelObj["enabled"] = m_config.tunnel.enabled;
-
-    json root;
-    root["tunnel"] = tunnelObj;
-    root["auto_reconnect"] = m_config.autoReconnect;
-    root["reconnect_delay"] = m_config.reconnectDelay;
-    root["max_reconnect_delay"] = m_config.maxReconnectDelay;
+    std::string error;
+    if (!replaceFile(m_configPath, contents, error)) {
+        logError("config", "Failed to save config file: " + m_configPath + ": " + error);
+        return false;
+    }
+    return true;
+}
 
-    std::ofstream file(m_configPath);
+std::string ConfigManager::readContents() const
+{
+    std::ifstream file(m_configPath, std::ios::binary);
     if (!file.is_open()) {
-        std::cerr << "Failed to save config file: " << m_configPath << std::endl;
-        return;
+        return std::string();
     }
-
-    file << root.dump(4);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
 }
 
 } // namespace sshconn
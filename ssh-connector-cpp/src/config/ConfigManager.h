@@ -14,25 +14,43 @@ public:
     explicit ConfigManager(const std::string& configDir = std::string());
 
     AppConfig load();
+
+    // Write the loaded config synchronously; see ConfigPersister for the
+    // debounced background variant
     void save();
 
+    // Pretty-printed config.json contents for `config`
+    static std::string serialize(const AppConfig& config);
+
+    // Replace config.json atomically (temp file, fsync, rename). Safe to call
+    // from any thread; only the immutable paths are used.
+    bool writeConfig(const AppConfig& config) const;
+    bool writeContents(const std::string& contents) const;
+
+    // Current config.json bytes, empty if it cannot be read
+    std::string readContents() const;
+
+    // Parse config.json into `config` without touching the loaded config.
+    // Returns false if the file is missing or invalid.
+    bool readConfig(AppConfig& config) const;
+
+    // Check ranges and cross-tunnel constraints; `error` says what is wrong
+    static bool validate(const AppConfig& config, std::string& error);
+
     std::string sshKeyPath() const;
     std::string configDir() const { return m_configDir; }
+    std::string configPath() const { return m_configPath; }
     AppConfig& config() { return m_config; }
     const AppConfig& config() const { return m_config; }
 
-    // Set executable directory for portable key search
+    // Set executable directory for portable key search (see PathResolver)
     static void setExecutableDir(const std::string& dir);
     static std::string executableDir();
 
 private:
-    std::string findConfigDir() const;
-    std::string getDefaultConfigDir() const;
-    std::string expandPath(const std::string& path) const;
-    std::string findKeyFile() const;
+    bool parseFile(AppConfig& config) const;
 
     std::string m_configDir;
-    static std::string s_executableDir;
     std::string m_configPath;
     AppConfig m_config;
 };
@@ -0,0 +1,100 @@
+#include "ConfigPersister.h"
+#include "ConfigManager.h"
+#include "../core/Logger.h"
+
+namespace sshconn {
+
+ConfigPersister::ConfigPersister(const ConfigManager& manager, std::chrono::milliseconds debounce)
+    : m_manager(manager)
+    , m_debounce(debounce)
+    , m_lastWritten(manager.readContents())
+{
+}
+
+ConfigPersister::~ConfigPersister()
+{
+    stop();
+}
+
+bool ConfigPersister::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable()) {
+        return true; // Already running
+    }
+    m_stopRequested = false;
+    m_thread = std::thread(&ConfigPersister::run, this);
+    return true;
+}
+
+void ConfigPersister::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+    m_changed.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    flush();
+}
+
+void ConfigPersister::schedule(const AppConfig& config)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = std::make_unique<AppConfig>(config);
+        m_writeAt = std::chrono::steady_clock::now() + m_debounce;
+    }
+    m_changed.notify_all();
+}
+
+bool ConfigPersister::flush()
+{
+    // Taking the config under the write lock keeps writes in schedule() order
+    std::lock_guard<std::mutex> writeLock(m_writeMutex);
+    std::unique_ptr<AppConfig> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+    return !pending || persist(*pending);
+}
+
+void ConfigPersister::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopRequested) {
+        if (!m_pending) {
+            m_changed.wait(lock, [this] { return m_stopRequested || m_pending; });
+            continue;
+        }
+        // Every schedule() moves m_writeAt out, so a burst ends in one write
+        if (m_changed.wait_until(lock, m_writeAt) == std::cv_status::no_timeout ||
+            std::chrono::steady_clock::now() < m_writeAt) {
+            continue;
+        }
+
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+bool ConfigPersister::persist(const AppConfig& config)
+{
+    std::string contents = ConfigManager::serialize(config);
+    if (contents == m_lastWritten) {
+        logDebug("config", "Config unchanged, skipping write");
+        return true;
+    }
+    if (!m_manager.writeContents(contents)) {
+        return false;
+    }
+    m_lastWritten = contents;
+    logDebug("config", "Config written to " + m_manager.configPath());
+    return true;
+}
+
+} // namespace sshconn
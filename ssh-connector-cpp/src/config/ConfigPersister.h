@@ -0,0 +1,68 @@
+#ifndef CONFIG_PERSISTER_H
+#define CONFIG_PERSISTER_H
+
+#include "Config.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sshconn {
+
+class ConfigManager;
+
+// Writes config.json from a background thread so the UI and connect path
+// never wait on the disk.
+//
+// schedule() only records the latest config; it is written once no further
+// schedule() arrives for the debounce interval. Writes go through
+// ConfigManager::writeContents (temp file + fsync + rename) and are skipped
+// when the serialized bytes match what is already on disk.
+class ConfigPersister {
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_DEBOUNCE{300};
+
+    explicit ConfigPersister(const ConfigManager& manager,
+                             std::chrono::milliseconds debounce = DEFAULT_DEBOUNCE);
+    ~ConfigPersister();
+
+    // Prevent copying
+    ConfigPersister(const ConfigPersister&) = delete;
+    ConfigPersister& operator=(const ConfigPersister&) = delete;
+
+    bool start();
+    // Writes anything still pending before returning
+    void stop();
+
+    // Queue `config` for writing, replacing any config not yet written
+    void schedule(const AppConfig& config);
+
+    // Write the pending config now on the calling thread; false if a write failed
+    bool flush();
+
+private:
+    void run();
+    // Caller holds m_writeMutex
+    bool persist(const AppConfig& config);
+
+    const ConfigManager& m_manager;
+    std::chrono::milliseconds m_debounce;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::unique_ptr<AppConfig> m_pending;
+    std::chrono::steady_clock::time_point m_writeAt;
+    bool m_stopRequested = false;
+    std::thread m_thread;
+
+    // Held for the whole of flush(); guards m_lastWritten
+    std::mutex m_writeMutex;
+    std::string m_lastWritten;
+};
+
+} // namespace sshconn
+
+#endif // CONFIG_PERSISTER_H
@@ -0,0 +1,229 @@
+#include "ConfigWatcher.h"
+#include "../core/Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace sshconn {
+
+namespace {
+
+constexpr auto POLL_INTERVAL = std::chrono::milliseconds(500);
+constexpr auto DEBOUNCE = std::chrono::milliseconds(150);
+
+#ifdef __linux__
+// Creation and deletion matter for files whose presence is what counts (keys)
+constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+#endif
+
+struct FileStamp {
+    bool exists = false;
+    fs::file_time_type modified{};
+    std::uintmax_t size = 0;
+
+    bool operator==(const FileStamp& other) const {
+        return exists == other.exists && modified == other.modified && size == other.size;
+    }
+};
+
+FileStamp stampOf(const std::string& path)
+{
+    FileStamp stamp;
+    std::error_code ec;
+    stamp.modified = fs::last_write_time(path, ec);
+    if (ec) {
+        return stamp;
+    }
+    stamp.size = fs::file_size(path, ec);
+    stamp.exists = !ec;
+    return stamp;
+}
+
+} // namespace
+
+ConfigWatcher::ConfigWatcher(const std::string& filePath)
+    : ConfigWatcher(std::vector<std::string>{filePath})
+{
+}
+
+ConfigWatcher::ConfigWatcher(const std::vector<std::string>& filePaths)
+{
+    for (const std::string& filePath : filePaths) {
+        fs::path path(filePath);
+        WatchedFile file;
+        file.path = filePath;
+        file.directory = path.has_parent_path() ? path.parent_path().string() : ".";
+        file.fileName = path.filename().string();
+        m_files.push_back(file);
+    }
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    stop();
+}
+
+bool ConfigWatcher::start()
+{
+    if (m_thread.joinable()) {
+        return true; // Already running
+    }
+
+#ifdef __linux__
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    bool anyWatched = false;
+    for (WatchedFile& file : m_files) {
+        file.watchDescriptor = -1;
+        if (m_inotifyFd < 0) {
+            continue;
+        }
+        // Watches on the same directory share one descriptor
+        file.watchDescriptor = inotify_add_watch(m_inotifyFd, file.directory.c_str(), WATCH_MASK);
+        if (file.watchDescriptor < 0) {
+            logWarning("config", "Cannot watch " + file.directory + ", polling " + file.fileName + " instead");
+        } else {
+            anyWatched = true;
+        }
+    }
+    if (m_inotifyFd >= 0 && !anyWatched) {
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+#endif
+
+    m_stopRequested.store(false);
+    m_thread = std::thread(&ConfigWatcher::run, this);
+    if (m_files.size() == 1) {
+        logInfo("config", "Watching " + m_files.front().path + " for changes");
+    } else {
+        logInfo("config", "Watching " + std::to_string(m_files.size()) + " files for changes");
+    }
+    return true;
+}
+
+void ConfigWatcher::stop()
+{
+    m_stopRequested.store(true);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+#ifdef __linux__
+    if (m_inotifyFd >= 0) {
+        close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+#endif
+}
+
+void ConfigWatcher::run()
+{
+    std::vector<FileStamp> stamps(m_files.size());
+    for (std::size_t i = 0; i < m_files.size(); ++i) {
+        if (m_files[i].watchDescriptor < 0) {
+            stamps[i] = stampOf(m_files[i].path);
+        }
+    }
+
+    bool pending = false;
+    std::string pendingPath;
+    auto fireAt = std::chrono::steady_clock::now();
+    auto nextPoll = fireAt + POLL_INTERVAL;
+
+    while (!m_stopRequested.load()) {
+        auto wakeAt = pending ? std::min(fireAt, nextPoll) : nextPoll;
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            wakeAt - std::chrono::steady_clock::now()).count();
+        int timeoutMs = remaining > 0 ? static_cast<int>(remaining) : 0;
+
+        std::string changedPath;
+        bool changed = false;
+#ifdef __linux__
+        if (m_inotifyFd >= 0) {
+            changed = readEvents(timeoutMs, changedPath);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        }
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+#endif
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextPoll) {
+            nextPoll = now + POLL_INTERVAL;
+            for (std::size_t i = 0; i < m_files.size(); ++i) {
+                if (m_files[i].watchDescriptor >= 0) {
+                    continue;
+                }
+                FileStamp current = stampOf(m_files[i].path);
+                if (!(current == stamps[i])) {
+                    stamps[i] = current;
+                    changed = true;
+                    changedPath = m_files[i].path;
+                }
+            }
+        }
+
+        if (changed) {
+            // Restart the debounce window on every change
+            pending = true;
+            pendingPath = changedPath;
+            fireAt = now + DEBOUNCE;
+        }
+        if (pending && now >= fireAt) {
+            pending = false;
+            notify(pendingPath);
+        }
+    }
+}
+
+#ifdef __linux__
+bool ConfigWatcher::readEvents(int timeoutMs, std::string& changedPath)
+{
+    struct pollfd pfd;
+    pfd.fd = m_inotifyFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) <= 0 || !(pfd.revents & POLLIN)) {
+        return false;
+    }
+
+    alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(m_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + len;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(p);
+            if (event->len > 0) {
+                for (const WatchedFile& file : m_files) {
+                    if (file.watchDescriptor == event->wd && file.fileName == event->name) {
+                        changed = true;
+                        changedPath = file.path;
+                    }
+                }
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+#endif
+
+void ConfigWatcher::notify(const std::string& changedPath)
+{
+    logDebug("config", "Change detected in " + changedPath);
+    if (m_changeCallback) {
+        m_changeCallback();
+    }
+}
+
+} // namespace sshconn
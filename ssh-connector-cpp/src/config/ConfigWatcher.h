@@ -0,0 +1,65 @@
+#ifndef CONFIG_WATCHER_H
+#define CONFIG_WATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sshconn {
+
+// Watches one or more files and reports changes from a background thread.
+//
+// On Linux this is an inotify watch on each file's parent directory, so
+// editors that save by writing a temp file and renaming it over the original
+// are seen too, as are files being created or deleted. Files whose directory
+// cannot be watched (or any file elsewhere) have their modification time and
+// size polled. Bursts of events (truncate + write + close) are debounced into
+// one notification.
+class ConfigWatcher {
+public:
+    using ChangeCallback = std::function<void()>;
+
+    explicit ConfigWatcher(const std::string& filePath);
+    explicit ConfigWatcher(const std::vector<std::string>& filePaths);
+    ~ConfigWatcher();
+
+    // Prevent copying
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    // Called on the watcher thread; marshal to the UI thread as needed
+    void setChangeCallback(ChangeCallback cb) { m_changeCallback = std::move(cb); }
+
+    bool start();
+    void stop();
+    bool isRunning() const { return m_thread.joinable(); }
+
+private:
+    struct WatchedFile {
+        std::string path;
+        std::string directory;
+        std::string fileName;
+        int watchDescriptor = -1; // -1: polled
+    };
+
+    void run();
+#ifdef __linux__
+    bool readEvents(int timeoutMs, std::string& changedPath);
+#endif
+    void notify(const std::string& changedPath);
+
+    std::vector<WatchedFile> m_files;
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_thread;
+#ifdef __linux__
+    int m_inotifyFd = -1;
+#endif
+
+    ChangeCallback m_changeCallback;
+};
+
+} // namespace sshconn
+
+#endif // CONFIG_WATCHER_H
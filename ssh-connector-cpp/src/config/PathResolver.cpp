@@ -0,0 +1,206 @@
+#include "PathResolver.h"
+#include "Config.h"
+#include "ConfigManager.h"
+#include "ConfigWatcher.h"
+#include "../core/Logger.h"
+
+#include <cstdlib>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace sshconn {
+
+namespace {
+
+constexpr const char* KEY_FILENAME = "tunnel_key";
+
+} // namespace
+
+PathResolver& PathResolver::instance()
+{
+    static PathResolver resolver;
+    return resolver;
+}
+
+PathResolver::PathResolver() = default;
+
+PathResolver::~PathResolver()
+{
+    stopWatching();
+}
+
+std::shared_ptr<const ResolvedPaths> PathResolver::paths()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_paths) {
+        // Probing under the lock: concurrent first callers wait for one discovery
+        m_paths = std::make_shared<const ResolvedPaths>(discoverWith(m_executableDir, std::string()));
+    }
+    return m_paths;
+}
+
+std::shared_ptr<const ResolvedPaths> PathResolver::refresh()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paths = std::make_shared<const ResolvedPaths>(discoverWith(m_executableDir, std::string()));
+    return m_paths;
+}
+
+void PathResolver::invalidate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paths.reset();
+}
+
+void PathResolver::setExecutableDir(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_executableDir != dir) {
+        m_executableDir = dir;
+        m_paths.reset();
+    }
+}
+
+std::string PathResolver::executableDir() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_executableDir;
+}
+
+bool PathResolver::startWatching()
+{
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    if (m_watcher) {
+        return true; // Already watching
+    }
+    m_watcher = std::make_unique<ConfigWatcher>(candidateFiles());
+    m_watcher->setChangeCallback([this]() {
+        logInfo("config", "Config or key location changed, rediscovering paths");
+        invalidate();
+    });
+    return m_watcher->start();
+}
+
+void PathResolver::stopWatching()
+{
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    if (m_watcher) {
+        m_watcher->stop();
+        m_watcher.reset();
+    }
+}
+
+ResolvedPaths PathResolver::discover(const std::string& configDir) const
+{
+    return discoverWith(executableDir(), configDir);
+}
+
+ResolvedPaths PathResolver::discoverWith(const std::string& executableDir, const std::string& configDir) const
+{
+    ResolvedPaths paths;
+    fs::path cwd = fs::current_path();
+
+    paths.configDir = configDir;
+    if (paths.configDir.empty()) {
+        // 1. Check executable directory first (for portable deployment)
+        // 2. Check current working directory
+        // 3. Fall back to platform-specific default
+        if (!executableDir.empty() && fs::exists(fs::path(executableDir) / ConfigManager::CONFIG_FILENAME)) {
+            logInfo("config", "Using portable config from executable directory");
+            paths.configDir = executableDir;
+        } else if (fs::exists(cwd / ConfigManager::CONFIG_FILENAME)) {
+            logInfo("config", "Using config from current directory");
+            paths.configDir = cwd.string();
+        } else {
+            paths.configDir = defaultConfigDir();
+        }
+    }
+    paths.configPath = paths.configDir + "/" + ConfigManager::CONFIG_FILENAME;
+
+    // Key search order: executable directory, current directory, config directory
+    std::vector<std::pair<fs::path, const char*>> keyCandidates;
+    if (!executableDir.empty()) {
+        keyCandidates.emplace_back(fs::path(executableDir) / KEY_FILENAME, "executable directory");
+    }
+    keyCandidates.emplace_back(cwd / KEY_FILENAME, "current directory");
+    keyCandidates.emplace_back(fs::path(paths.configDir) / KEY_FILENAME, "config directory");
+
+    for (const auto& candidate : keyCandidates) {
+        if (fs::exists(candidate.first)) {
+            logInfo("config", "Found SSH key in " + std::string(candidate.second) + ": " + candidate.first.string());
+            paths.keyPath = candidate.first.string();
+            paths.keyFound = true;
+            return paths;
+        }
+    }
+
+    // 4. Fall back to default path (~/.ssh/tunnel_key)
+    paths.keyPath = expandPath(ServerConfig::SSH_KEY_PATH);
+    return paths;
+}
+
+std::vector<std::string> PathResolver::candidateFiles() const
+{
+    // Every file whose appearance or removal can change what discover() returns
+    std::string exeDir = executableDir();
+    fs::path cwd = fs::current_path();
+
+    std::vector<std::string> files;
+    if (!exeDir.empty()) {
+        files.push_back((fs::path(exeDir) / ConfigManager::CONFIG_FILENAME).string());
+        files.push_back((fs::path(exeDir) / KEY_FILENAME).string());
+    }
+    files.push_back((cwd / ConfigManager::CONFIG_FILENAME).string());
+    files.push_back((cwd / KEY_FILENAME).string());
+    files.push_back((fs::path(defaultConfigDir()) / KEY_FILENAME).string());
+    files.push_back(expandPath(ServerConfig::SSH_KEY_PATH));
+    return files;
+}
+
+std::string PathResolver::defaultConfigDir()
+{
+#ifdef _WIN32
+    const char* appdata = std::getenv("APPDATA");
+    if (appdata) {
+        return std::string(appdata) + "/ssh-connector";
+    }
+    return "./ssh-connector";
+#elif defined(__APPLE__)
+    const char* home = std::getenv("HOME");
+    if (home) {
+        return std::string(home) + "/Library/Application Support/ssh-connector";
+    }
+    return "./ssh-connector";
+#else
+    // Linux - use XDG_CONFIG_HOME or fallback to ~/.config
+    const char* xdg = std::getenv("XDG_CONFIG_HOME");
+    if (xdg) {
+        return std::string(xdg) + "/ssh-connector";
+    }
+    const char* home = std::getenv("HOME");
+    if (home) {
+        return std::string(home) + "/.config/ssh-connector";
+    }
+    return "./ssh-connector";
+#endif
+}
+
+std::string PathResolver::expandPath(const std::string& path)
+{
+    if (path.empty() || path[0] != '~') {
+        return path;
+    }
+    const char* home = std::getenv("HOME");
+#ifdef _WIN32
+    if (!home) {
+        home = std::getenv("USERPROFILE");
+    }
+#endif
+    if (home) {
+        return std::string(home) + path.substr(1);
+    }
+    return path;
+}
+
+} // namespace sshconn
@@ -0,0 +1,75 @@
+#ifndef PATH_RESOLVER_H
+#define PATH_RESOLVER_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sshconn {
+
+class ConfigWatcher;
+
+// Result of config directory and SSH key discovery. Never modified once
+// published; a refresh publishes a new object instead.
+struct ResolvedPaths {
+    std::string configDir;
+    std::string configPath;
+    std::string keyPath;
+    bool keyFound = false; // false: keyPath is the ~/.ssh fallback, not a file that was seen
+};
+
+// Resolves where config.json and the tunnel key live once, and shares the
+// result between the UI (ConfigManager) and core (SSHClient::connect).
+//
+// Discovery probes up to four locations, which is slow on eMMC or network
+// home directories, so it only runs again after invalidate()/refresh() or
+// when the watch started by startWatching() sees a candidate file appear,
+// disappear or be replaced. Callers that hold an older snapshot keep a
+// consistent view of it.
+class PathResolver {
+public:
+    static PathResolver& instance();
+
+    // Current snapshot, running discovery first if there is none
+    std::shared_ptr<const ResolvedPaths> paths();
+
+    // Run discovery now and publish the result
+    std::shared_ptr<const ResolvedPaths> refresh();
+
+    // Drop the snapshot; the next paths() runs discovery again
+    void invalidate();
+
+    // Executable directory, searched first for portable deployments
+    void setExecutableDir(const std::string& dir);
+    std::string executableDir() const;
+
+    // Invalidate automatically when a candidate location changes
+    bool startWatching();
+    void stopWatching();
+
+    // Probe the filesystem without touching the snapshot. A non-empty
+    // `configDir` is used as-is instead of being discovered.
+    ResolvedPaths discover(const std::string& configDir = std::string()) const;
+
+    static std::string defaultConfigDir();
+    static std::string expandPath(const std::string& path);
+
+private:
+    PathResolver();
+    ~PathResolver();
+
+    ResolvedPaths discoverWith(const std::string& executableDir, const std::string& configDir) const;
+    std::vector<std::string> candidateFiles() const;
+
+    mutable std::mutex m_mutex;
+    std::string m_executableDir;
+    std::shared_ptr<const ResolvedPaths> m_paths;
+
+    std::mutex m_watchMutex;
+    std::unique_ptr<ConfigWatcher> m_watcher;
+};
+
+} // namespace sshconn
+
+#endif // PATH_RESOLVER_H
@@ -0,0 +1,92 @@
+#include "CommandExecutor.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace sshconn {
+
+CommandExecutor::~CommandExecutor()
+{
+    stop();
+}
+
+bool CommandExecutor::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_thread.joinable()) {
+        return true; // Already running
+    }
+    m_stopRequested = false;
+    m_thread = std::thread(&CommandExecutor::run, this);
+    return true;
+}
+
+void CommandExecutor::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+    m_changed.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void CommandExecutor::submit(const std::string& key, Command command)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!key.empty()) {
+            // Debounce: the newer request of this kind supersedes the queued one
+            m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                                         [&key](const Entry& entry) { return entry.key == key; }),
+                          m_queue.end());
+        }
+        m_queue.push_back({key, std::move(command)});
+    }
+    m_changed.notify_all();
+}
+
+std::size_t CommandExecutor::cancelPending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::size_t dropped = m_queue.size();
+    m_queue.clear();
+    return dropped;
+}
+
+bool CommandExecutor::busy() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_executing || !m_queue.empty();
+}
+
+void CommandExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_changed.wait(lock, [this] { return m_stopRequested || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            break; // Stop requested and nothing left to run
+        }
+
+        Entry entry = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_executing = true;
+        lock.unlock();
+
+        try {
+            entry.command();
+        } catch (const std::exception& e) {
+            logError("executor", "Command " + (entry.key.empty() ? std::string("(unnamed)") : entry.key) +
+                     " failed: " + e.what());
+        }
+
+        lock.lock();
+        m_executing = false;
+    }
+}
+
+} // namespace sshconn
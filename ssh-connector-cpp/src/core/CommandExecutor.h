@@ -0,0 +1,66 @@
+#ifndef COMMAND_EXECUTOR_H
+#define COMMAND_EXECUTOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sshconn {
+
+// Runs blocking client operations (connect, disconnect, tunnel changes) on
+// one long-lived worker thread, in the order they were submitted, so the UI
+// neither blocks nor starts a thread per click and no two operations race.
+//
+// A command submitted under a key replaces any command still queued under
+// the same key, so a burst of clicks leaves only the last request of each
+// kind. Queued commands can be cancelled; one already running always
+// finishes.
+class CommandExecutor {
+public:
+    using Command = std::function<void()>;
+
+    CommandExecutor() = default;
+    ~CommandExecutor();
+
+    // Prevent copying
+    CommandExecutor(const CommandExecutor&) = delete;
+    CommandExecutor& operator=(const CommandExecutor&) = delete;
+
+    bool start();
+    // Runs what is still queued, then stops the worker
+    void stop();
+
+    // Queue `command` behind those already queued; an empty key never
+    // replaces anything
+    void submit(const std::string& key, Command command);
+    void submit(Command command) { submit(std::string(), std::move(command)); }
+
+    // Drop every queued command; returns how many were dropped
+    std::size_t cancelPending();
+
+    // True while a command runs or waits to
+    bool busy() const;
+
+private:
+    struct Entry {
+        std::string key;
+        Command command;
+    };
+
+    void run();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Entry> m_queue;
+    bool m_executing = false;
+    bool m_stopRequested = false;
+    std::thread m_thread;
+};
+
+} // namespace sshconn
+
+#endif // COMMAND_EXECUTOR_H
@@ -0,0 +1,95 @@
+#include "DnsCache.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+
+namespace sshconn {
+
+DnsCache::DnsCache(std::size_t capacity, Clock::duration ttl)
+    : m_capacity(capacity)
+    , m_ttl(ttl)
+{
+}
+
+DnsCache::Status DnsCache::lookup(const std::string& host, std::string& address, Clock::time_point now)
+{
+    auto it = m_entries.find(host);
+    if (it != m_entries.end() && !it->second.pending.valid() && now >= it->second.expiresAt) {
+        m_entries.erase(it);
+        it = m_entries.end();
+    }
+
+    if (it == m_entries.end()) {
+        evict();
+        Entry entry;
+        entry.pending = std::async(std::launch::async, &DnsCache::resolve, host).share();
+        entry.lastUsed = now;
+        m_entries.emplace(host, std::move(entry));
+        return Status::Started;
+    }
+
+    Entry& entry = it->second;
+    entry.lastUsed = now;
+    if (entry.pending.valid()) {
+        if (entry.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return Status::Pending;
+        }
+        entry.address = entry.pending.get();
+        entry.pending = std::shared_future<std::string>();
+        entry.expiresAt = now + (entry.address.empty() ? Clock::duration(NEGATIVE_TTL) : m_ttl);
+    }
+    if (entry.address.empty()) {
+        return Status::Failed;
+    }
+    address = entry.address;
+    return Status::Resolved;
+}
+
+void DnsCache::evict()
+{
+    while (m_entries.size() >= m_capacity) {
+        auto oldest = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->second.pending.valid()) {
+                continue; // Still wanted by whoever started it
+            }
+            if (oldest == m_entries.end() || it->second.lastUsed < oldest->second.lastUsed) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_entries.end()) {
+            return; // All resolving; allow a temporary overshoot
+        }
+        m_entries.erase(oldest);
+    }
+}
+
+std::string DnsCache::resolve(const std::string& host)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) {
+        return std::string();
+    }
+
+    char numeric[NI_MAXHOST] = "";
+    if (result != nullptr) {
+        getnameinfo(result->ai_addr, static_cast<socklen_t>(result->ai_addrlen), numeric, sizeof(numeric),
+                    nullptr, 0, NI_NUMERICHOST);
+    }
+    freeaddrinfo(result);
+    return numeric;
+}
+
+} // namespace sshconn
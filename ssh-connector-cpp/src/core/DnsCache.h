@@ -0,0 +1,57 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <map>
+#include <string>
+
+namespace sshconn {
+
+// Hostname -> numeric address cache for reverse forwards' local targets and
+// SOCKS targets resolved on this side.
+// Lookups run on a helper thread so the caller can poll instead of blocking;
+// answers are kept for a TTL (failures for a shorter one) and the least
+// recently used entry is dropped when full. Destruction waits for lookups
+// still running.
+// Not thread-safe: owned by one TunnelHandler thread.
+class DnsCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Status {
+        Started,  // Not cached: a lookup was started
+        Pending,  // A lookup is still running
+        Resolved, // `address` holds the answer
+        Failed    // The name did not resolve
+    };
+
+    static constexpr std::size_t DEFAULT_CAPACITY = 256;
+    static constexpr std::chrono::seconds DEFAULT_TTL{60};
+    static constexpr std::chrono::seconds NEGATIVE_TTL{10};
+
+    explicit DnsCache(std::size_t capacity = DEFAULT_CAPACITY, Clock::duration ttl = DEFAULT_TTL);
+
+    Status lookup(const std::string& host, std::string& address, Clock::time_point now);
+    std::size_t size() const { return m_entries.size(); }
+
+private:
+    struct Entry {
+        std::shared_future<std::string> pending; // Valid while resolving
+        std::string address;                     // Empty: did not resolve
+        Clock::time_point expiresAt;
+        Clock::time_point lastUsed;
+    };
+
+    static std::string resolve(const std::string& host);
+    void evict();
+
+    std::size_t m_capacity;
+    Clock::duration m_ttl;
+    std::map<std::string, Entry> m_entries;
+};
+
+} // namespace sshconn
+
+#endif // DNS_CACHE_H
@@ -0,0 +1,142 @@
+#include "EchoResponder.h"
+#include "Logger.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+namespace sshconn {
+
+namespace {
+
+// A probe's echo is a few bytes; a connection quiet for this long is dropped
+// so a probe the client gave up on does not hold up the next one
+constexpr int CLIENT_IDLE_MS = 2000;
+constexpr int STOP_POLL_MS = 200;
+
+void closeSocket(int sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+// Wait until the socket is readable; returns false on timeout or error
+bool waitReadable(int sock, int timeoutMs)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(sock + 1, &readSet, nullptr, nullptr, &tv) > 0;
+}
+
+} // namespace
+
+EchoResponder::~EchoResponder()
+{
+    stop();
+}
+
+bool EchoResponder::start()
+{
+    if (m_thread.joinable()) {
+        return true; // Already running
+    }
+
+    int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (sock < 0) {
+        logError("probe", "Failed to create echo responder socket");
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0; // Ephemeral
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    socklen_t length = sizeof(addr);
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(sock, 4) < 0 ||
+        getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &length) < 0) {
+        logError("probe", "Failed to start echo responder on 127.0.0.1");
+        closeSocket(sock);
+        return false;
+    }
+
+    m_port = ntohs(addr.sin_port);
+    m_listenSocket = sock;
+    m_stopRequested.store(false);
+    m_thread = std::thread(&EchoResponder::run, this);
+    logDebug("probe", "Echo responder listening on 127.0.0.1:" + std::to_string(m_port));
+    return true;
+}
+
+void EchoResponder::stop()
+{
+    m_stopRequested.store(true);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_listenSocket >= 0) {
+        closeSocket(m_listenSocket);
+        m_listenSocket = -1;
+    }
+}
+
+void EchoResponder::run()
+{
+    while (!m_stopRequested.load()) {
+        // Poll with a timeout so stop() is noticed promptly
+        if (!waitReadable(m_listenSocket, STOP_POLL_MS)) {
+            continue;
+        }
+
+        int client = static_cast<int>(accept(m_listenSocket, nullptr, nullptr));
+        if (client < 0) {
+            continue;
+        }
+        serveClient(client);
+        closeSocket(client);
+    }
+}
+
+void EchoResponder::serveClient(int clientSocket)
+{
+    char buffer[1024];
+    int idleMs = 0;
+    while (!m_stopRequested.load() && idleMs < CLIENT_IDLE_MS) {
+        if (!waitReadable(clientSocket, STOP_POLL_MS)) {
+            idleMs += STOP_POLL_MS;
+            continue;
+        }
+        idleMs = 0;
+        int received = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+        int sent = 0;
+        while (sent < received) {
+            int n = send(clientSocket, buffer + sent, received - sent, 0);
+            if (n <= 0) {
+                return;
+            }
+            sent += n;
+        }
+    }
+}
+
+} // namespace sshconn
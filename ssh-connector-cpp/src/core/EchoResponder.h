@@ -0,0 +1,38 @@
+#ifndef ECHO_RESPONDER_H
+#define ECHO_RESPONDER_H
+
+#include <atomic>
+#include <thread>
+
+namespace sshconn {
+
+// Loopback TCP echo service, the local end of the end-to-end probe. Listens on
+// an ephemeral port of 127.0.0.1 and echoes each connection back until the
+// peer closes or goes idle; connections are served one at a time.
+class EchoResponder {
+public:
+    EchoResponder() = default;
+    ~EchoResponder();
+
+    // Prevent copying
+    EchoResponder(const EchoResponder&) = delete;
+    EchoResponder& operator=(const EchoResponder&) = delete;
+
+    bool start();
+    void stop();
+    // The bound port, once started
+    int port() const { return m_port; }
+
+private:
+    void run();
+    void serveClient(int clientSocket);
+
+    int m_port = 0;
+    int m_listenSocket = -1;
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_thread;
+};
+
+} // namespace sshconn
+
+#endif // ECHO_RESPONDER_H
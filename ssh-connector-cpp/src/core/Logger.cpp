@@ -0,0 +1,289 @@
+#include "Logger.h"
+
+#include <nlohmann/json.hpp>
+#include <cstdio>
+#include <ctime>
+
+namespace sshconn {
+
+namespace {
+
+constexpr auto WRITER_POLL_INTERVAL = std::chrono::milliseconds(20);
+
+std::string formatTimestamp(std::chrono::system_clock::time_point time)
+{
+    auto sinceEpoch = time.time_since_epoch();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch);
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch - seconds).count();
+    std::time_t tt = static_cast<std::time_t>(seconds.count());
+
+    std::tm tm{};
+#ifdef _WIN32
+    gmtime_s(&tm, &tt);
+#else
+    gmtime_r(&tt, &tm);
+#endif
+
+    // Sized for any int in every field, not just the ones gmtime returns
+    char buffer[96];
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                  tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(millis));
+    return buffer;
+}
+
+} // namespace
+
+std::string logLevelToString(LogLevel level)
+{
+    switch (level) {
+        case LogLevel::Debug: return "debug";
+        case LogLevel::Info: return "info";
+        case LogLevel::Warning: return "warning";
+        case LogLevel::Error: return "error";
+        default: return "unknown";
+    }
+}
+
+bool logLevelFromString(const std::string& name, LogLevel& level)
+{
+    for (LogLevel candidate : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error}) {
+        if (name == logLevelToString(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+LogRateLimiter::LogRateLimiter(int burst, std::chrono::steady_clock::duration interval)
+    : m_burst(burst)
+    , m_intervalTicks(interval.count())
+{
+}
+
+bool LogRateLimiter::allow(std::uint64_t& suppressed)
+{
+    std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::int64_t windowStart = m_windowStart.load(std::memory_order_relaxed);
+    if (now - windowStart >= m_intervalTicks &&
+        m_windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed)) {
+        m_countInWindow.store(0, std::memory_order_relaxed);
+    }
+
+    if (m_countInWindow.fetch_add(1, std::memory_order_relaxed) < m_burst) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : m_slots(new Slot[QUEUE_CAPACITY])
+{
+    static_assert((QUEUE_CAPACITY & (QUEUE_CAPACITY - 1)) == 0, "QUEUE_CAPACITY must be a power of two");
+    for (std::size_t i = 0; i < QUEUE_CAPACITY; ++i) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+    shutdown();
+}
+
+void Logger::configure(const LoggingConfig& config)
+{
+    LogLevel level = LogLevel::Info;
+    if (logLevelFromString(config.level, level)) {
+        setLevel(level);
+    } else {
+        log(LogLevel::Warning, "log", "Unknown log level '" + config.level + "', keeping " + logLevelToString(this->level()));
+    }
+    setFormat(config.format == "json" ? LogFormat::Json : LogFormat::Text);
+}
+
+void Logger::log(LogLevel level, const char* component, std::string message)
+{
+    if (!isEnabled(level)) {
+        return;
+    }
+
+    Record record;
+    record.level = level;
+    record.time = std::chrono::system_clock::now();
+    record.component = component;
+    record.message = std::move(message);
+
+    if (m_stopRequested.load(std::memory_order_relaxed)) {
+        // Writer is gone (process shutdown): write synchronously
+        std::string line;
+        format(record, line);
+        std::fwrite(line.data(), 1, line.size(), stderr);
+        return;
+    }
+
+    if (!enqueue(std::move(record))) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Wake the writer early when a burst fills half the ring
+    std::size_t backlog = m_enqueuePos.load(std::memory_order_relaxed) - m_written.load(std::memory_order_relaxed);
+    if (backlog >= QUEUE_CAPACITY / 2) {
+        m_wake.notify_one();
+    }
+}
+
+void Logger::log(LogRateLimiter& limiter, LogLevel level, const char* component, std::string message)
+{
+    if (!isEnabled(level)) {
+        return;
+    }
+
+    std::uint64_t suppressed = 0;
+    if (!limiter.allow(suppressed)) {
+        return;
+    }
+    if (suppressed > 0) {
+        message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+    }
+    log(level, component, std::move(message));
+}
+
+bool Logger::enqueue(Record&& record)
+{
+    // Bounded MPMC ring (Vyukov): a slot is free for position `pos` once its
+    // sequence equals `pos`, and ready for the reader once it equals `pos + 1`.
+    std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &m_slots[pos & (QUEUE_CAPACITY - 1)];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // Full
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->record = std::move(record);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool Logger::dequeue(Record& record)
+{
+    Slot& slot = m_slots[m_dequeuePos & (QUEUE_CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+        return false;
+    }
+
+    record = std::move(slot.record);
+    slot.sequence.store(m_dequeuePos + QUEUE_CAPACITY, std::memory_order_release);
+    ++m_dequeuePos;
+    return true;
+}
+
+void Logger::format(const Record& record, std::string& out) const
+{
+    if (m_format.load(std::memory_order_relaxed) == LogFormat::Json) {
+        nlohmann::json line;
+        line["ts"] = formatTimestamp(record.time);
+        line["level"] = logLevelToString(record.level);
+        line["component"] = record.component;
+        line["msg"] = record.message;
+        out += line.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    } else {
+        out += formatTimestamp(record.time);
+        out += ' ';
+        std::string level = logLevelToString(record.level);
+        for (char& c : level) {
+            c = static_cast<char>(c - 'a' + 'A');
+        }
+        out += level;
+        out += " [";
+        out += record.component;
+        out += "] ";
+        out += record.message;
+    }
+    out += '\n';
+}
+
+void Logger::run()
+{
+    Record record;
+    std::string batch;
+    std::uint64_t reportedDrops = 0;
+
+    for (;;) {
+        bool stopping = m_stopRequested.load();
+
+        batch.clear();
+        std::size_t count = 0;
+        while (dequeue(record)) {
+            format(record, batch);
+            ++count;
+        }
+
+        std::uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != reportedDrops) {
+            Record notice;
+            notice.level = LogLevel::Warning;
+            notice.time = std::chrono::system_clock::now();
+            notice.component = "log";
+            notice.message = "Log queue full, dropped " + std::to_string(dropped - reportedDrops) + " records";
+            format(notice, batch);
+            reportedDrops = dropped;
+        }
+
+        if (!batch.empty()) {
+            std::fwrite(batch.data(), 1, batch.size(), stderr);
+            std::fflush(stderr);
+        }
+        if (count > 0) {
+            m_written.fetch_add(count, std::memory_order_release);
+            continue;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wake.wait_for(lock, WRITER_POLL_INTERVAL);
+    }
+}
+
+void Logger::flush()
+{
+    std::size_t target = m_enqueuePos.load(std::memory_order_acquire);
+    while (m_thread.joinable() && m_written.load(std::memory_order_acquire) < target) {
+        m_wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Logger::shutdown()
+{
+    m_stopRequested.store(true);
+    m_wake.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+} // namespace sshconn
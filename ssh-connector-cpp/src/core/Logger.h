@@ -0,0 +1,140 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "../config/Config.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace sshconn {
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+enum class LogFormat {
+    Text,
+    Json
+};
+
+std::string logLevelToString(LogLevel level);
+bool logLevelFromString(const std::string& name, LogLevel& level);
+
+// Allows up to `burst` messages per interval and counts the rest, so a
+// repeating error (e.g. a dead local service) cannot flood the log.
+class LogRateLimiter {
+public:
+    LogRateLimiter(int burst, std::chrono::steady_clock::duration interval);
+
+    // Returns true if the caller should log; `suppressed` receives the number
+    // of messages dropped since the last one that was let through.
+    bool allow(std::uint64_t& suppressed);
+
+private:
+    const int m_burst;
+    const std::int64_t m_intervalTicks;
+    std::atomic<std::int64_t> m_windowStart{0};
+    std::atomic<int> m_countInWindow{0};
+    std::atomic<std::uint64_t> m_suppressed{0};
+};
+
+// Asynchronous logger. Producers format their message and push it into a
+// bounded lock-free ring; a background thread formats and writes batches to
+// stderr. When the ring is full, records are dropped and counted.
+class Logger {
+public:
+    static constexpr std::size_t QUEUE_CAPACITY = 4096; // must be a power of two
+
+    static Logger& instance();
+
+    // Prevent copying
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void setLevel(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+    LogLevel level() const { return m_level.load(std::memory_order_relaxed); }
+    void setFormat(LogFormat format) { m_format.store(format, std::memory_order_relaxed); }
+    bool isEnabled(LogLevel level) const { return level >= this->level(); }
+
+    // Apply level/format from the loaded configuration
+    void configure(const LoggingConfig& config);
+
+    void log(LogLevel level, const char* component, std::string message);
+    void log(LogRateLimiter& limiter, LogLevel level, const char* component, std::string message);
+
+    // Block until everything enqueued so far has been written
+    void flush();
+    // Drain the queue and stop the writer thread
+    void shutdown();
+
+    std::uint64_t droppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Record {
+        LogLevel level = LogLevel::Info;
+        std::chrono::system_clock::time_point time;
+        const char* component = "";
+        std::string message;
+    };
+
+    struct Slot {
+        std::atomic<std::size_t> sequence{0};
+        Record record;
+    };
+
+    Logger();
+    ~Logger();
+
+    bool enqueue(Record&& record);
+    bool dequeue(Record& record);
+    void run();
+    void format(const Record& record, std::string& out) const;
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos{0};
+    alignas(64) std::size_t m_dequeuePos = 0;
+    std::atomic<std::size_t> m_written{0};
+
+    std::atomic<LogLevel> m_level{LogLevel::Info};
+    std::atomic<LogFormat> m_format{LogFormat::Text};
+    std::atomic<std::uint64_t> m_dropped{0};
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_thread;
+};
+
+inline void logDebug(const char* component, std::string message)
+{
+    Logger::instance().log(LogLevel::Debug, component, std::move(message));
+}
+
+inline void logInfo(const char* component, std::string message)
+{
+    Logger::instance().log(LogLevel::Info, component, std::move(message));
+}
+
+inline void logWarning(const char* component, std::string message)
+{
+    Logger::instance().log(LogLevel::Warning, component, std::move(message));
+}
+
+inline void logError(const char* component, std::string message)
+{
+    Logger::instance().log(LogLevel::Error, component, std::move(message));
+}
+
+} // namespace sshconn
+
+#endif // LOGGER_H
@@ -0,0 +1,127 @@
+#include "Metrics.h"
+
+#include <cmath>
+
+namespace sshconn {
+
+std::uint64_t ShardedCounter::value() const
+{
+    std::uint64_t total = 0;
+    for (const auto& shard : m_shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+std::int64_t ShardedGauge::value() const
+{
+    std::int64_t total = 0;
+    for (const auto& shard : m_shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+int Histogram::bucketIndex(std::uint64_t micros)
+{
+    constexpr std::uint64_t linearLimit = SUB_BUCKETS * 2;
+    if (micros < linearLimit) {
+        return static_cast<int>(micros);
+    }
+
+    int exponent = 63;
+    while ((micros >> exponent) == 0) {
+        --exponent;
+    }
+    if (exponent >= MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+
+    int sub = static_cast<int>((micros >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return static_cast<int>(linearLimit) + (exponent - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + sub;
+}
+
+std::uint64_t Histogram::bucketUpperBound(int index)
+{
+    constexpr int linearLimit = SUB_BUCKETS * 2;
+    if (index < linearLimit) {
+        return static_cast<std::uint64_t>(index);
+    }
+
+    int exponent = (index - linearLimit) / SUB_BUCKETS + SUB_BUCKET_BITS + 1;
+    int sub = (index - linearLimit) % SUB_BUCKETS;
+    std::uint64_t width = std::uint64_t(1) << (exponent - SUB_BUCKET_BITS);
+    std::uint64_t lower = (std::uint64_t(1) << exponent) + static_cast<std::uint64_t>(sub) * width;
+    return lower + width - 1;
+}
+
+void Histogram::record(std::uint64_t micros)
+{
+    m_buckets[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(micros, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::record(std::chrono::steady_clock::duration elapsed)
+{
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    record(micros > 0 ? static_cast<std::uint64_t>(micros) : 0);
+}
+
+std::uint64_t Histogram::percentile(double quantile) const
+{
+    std::uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    auto target = static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(total)));
+    if (target == 0) {
+        target = 1;
+    }
+
+    std::uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += bucketCount(i);
+        if (seen >= target) {
+            return bucketUpperBound(i);
+        }
+    }
+    return bucketUpperBound(BUCKET_COUNT - 1);
+}
+
+const char* connectPhaseName(ConnectPhase phase)
+{
+    switch (phase) {
+        case ConnectPhase::KeyLoad: return "key_load";
+        case ConnectPhase::SessionCreate: return "session_create";
+        case ConnectPhase::Handshake: return "handshake";
+        case ConnectPhase::Auth: return "auth";
+        case ConnectPhase::ForwardSetup: return "forward_setup";
+    }
+    return "unknown";
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<TunnelMetrics> MetricsRegistry::tunnel(const std::string& name)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    auto& metrics = m_tunnels[name];
+    if (!metrics) {
+        metrics = std::make_shared<TunnelMetrics>();
+    }
+    return metrics;
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<TunnelMetrics>>> MetricsRegistry::tunnels() const
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return {m_tunnels.begin(), m_tunnels.end()};
+}
+
+} // namespace sshconn
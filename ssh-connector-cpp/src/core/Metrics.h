@@ -0,0 +1,173 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sshconn {
+
+namespace MetricsLayout {
+    constexpr std::size_t SHARD_COUNT = 16;
+    constexpr std::size_t CACHE_LINE_SIZE = 64;
+}
+
+// Index of the calling thread's shard; assigned round-robin on first use
+inline std::size_t metricsShardIndex()
+{
+    static std::atomic<std::size_t> nextIndex{0};
+    thread_local const std::size_t index =
+        nextIndex.fetch_add(1, std::memory_order_relaxed) % MetricsLayout::SHARD_COUNT;
+    return index;
+}
+
+// Monotonic counter split across cache-line aligned shards. Writers only touch
+// their own shard (one relaxed add), readers sum all shards.
+class ShardedCounter {
+public:
+    void add(std::uint64_t n = 1)
+    {
+        m_shards[metricsShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const;
+
+private:
+    struct alignas(MetricsLayout::CACHE_LINE_SIZE) Shard {
+        std::atomic<std::uint64_t> value{0};
+    };
+    std::array<Shard, MetricsLayout::SHARD_COUNT> m_shards;
+};
+
+// Up/down gauge with the same sharding as ShardedCounter. Individual shards may
+// go negative (inc and dec on different threads); only the sum is meaningful.
+class ShardedGauge {
+public:
+    void add(std::int64_t n)
+    {
+        m_shards[metricsShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    void increment() { add(1); }
+    void decrement() { add(-1); }
+
+    std::int64_t value() const;
+
+private:
+    struct alignas(MetricsLayout::CACHE_LINE_SIZE) Shard {
+        std::atomic<std::int64_t> value{0};
+    };
+    std::array<Shard, MetricsLayout::SHARD_COUNT> m_shards;
+};
+
+// Log-linear latency histogram in microseconds (HDR-style: every power of two
+// is split into SUB_BUCKETS linear buckets, ~12% relative precision).
+class Histogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 40; // ~12.7 days in microseconds
+    static constexpr int BUCKET_COUNT = SUB_BUCKETS * 2 + (MAX_EXPONENT - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+    void record(std::uint64_t micros);
+    void record(std::chrono::steady_clock::duration elapsed);
+
+    std::uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    std::uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    std::uint64_t bucketCount(int index) const { return m_buckets[index].load(std::memory_order_relaxed); }
+
+    // Value (upper bucket bound) at the given quantile in [0, 1]
+    std::uint64_t percentile(double quantile) const;
+
+    static int bucketIndex(std::uint64_t micros);
+    static std::uint64_t bucketUpperBound(int index);
+
+private:
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> m_buckets{};
+    std::atomic<std::uint64_t> m_count{0};
+    std::atomic<std::uint64_t> m_sum{0};
+};
+
+// Series recorded for a single reverse tunnel
+struct TunnelMetrics {
+    ShardedCounter bytesToLocal;      // channel -> local socket
+    ShardedCounter bytesToRemote;     // local socket -> channel
+    ShardedCounter connectionsTotal;
+    ShardedGauge activeConnections;
+    ShardedGauge interactiveConnections; // open connections currently classed as interactive
+    ShardedCounter localConnectFailures;
+    ShardedCounter channelOpenFailures;  // direct-tcpip opens refused or failed (local, dynamic)
+    ShardedCounter dnsLookups;           // hostnames sent to the resolver (local targets, resolve_locally)
+    ShardedCounter dnsCacheHits;         // hostnames answered from the DNS cache
+    ShardedGauge queuedConnections;      // channels waiting for a max_connections slot
+    ShardedCounter rejectedConnections;  // channels closed unserved by admission control
+    ShardedCounter drainedConnections;   // connections that finished while the handler drained
+    ShardedCounter abortedConnections;   // connections cut off by a stop or an expired drain
+    ShardedCounter channelWriteStalls; // local data held back by an exhausted remote window
+    ShardedCounter throttledWaits;     // transfers held back by a rate limit
+
+    Histogram firstByteLatency;   // connection accepted -> first byte from its target
+    Histogram connectionDuration; // connection accepted -> closed
+    Histogram admissionWait;      // connection accepted -> admitted from the queue
+};
+
+// Steps of establishing a session and its forwards, timed separately
+enum class ConnectPhase {
+    KeyLoad,       // key file lookup and parse
+    SessionCreate, // ssh_new and options
+    Handshake,     // ssh_connect: TCP connect and key exchange
+    Auth,          // public key authentication
+    ForwardSetup   // ssh_channel_listen_forward round trip, per reverse tunnel
+};
+
+constexpr std::size_t CONNECT_PHASE_COUNT = static_cast<std::size_t>(ConnectPhase::ForwardSetup) + 1;
+
+const char* connectPhaseName(ConnectPhase phase);
+
+// Series recorded for the SSH session itself
+struct SessionMetrics {
+    std::atomic<int> state{0};         // ConnectionState value
+    ShardedCounter connectAttempts;
+    ShardedCounter reconnects;         // connect attempts after a session was previously established
+    std::array<Histogram, CONNECT_PHASE_COUNT> connectPhases; // successful steps only, across reconnects
+    ShardedCounter rekeys;             // rekeys expected from the configured limits
+    Histogram rekeyProbeLatency;       // probes started as a rekey starts
+    std::atomic<std::uint64_t> lastRekeyThroughputPermille{0}; // payload rate after / before the last busy rekey
+    ShardedCounter probes;             // end-to-end probes started
+    ShardedCounter probeFailures;      // probes refused, cut off, answered wrongly or timed out
+    std::atomic<std::uint64_t> lastProbeLatencyMicros{0};
+    Histogram probeLatency;            // channel open through the relay and back, plus the echo
+
+    Histogram& connectPhase(ConnectPhase phase) { return connectPhases[static_cast<std::size_t>(phase)]; }
+};
+
+// Process-wide registry of session and per-tunnel series
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance();
+
+    SessionMetrics& session() { return m_session; }
+
+    // Returns the series for a tunnel, creating them on first use. Series
+    // outlive tunnel restarts so totals keep accumulating.
+    std::shared_ptr<TunnelMetrics> tunnel(const std::string& name);
+
+    std::vector<std::pair<std::string, std::shared_ptr<TunnelMetrics>>> tunnels() const;
+
+private:
+    MetricsRegistry() = default;
+
+    SessionMetrics m_session;
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<TunnelMetrics>> m_tunnels;
+};
+
+} // namespace sshconn
+
+#endif // METRICS_H
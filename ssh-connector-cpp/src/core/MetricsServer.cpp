@@ -0,0 +1,375 @@
+#include "MetricsServer.h"
+#include "ConnectionState.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "TraceLog.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+namespace sshconn {
+
+namespace {
+
+constexpr int MAX_REQUEST_SIZE = 4096;
+constexpr int CLIENT_TIMEOUT_MS = 2000;
+
+void closeSocket(int sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+// Wait until the socket is readable; returns false on timeout or error
+bool waitReadable(int sock, int timeoutMs)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(sock + 1, &readSet, nullptr, nullptr, &tv) > 0;
+}
+
+std::string formatSeconds(std::uint64_t micros)
+{
+    std::ostringstream out;
+    out << std::setprecision(12) << static_cast<double>(micros) / 1e6;
+    return out.str();
+}
+
+// Histograms are exported with one bucket per power of two; the finer
+// sub-buckets are folded into the octave that contains them.
+void writeHistogram(std::ostringstream& out, const std::string& name,
+                    const std::string& labels, const Histogram& histogram)
+{
+    std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+    std::uint64_t cumulative = 0;
+    for (int i = 0; i < Histogram::BUCKET_COUNT; ++i) {
+        cumulative += histogram.bucketCount(i);
+        std::uint64_t upper = Histogram::bucketUpperBound(i);
+        bool octaveEnd = (upper & (upper + 1)) == 0; // 2^n - 1
+        if (octaveEnd && upper >= Histogram::SUB_BUCKETS * 2 - 1) {
+            out << name << "_bucket" << prefix << "le=\"" << formatSeconds(upper) << "\"} " << cumulative << "\n";
+        }
+    }
+    out << name << "_bucket" << prefix << "le=\"+Inf\"} " << histogram.count() << "\n";
+    out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << " " << histogram.count() << "\n";
+    out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << " " << formatSeconds(histogram.sum()) << "\n";
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(int port)
+    : m_port(port)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start()
+{
+    if (m_thread.joinable()) {
+        return true; // Already running
+    }
+
+    int sock = static_cast<int>(socket(AF_INET, SOCK_STREAM, 0));
+    if (sock < 0) {
+        logError("metrics", "Failed to create metrics endpoint socket");
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<unsigned short>(m_port));
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 || listen(sock, 8) < 0) {
+        logError("metrics", "Failed to listen on 127.0.0.1:" + std::to_string(m_port));
+        closeSocket(sock);
+        return false;
+    }
+
+    m_listenSocket = sock;
+    m_stopRequested.store(false);
+    m_thread = std::thread(&MetricsServer::run, this);
+    logInfo("metrics", "Metrics endpoint listening on http://127.0.0.1:" + std::to_string(m_port) + "/metrics");
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    m_stopRequested.store(true);
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_listenSocket >= 0) {
+        closeSocket(m_listenSocket);
+        m_listenSocket = -1;
+    }
+}
+
+void MetricsServer::run()
+{
+    m_running.store(true);
+
+    while (!m_stopRequested.load()) {
+        // Poll with a timeout so stop() is noticed promptly
+        if (!waitReadable(m_listenSocket, 500)) {
+            continue;
+        }
+
+        int client = static_cast<int>(accept(m_listenSocket, nullptr, nullptr));
+        if (client < 0) {
+            continue;
+        }
+        handleClient(client);
+        closeSocket(client);
+    }
+
+    m_running.store(false);
+}
+
+void MetricsServer::handleClient(int clientSocket)
+{
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+        if (!waitReadable(clientSocket, CLIENT_TIMEOUT_MS)) {
+            return;
+        }
+        int received = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<std::size_t>(received));
+    }
+
+    std::string status = "200 OK";
+    std::string contentType = CONTENT_TYPE;
+    std::string body;
+
+    if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET /metrics?", 0) == 0) {
+        body = render();
+    } else if (request.rfind("GET /trace ", 0) == 0 || request.rfind("GET /trace?", 0) == 0) {
+        // Connection lifecycles as Chrome trace-event JSON
+        contentType = "application/json";
+        body = TraceLog::instance().chromeTraceJson();
+    } else if (request.rfind("GET ", 0) == 0) {
+        status = "404 Not Found";
+        contentType = "text/plain; charset=utf-8";
+        body = "Not Found\n";
+    } else {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain; charset=utf-8";
+        body = "Method Not Allowed\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: " << contentType << "\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+
+    std::string data = response.str();
+    std::size_t totalSent = 0;
+    while (totalSent < data.size()) {
+        int sent = send(clientSocket, data.data() + totalSent, static_cast<int>(data.size() - totalSent), 0);
+        if (sent <= 0) break;
+        totalSent += static_cast<std::size_t>(sent);
+    }
+}
+
+std::string MetricsServer::render()
+{
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    SessionMetrics& session = registry.session();
+    std::ostringstream out;
+
+    // Session
+    out << "# TYPE sshconn_session_state stateset\n"
+        << "# HELP sshconn_session_state Current SSH session state.\n";
+    int current = session.state.load();
+    for (ConnectionState state : {ConnectionState::Disconnected, ConnectionState::Connecting,
+                                  ConnectionState::Connected, ConnectionState::Error}) {
+        out << "sshconn_session_state{sshconn_session_state=\"" << connectionStateToString(state) << "\"} "
+            << (static_cast<int>(state) == current ? 1 : 0) << "\n";
+    }
+
+    out << "# TYPE sshconn_session_connect_attempts counter\n"
+        << "# HELP sshconn_session_connect_attempts Connection attempts.\n"
+        << "sshconn_session_connect_attempts_total " << session.connectAttempts.value() << "\n";
+    out << "# TYPE sshconn_session_reconnects counter\n"
+        << "# HELP sshconn_session_reconnects Connection attempts after a session was established.\n"
+        << "sshconn_session_reconnects_total " << session.reconnects.value() << "\n";
+    out << "# TYPE sshconn_session_connect_phase_seconds histogram\n"
+        << "# HELP sshconn_session_connect_phase_seconds Time spent in each step of establishing the session and its forwards.\n"
+        << "# UNIT sshconn_session_connect_phase_seconds seconds\n";
+    for (std::size_t i = 0; i < CONNECT_PHASE_COUNT; ++i) {
+        auto phase = static_cast<ConnectPhase>(i);
+        writeHistogram(out, "sshconn_session_connect_phase_seconds",
+                       std::string("phase=\"") + connectPhaseName(phase) + "\"", session.connectPhase(phase));
+    }
+    out << "# TYPE sshconn_session_rekeys counter\n"
+        << "# HELP sshconn_session_rekeys Rekeys expected from the configured data and time limits.\n"
+        << "sshconn_session_rekeys_total " << session.rekeys.value() << "\n";
+    out << "# TYPE sshconn_session_rekey_probe_latency_seconds histogram\n"
+        << "# HELP sshconn_session_rekey_probe_latency_seconds End-to-end probes started as a rekey starts.\n"
+        << "# UNIT sshconn_session_rekey_probe_latency_seconds seconds\n";
+    writeHistogram(out, "sshconn_session_rekey_probe_latency_seconds", "", session.rekeyProbeLatency);
+    out << "# TYPE sshconn_session_rekey_throughput_ratio gauge\n"
+        << "# HELP sshconn_session_rekey_throughput_ratio Forwarded bytes in the second after the last busy rekey over the second before.\n"
+        << "sshconn_session_rekey_throughput_ratio " << session.lastRekeyThroughputPermille.load() / 1000.0 << "\n";
+    out << "# TYPE sshconn_probes counter\n"
+        << "# HELP sshconn_probes End-to-end probes started through the relay.\n"
+        << "sshconn_probes_total " << session.probes.value() << "\n";
+    out << "# TYPE sshconn_probe_failures counter\n"
+        << "# HELP sshconn_probe_failures End-to-end probes that failed or timed out.\n"
+        << "sshconn_probe_failures_total " << session.probeFailures.value() << "\n";
+    out << "# TYPE sshconn_probe_last_latency_seconds gauge\n"
+        << "# HELP sshconn_probe_last_latency_seconds Most recent successful end-to-end probe.\n"
+        << "# UNIT sshconn_probe_last_latency_seconds seconds\n"
+        << "sshconn_probe_last_latency_seconds " << formatSeconds(session.lastProbeLatencyMicros.load()) << "\n";
+    out << "# TYPE sshconn_probe_latency_seconds histogram\n"
+        << "# HELP sshconn_probe_latency_seconds End-to-end probes: channel open through the relay back to the echo responder, plus the echo.\n"
+        << "# UNIT sshconn_probe_latency_seconds seconds\n";
+    writeHistogram(out, "sshconn_probe_latency_seconds", "", session.probeLatency);
+
+    // Tunnels
+    auto tunnels = registry.tunnels();
+
+    out << "# TYPE sshconn_tunnel_bytes counter\n"
+        << "# HELP sshconn_tunnel_bytes Bytes forwarded through the tunnel.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_bytes_total{tunnel=\"" << name << "\",direction=\"to_local\"} " << metrics->bytesToLocal.value() << "\n"
+            << "sshconn_tunnel_bytes_total{tunnel=\"" << name << "\",direction=\"to_remote\"} " << metrics->bytesToRemote.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_connections counter\n"
+        << "# HELP sshconn_tunnel_connections Forwarded connections accepted.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_connections_total{tunnel=\"" << name << "\"} " << metrics->connectionsTotal.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_active_connections gauge\n"
+        << "# HELP sshconn_tunnel_active_connections Forwarded connections currently open.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_active_connections{tunnel=\"" << name << "\"} " << metrics->activeConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_interactive_connections gauge\n"
+        << "# HELP sshconn_tunnel_interactive_connections Open connections scheduled as interactive.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_interactive_connections{tunnel=\"" << name << "\"} " << metrics->interactiveConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_queued_connections gauge\n"
+        << "# HELP sshconn_tunnel_queued_connections Channels waiting for a max_connections slot.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_queued_connections{tunnel=\"" << name << "\"} " << metrics->queuedConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_rejected_connections counter\n"
+        << "# HELP sshconn_tunnel_rejected_connections Channels closed because the tunnel was at max_connections.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_rejected_connections_total{tunnel=\"" << name << "\"} " << metrics->rejectedConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_drained_connections counter\n"
+        << "# HELP sshconn_tunnel_drained_connections Connections that finished on their own during a drain.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_drained_connections_total{tunnel=\"" << name << "\"} " << metrics->drainedConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_aborted_connections counter\n"
+        << "# HELP sshconn_tunnel_aborted_connections Connections closed mid-transfer by a stop or an expired drain.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_aborted_connections_total{tunnel=\"" << name << "\"} " << metrics->abortedConnections.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_local_connect_failures counter\n"
+        << "# HELP sshconn_tunnel_local_connect_failures Failed connects to the local service.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_local_connect_failures_total{tunnel=\"" << name << "\"} " << metrics->localConnectFailures.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_channel_open_failures counter\n"
+        << "# HELP sshconn_tunnel_channel_open_failures Channels to the remote target that could not be opened.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_channel_open_failures_total{tunnel=\"" << name << "\"} " << metrics->channelOpenFailures.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_dns_lookups counter\n"
+        << "# HELP sshconn_tunnel_dns_lookups Hostnames resolved locally that missed the DNS cache.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_dns_lookups_total{tunnel=\"" << name << "\"} " << metrics->dnsLookups.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_dns_cache_hits counter\n"
+        << "# HELP sshconn_tunnel_dns_cache_hits Hostnames answered from the DNS cache.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_dns_cache_hits_total{tunnel=\"" << name << "\"} " << metrics->dnsCacheHits.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_channel_write_stalls counter\n"
+        << "# HELP sshconn_tunnel_channel_write_stalls Times local data waited for the remote window to open.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_channel_write_stalls_total{tunnel=\"" << name << "\"} " << metrics->channelWriteStalls.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_throttled counter\n"
+        << "# HELP sshconn_tunnel_throttled Times a connection was held back by a rate limit.\n";
+    for (const auto& [name, metrics] : tunnels) {
+        out << "sshconn_tunnel_throttled_total{tunnel=\"" << name << "\"} " << metrics->throttledWaits.value() << "\n";
+    }
+
+    out << "# TYPE sshconn_tunnel_first_byte_latency_seconds histogram\n"
+        << "# HELP sshconn_tunnel_first_byte_latency_seconds Connection accept to first byte from the forwarding target.\n"
+        << "# UNIT sshconn_tunnel_first_byte_latency_seconds seconds\n";
+    for (const auto& [name, metrics] : tunnels) {
+        writeHistogram(out, "sshconn_tunnel_first_byte_latency_seconds", "tunnel=\"" + name + "\"", metrics->firstByteLatency);
+    }
+
+    out << "# TYPE sshconn_tunnel_connection_duration_seconds histogram\n"
+        << "# HELP sshconn_tunnel_connection_duration_seconds Lifetime of forwarded connections.\n"
+        << "# UNIT sshconn_tunnel_connection_duration_seconds seconds\n";
+    for (const auto& [name, metrics] : tunnels) {
+        writeHistogram(out, "sshconn_tunnel_connection_duration_seconds", "tunnel=\"" + name + "\"", metrics->connectionDuration);
+    }
+
+    out << "# TYPE sshconn_tunnel_admission_wait_seconds histogram\n"
+        << "# HELP sshconn_tunnel_admission_wait_seconds Time queued channels waited for a max_connections slot.\n"
+        << "# UNIT sshconn_tunnel_admission_wait_seconds seconds\n";
+    for (const auto& [name, metrics] : tunnels) {
+        writeHistogram(out, "sshconn_tunnel_admission_wait_seconds", "tunnel=\"" + name + "\"", metrics->admissionWait);
+    }
+
+    out << "# EOF\n";
+    return out.str();
+}
+
+} // namespace sshconn
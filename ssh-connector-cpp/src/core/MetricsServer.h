@@ -0,0 +1,44 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace sshconn {
+
+// Minimal HTTP listener serving GET /metrics in OpenMetrics text format.
+// Binds to 127.0.0.1 only; requests are handled sequentially on one thread.
+class MetricsServer {
+public:
+    static constexpr const char* CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+    explicit MetricsServer(int port);
+    ~MetricsServer();
+
+    // Prevent copying
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    bool start();
+    void stop();
+    bool isRunning() const { return m_running.load(); }
+    int port() const { return m_port; }
+
+    // Render the current registry contents
+    static std::string render();
+
+private:
+    void run();
+    void handleClient(int clientSocket);
+
+    int m_port;
+    int m_listenSocket = -1;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_stopRequested{false};
+    std::thread m_thread;
+};
+
+} // namespace sshconn
+
+#endif // METRICS_SERVER_H
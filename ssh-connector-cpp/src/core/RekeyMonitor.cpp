@@ -0,0 +1,131 @@
+#include "RekeyMonitor.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <string>
+
+namespace sshconn {
+
+namespace {
+
+// Less payload than this in the second before a rekey is too little traffic
+// for the throughput comparison to mean anything
+constexpr std::uint64_t MIN_BUSY_BYTES = 64 * 1024;
+
+} // namespace
+
+void RekeyMonitor::configure(const RekeyConfig& policy, Clock::time_point keyedAt)
+{
+    m_policy = policy;
+    m_epochStart = keyedAt;
+    m_inbound = 0;
+    m_outbound = 0;
+    m_slots.fill(0);
+    m_slotIndex = 0;
+    m_slotOrigin = keyedAt;
+    m_measuring = false;
+}
+
+void RekeyMonitor::recordInbound(std::size_t bytes, Clock::time_point now)
+{
+    m_inbound += bytes;
+    record(bytes, now);
+}
+
+void RekeyMonitor::recordOutbound(std::size_t bytes, Clock::time_point now)
+{
+    m_outbound += bytes;
+    record(bytes, now);
+}
+
+void RekeyMonitor::record(std::size_t bytes, Clock::time_point now)
+{
+    rotate(now);
+    m_slots[static_cast<std::size_t>(m_slotIndex) % SLOT_COUNT] += bytes;
+    if (m_measuring && now - m_rekeyAt < SLOT_LENGTH * SLOT_COUNT) {
+        m_bytesAfter += bytes;
+    }
+}
+
+void RekeyMonitor::rotate(Clock::time_point now)
+{
+    std::int64_t index = (now - m_slotOrigin) / SLOT_LENGTH;
+    if (index <= m_slotIndex) {
+        return;
+    }
+    // Slots skipped while nothing moved are empty
+    std::int64_t first = std::max(m_slotIndex + 1, index - static_cast<std::int64_t>(SLOT_COUNT) + 1);
+    for (std::int64_t i = first; i <= index; ++i) {
+        m_slots[static_cast<std::size_t>(i) % SLOT_COUNT] = 0;
+    }
+    m_slotIndex = index;
+}
+
+bool RekeyMonitor::poll(Clock::time_point now)
+{
+    rotate(now);
+    if (m_measuring && now - m_rekeyAt >= SLOT_LENGTH * SLOT_COUNT) {
+        report(now);
+    }
+
+    bool dataDue = m_policy.dataBytes > 0 &&
+                   std::max(m_inbound, m_outbound) >= static_cast<std::uint64_t>(m_policy.dataBytes);
+    bool timeDue = m_policy.timeSeconds > 0 && now - m_epochStart >= std::chrono::seconds(m_policy.timeSeconds);
+    if (!dataDue && !timeDue) {
+        return false;
+    }
+    if (m_measuring) {
+        report(now); // Another rekey inside the window
+    }
+
+    m_measuring = true;
+    m_dataTriggered = dataDue;
+    m_rekeyAt = now;
+    m_bytesBefore = 0;
+    for (std::uint64_t bytes : m_slots) {
+        m_bytesBefore += bytes;
+    }
+    m_bytesAfter = 0;
+    m_probeMicros = -1;
+
+    // Both directions start over with the new keys
+    m_inbound = 0;
+    m_outbound = 0;
+    m_epochStart = now;
+    MetricsRegistry::instance().session().rekeys.add();
+    return true;
+}
+
+void RekeyMonitor::recordProbe(Clock::duration roundTrip)
+{
+    m_probeMicros = std::chrono::duration_cast<std::chrono::microseconds>(roundTrip).count();
+    MetricsRegistry::instance().session().rekeyProbeLatency.record(roundTrip);
+}
+
+void RekeyMonitor::report(Clock::time_point now)
+{
+    m_measuring = false;
+
+    // The window before is one second, so its byte count is also a rate; the
+    // one after is cut short by a rekey that follows within the second
+    const auto window = std::chrono::duration_cast<Clock::duration>(SLOT_LENGTH * SLOT_COUNT);
+    auto measured = std::max(std::min(now - m_rekeyAt, window), Clock::duration(1));
+    std::uint64_t rateAfter = static_cast<std::uint64_t>(static_cast<double>(m_bytesAfter) * window.count() / measured.count());
+
+    std::string message = std::string("Rekey (") + (m_dataTriggered ? "data" : "time") + " limit): ";
+    if (m_bytesBefore >= MIN_BUSY_BYTES) {
+        std::uint64_t permille = rateAfter * 1000 / m_bytesBefore;
+        MetricsRegistry::instance().session().lastRekeyThroughputPermille.store(permille, std::memory_order_relaxed);
+        message += "throughput " + std::to_string(m_bytesBefore) + " -> " + std::to_string(rateAfter) +
+                   " bytes/s (" + std::to_string(permille / 10) + "%)";
+    } else {
+        message += "tunnels idle";
+    }
+    if (m_probeMicros >= 0) {
+        message += ", probe " + std::to_string(m_probeMicros / 1000) + " ms";
+    }
+    logInfo("ssh", message);
+}
+
+} // namespace sshconn
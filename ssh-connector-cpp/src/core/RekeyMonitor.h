@@ -0,0 +1,66 @@
+#ifndef REKEY_MONITOR_H
+#define REKEY_MONITOR_H
+
+#include "../config/Config.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace sshconn {
+
+// Follows a session towards its rekey limits using the channel payload a
+// TunnelHandler moves, and measures forwarding around each expected rekey:
+// payload throughput in the second before against the second after, and the
+// latency of an end-to-end probe started as the rekey starts. libssh counts
+// packet overhead too, so a data-limit rekey is noticed slightly after it
+// begins.
+// Not thread-safe: owned by one TunnelHandler thread.
+class RekeyMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Apply the limits the session was opened with; counting starts over
+    // from keyedAt, when the session's keys were exchanged
+    void configure(const RekeyConfig& policy, Clock::time_point keyedAt);
+
+    // Channel payload read (inbound) and written (outbound)
+    void recordInbound(std::size_t bytes, Clock::time_point now);
+    void recordOutbound(std::size_t bytes, Clock::time_point now);
+
+    // True when a rekey is expected to have just started; the caller then
+    // times a probe and passes the result to recordProbe
+    bool poll(Clock::time_point now);
+    void recordProbe(Clock::duration roundTrip);
+
+private:
+    static constexpr std::size_t SLOT_COUNT = 10;
+    static constexpr std::chrono::milliseconds SLOT_LENGTH{100}; // SLOT_COUNT slots make the window
+
+    void record(std::size_t bytes, Clock::time_point now);
+    void rotate(Clock::time_point now);
+    void report(Clock::time_point now);
+
+    RekeyConfig m_policy;
+    Clock::time_point m_epochStart{};
+    std::uint64_t m_inbound = 0;  // Since the last rekey
+    std::uint64_t m_outbound = 0;
+
+    // Payload moved per slot over the last window, oldest first from m_slotIndex
+    std::array<std::uint64_t, SLOT_COUNT> m_slots{};
+    std::int64_t m_slotIndex = 0; // Slots since m_slotOrigin
+    Clock::time_point m_slotOrigin{};
+
+    // The rekey being measured
+    bool m_measuring = false;
+    bool m_dataTriggered = false;
+    Clock::time_point m_rekeyAt{};
+    std::uint64_t m_bytesBefore = 0;
+    std::uint64_t m_bytesAfter = 0;
+    std::int64_t m_probeMicros = -1;
+};
+
+} // namespace sshconn
+
+#endif // REKEY_MONITOR_H
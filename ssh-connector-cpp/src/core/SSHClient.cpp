@@ -1,13 +1,27 @@
 #include "SSHClient.h"
-#include "../config/ConfigManager.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "../config/PathResolver.h"
 
-#include <iostream>
+#include <array>
+#include <chrono>
+#include <cstdio>
 #include <filesystem>
+#include <thread>
 
 namespace fs = std::filesystem;
 
 namespace sshconn {
 
+namespace {
+
+// How often migration checks on forwards being bound or released
+constexpr int MIGRATION_POLL_MS = 10;
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
 SSHClient::SSHClient()
 {
 }
@@ -32,6 +46,10 @@ void SSHClient::setState(ConnectionState state, const std::string& errorMessage)
 {
     m_state = state;
     m_errorMessage = errorMessage;
+    MetricsRegistry::instance().session().state.store(static_cast<int>(state));
+    if (state == ConnectionState::Connected) {
+        m_wasConnected = true;
+    }
     if (m_stateCallback) {
         m_stateCallback(state, errorMessage);
     }
@@ -48,7 +66,7 @@ bool SSHClient::loadKey(const std::string& keyPath)
     // Try loading key (libssh auto-detects key type)
     int rc = ssh_pki_import_privkey_file(keyPath.c_str(), nullptr, nullptr, nullptr, &m_privateKey);
     if (rc != SSH_OK) {
-        std::cerr << "Failed to load SSH key: " << keyPath << std::endl;
+        logError("ssh", "Failed to load SSH key: " + keyPath);
         return false;
     }
 
@@ -64,74 +82,297 @@ void SSHClient::connect()
         }
     }
 
-    setState(ConnectionState::Connecting);
+    SessionMetrics& sessionMetrics = MetricsRegistry::instance().session();
+    sessionMetrics.connectAttempts.add();
+    if (m_wasConnected) {
+        sessionMetrics.reconnects.add();
+    }
 
-    // Get key path
-    ConfigManager configManager;
-    std::string keyPath = configManager.sshKeyPath();
+    setState(ConnectionState::Connecting);
 
-    // Check if key exists
-    if (!fs::exists(keyPath)) {
-        std::string error = "SSH key not found: " + keyPath;
+    RekeyConfig rekey;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        rekey = m_rekey;
+    }
+    std::string error;
+    Clock::time_point keyedAt;
+    ssh_session session = openSession(m_endpoint, rekey, keyedAt, error);
+    if (session == nullptr) {
         cleanup();
         setState(ConnectionState::Error, error);
-        std::cerr << error << std::endl;
+        logError("ssh", error);
         return;
     }
+    m_session = session;
+    m_sessionRekey = rekey;
+    m_sessionKeyedAt = keyedAt;
+
+    setState(ConnectionState::Connected);
+    logInfo("ssh", "Connected successfully");
+}
+
+ssh_session SSHClient::openSession(const ServerEndpoint& endpoint, const RekeyConfig& rekey,
+                                   Clock::time_point& keyedAt, std::string& error)
+{
+    SessionMetrics& metrics = MetricsRegistry::instance().session();
+    std::array<Clock::duration, CONNECT_PHASE_COUNT> elapsed{};
+    auto phaseStart = Clock::now();
+    auto endPhase = [&](ConnectPhase phase) {
+        auto now = Clock::now();
+        elapsed[static_cast<std::size_t>(phase)] = now - phaseStart;
+        metrics.connectPhase(phase).record(now - phaseStart);
+        phaseStart = now;
+    };
+
+    // Get key path; discovery results are shared, so reconnects do not re-probe
+    std::string keyPath = endpoint.keyPath;
+    if (keyPath.empty()) {
+        keyPath = PathResolver::instance().paths()->keyPath;
+        if (!fs::exists(keyPath)) {
+            // The key may have been put in place since the last discovery
+            keyPath = PathResolver::instance().refresh()->keyPath;
+        }
+    }
+
+    // Check if key exists
+    if (!fs::exists(keyPath)) {
+        error = "SSH key not found: " + keyPath;
+        return nullptr;
+    }
 
     // Load the private key
     if (!loadKey(keyPath)) {
-        std::string error = "Failed to load SSH key: " + keyPath;
-        cleanup();
-        setState(ConnectionState::Error, error);
-        std::cerr << error << std::endl;
-        return;
+        error = "Failed to load SSH key: " + keyPath;
+        return nullptr;
     }
+    endPhase(ConnectPhase::KeyLoad);
 
     // Create SSH session
-    m_session = ssh_new();
-    if (m_session == nullptr) {
-        std::string error = "Failed to create SSH session";
-        cleanup();
-        setState(ConnectionState::Error, error);
-        std::cerr << error << std::endl;
-        return;
+    ssh_session session = ssh_new();
+    if (session == nullptr) {
+        error = "Failed to create SSH session";
+        return nullptr;
     }
 
     // Configure session
-    ssh_options_set(m_session, SSH_OPTIONS_HOST, ServerConfig::SSH_HOST);
-    int port = ServerConfig::SSH_PORT;
-    ssh_options_set(m_session, SSH_OPTIONS_PORT, &port);
-    ssh_options_set(m_session, SSH_OPTIONS_USER, ServerConfig::SSH_USER);
+    ssh_options_set(session, SSH_OPTIONS_HOST, endpoint.host.c_str());
+    int port = endpoint.port;
+    ssh_options_set(session, SSH_OPTIONS_PORT, &port);
+    ssh_options_set(session, SSH_OPTIONS_USER, endpoint.user.c_str());
 
     // Set connection timeout
     int timeout = 30;
-    ssh_options_set(m_session, SSH_OPTIONS_TIMEOUT, &timeout);
+    ssh_options_set(session, SSH_OPTIONS_TIMEOUT, &timeout);
 
-    std::cout << "Connecting to " << ServerConfig::SSH_USER << "@" << ServerConfig::SSH_HOST << ":" << ServerConfig::SSH_PORT << std::endl;
+    // Rekey limits (RFC 4253 section 9)
+    uint64_t rekeyData = static_cast<uint64_t>(rekey.dataBytes);
+    ssh_options_set(session, SSH_OPTIONS_REKEY_DATA, &rekeyData);
+    uint32_t rekeyTime = static_cast<uint32_t>(rekey.timeSeconds);
+    ssh_options_set(session, SSH_OPTIONS_REKEY_TIME, &rekeyTime);
+
+    logInfo("ssh", "Connecting to " + endpoint.user + "@" + endpoint.host + ":" + std::to_string(endpoint.port));
+    endPhase(ConnectPhase::SessionCreate);
 
     // Connect to server
-    int rc = ssh_connect(m_session);
+    int rc = ssh_connect(session);
     if (rc != SSH_OK) {
-        std::string error = "Connection failed: " + std::string(ssh_get_error(m_session));
-        cleanup();
-        setState(ConnectionState::Error, error);
-        std::cerr << error << std::endl;
-        return;
+        error = "Connection failed: " + std::string(ssh_get_error(session));
+        ssh_free(session);
+        return nullptr;
     }
+    endPhase(ConnectPhase::Handshake);
+    keyedAt = Clock::now(); // The rekey limits count from the first key exchange
 
     // Authenticate with public key
-    rc = ssh_userauth_publickey(m_session, nullptr, m_privateKey);
+    rc = ssh_userauth_publickey(session, nullptr, m_privateKey);
     if (rc != SSH_AUTH_SUCCESS) {
-        std::string error = "Authentication failed: " + std::string(ssh_get_error(m_session));
-        cleanup();
-        setState(ConnectionState::Error, error);
-        std::cerr << error << std::endl;
-        return;
+        error = "Authentication failed: " + std::string(ssh_get_error(session));
+        ssh_disconnect(session);
+        ssh_free(session);
+        return nullptr;
     }
+    endPhase(ConnectPhase::Auth);
+
+    auto formatMillis = [](std::uint64_t micros) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.1f", static_cast<double>(micros) / 1000.0);
+        return std::string(buffer);
+    };
+    auto millis = [&](Clock::duration d) {
+        return formatMillis(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+    auto p99 = [&](ConnectPhase phase) { return formatMillis(metrics.connectPhase(phase).percentile(0.99)); };
+    Clock::duration total{};
+    for (auto d : elapsed) {
+        total += d;
+    }
+    logInfo("ssh", "Session established in " + millis(total) + " ms (key load "
+                       + millis(elapsed[static_cast<std::size_t>(ConnectPhase::KeyLoad)]) + ", session "
+                       + millis(elapsed[static_cast<std::size_t>(ConnectPhase::SessionCreate)]) + ", handshake "
+                       + millis(elapsed[static_cast<std::size_t>(ConnectPhase::Handshake)]) + ", auth "
+                       + millis(elapsed[static_cast<std::size_t>(ConnectPhase::Auth)]) + "); p99 over "
+                       + std::to_string(metrics.connectPhase(ConnectPhase::Auth).count()) + " sessions: handshake "
+                       + p99(ConnectPhase::Handshake) + " ms, auth " + p99(ConnectPhase::Auth) + " ms, forward setup "
+                       + p99(ConnectPhase::ForwardSetup) + " ms");
+    return session;
+}
 
-    setState(ConnectionState::Connected);
-    std::cout << "Connected successfully" << std::endl;
+bool SSHClient::migrate(const ServerEndpoint& endpoint)
+{
+    if (!isConnected()) {
+        return false;
+    }
+
+    // Make: the old session keeps forwarding while the new one connects
+    RekeyConfig rekey;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        rekey = m_rekey;
+    }
+    std::string error;
+    Clock::time_point keyedAt;
+    ssh_session session = openSession(endpoint, rekey, keyedAt, error);
+    if (session == nullptr) {
+        logError("ssh", "Migration failed, staying on the current session: " + error);
+        return false;
+    }
+
+    m_migrating.store(true);
+    std::vector<TunnelConfig> tunnels;
+    if (m_tunnelHandler) {
+        tunnels = m_tunnelHandler->tunnels();
+    }
+
+    // Bind everything on the new session first. A port the old session still
+    // holds (the same relay, or a local listener) cannot bind yet; those
+    // forwards are released on the old session alone and retried.
+    std::unique_ptr<TunnelHandler> handler;
+    std::vector<TunnelConfig> blocked = bindTunnels(handler, session, rekey, keyedAt, tunnels);
+    double drainTimeout;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        drainTimeout = m_drainTimeout;
+    }
+    auto drainFor = std::chrono::milliseconds(static_cast<long long>(drainTimeout * 1000));
+
+    std::vector<TunnelConfig> unbound;
+    if (!blocked.empty()) {
+        for (const TunnelConfig& tunnel : blocked) {
+            m_tunnelHandler->removeForward(tunnel.key());
+        }
+        for (const TunnelConfig& tunnel : blocked) {
+            while (m_tunnelHandler->isRunning() && m_tunnelHandler->isForwarding(tunnel.key())) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(MIGRATION_POLL_MS));
+            }
+        }
+        unbound = bindTunnels(handler, session, rekey, keyedAt, blocked);
+    }
+
+    if (!unbound.empty()) {
+        // Roll back rather than drop a tunnel: the new session's connections
+        // finish and it closes, and the released forwards return to the old one
+        if (handler) {
+            handler->drain(drainFor);
+            handler->join();
+            handler.reset();
+        }
+        if (ssh_is_connected(session)) {
+            ssh_disconnect(session);
+        }
+        ssh_free(session);
+        for (const TunnelConfig& tunnel : bindTunnels(m_tunnelHandler, m_session, m_sessionRekey, m_sessionKeyedAt,
+                                                      blocked)) {
+            logError("ssh", "Tunnel " + tunnelKeyName(tunnel.key()) + " lost restoring the current session");
+        }
+        m_migrating.store(false);
+        logError("ssh", "Migration failed, staying on the current session: tunnel " +
+                 tunnelKeyName(unbound.front().key()) + " could not be bound on the new one");
+        return false;
+    }
+    m_migrating.store(false);
+
+    // Break: the old handler stops accepting and drains in the background
+    std::unique_ptr<TunnelHandler> oldHandler;
+    ssh_session oldSession = m_session;
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        oldHandler = std::move(m_tunnelHandler);
+    }
+    if (oldHandler) {
+        oldHandler->drain(drainFor);
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        m_session = session;
+        m_sessionRekey = rekey;
+        m_sessionKeyedAt = keyedAt;
+        m_tunnelHandler = std::move(handler);
+        m_endpoint = endpoint;
+    }
+    logInfo("ssh", "Migrated to " + endpoint.user + "@" + endpoint.host + ":" + std::to_string(endpoint.port));
+
+    // Open connections finish on the old session before it closes
+    if (oldHandler) {
+        oldHandler->join();
+    }
+    if (ssh_is_connected(oldSession)) {
+        ssh_disconnect(oldSession);
+    }
+    ssh_free(oldSession);
+    return true;
+}
+
+std::vector<TunnelConfig> SSHClient::bindTunnels(std::unique_ptr<TunnelHandler>& handler, ssh_session session,
+                                                 const RekeyConfig& rekey, Clock::time_point keyedAt,
+                                                 const std::vector<TunnelConfig>& tunnels)
+{
+    if (tunnels.empty()) {
+        return {};
+    }
+
+    if (handler && handler->isRunning()) {
+        for (const TunnelConfig& tunnel : tunnels) {
+            handler->addForward(tunnel);
+        }
+    } else {
+        if (handler) {
+            handler->join(); // Every forward it had failed
+        }
+        handler = std::make_unique<TunnelHandler>(session, tunnels.front());
+        for (std::size_t i = 1; i < tunnels.size(); ++i) {
+            handler->addForward(tunnels[i]);
+        }
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            handler->setRateLimit(m_rateLimit);
+            handler->setProbe(m_probe);
+        }
+        handler->setRekeyPolicy(rekey, keyedAt);
+        handler->setErrorCallback([this](const std::string& error) {
+            if (m_migrating.load()) {
+                // Expected for ports the old session holds; they are retried
+                logDebug("tunnel", "Tunnel not bound yet: " + error);
+            } else {
+                logError("tunnel", "Tunnel error: " + error);
+            }
+        });
+        handler->start();
+    }
+
+    // Wait until the handler thread has bound or given up on each
+    std::vector<TunnelConfig> failed;
+    for (const TunnelConfig& tunnel : tunnels) {
+        TunnelKey key = tunnel.key();
+        while (handler->isRunning() && handler->hasForward(key) && !handler->isForwarding(key)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(MIGRATION_POLL_MS));
+        }
+        if (!handler->isForwarding(key)) {
+            failed.push_back(tunnel);
+        }
+    }
+    return failed;
 }
 
 void SSHClient::disconnect()
@@ -143,19 +384,17 @@ void SSHClient::disconnect()
         }
     }
 
+    // Let forwarded connections finish while the session can still carry them
+    stopTunnelHandler(isTransportActive());
     cleanup();
     setState(ConnectionState::Disconnected);
-    std::cout << "Disconnected" << std::endl;
+    logInfo("ssh", "Disconnected");
 }
 
 void SSHClient::cleanup()
 {
     // Stop tunnel handler first
-    if (m_tunnelHandler) {
-        m_tunnelHandler->stop();
-        m_tunnelHandler->join();
-        m_tunnelHandler.reset();
-    }
+    stopTunnelHandler(false);
 
     // Free SSH session
     if (m_session != nullptr) {
@@ -173,50 +412,159 @@ void SSHClient::cleanup()
     }
 }
 
-bool SSHClient::checkConnection()
+void SSHClient::stopTunnelHandler(bool drain)
 {
-    if (!isTransportActive()) {
-        return false;
+    if (!m_tunnelHandler) {
+        return;
+    }
+    if (drain) {
+        double timeout;
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            timeout = m_drainTimeout;
+        }
+        m_tunnelHandler->drain(std::chrono::milliseconds(static_cast<long long>(timeout * 1000)));
+    } else {
+        m_tunnelHandler->stop();
     }
+    m_tunnelHandler->join();
 
-    // Send a keep-alive message to verify connection
-    int rc = ssh_send_ignore(m_session, "keepalive");
-    return rc == SSH_OK;
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_tunnelHandler.reset();
+}
+
+bool SSHClient::checkConnection()
+{
+    // A running handler owns the session and keeps it alive; ask it rather
+    // than touching the session from this thread
+    std::lock_guard<std::mutex> locker(m_mutex);
+    if (m_tunnelHandler && m_tunnelHandler->isRunning()) {
+        return m_tunnelHandler->isResponsive();
+    }
+    return isTransportActive();
 }
 
 bool SSHClient::startReverseTunnel(int localPort, int remotePort)
 {
+    TunnelConfig tunnel;
+    tunnel.localPort = localPort;
+    tunnel.remotePort = remotePort;
+    return startTunnel(tunnel);
+}
+
+bool SSHClient::startTunnel(const TunnelConfig& tunnel)
+{
+    std::string description;
+    switch (tunnel.type) {
+        case TunnelType::Remote:
+            description = "reverse tunnel: remote:" + std::to_string(tunnel.remotePort) + " -> local:" + std::to_string(tunnel.localPort);
+            break;
+        case TunnelType::Local:
+            description = "local tunnel: local:" + std::to_string(tunnel.localPort) + " -> remote:" + std::to_string(tunnel.remotePort);
+            break;
+        case TunnelType::Dynamic:
+            description = "SOCKS5 tunnel: local:" + std::to_string(tunnel.localPort);
+            break;
+    }
+
     if (!isTransportActive()) {
-        std::cerr << "Cannot start tunnel: not connected" << std::endl;
+        logError("ssh", "Cannot start tunnel: not connected");
         return false;
     }
 
-    // Stop any existing tunnel
-    stopReverseTunnel(remotePort);
+    // The running handler owns the session; hand it the new forward
+    if (m_tunnelHandler && m_tunnelHandler->isRunning()) {
+        m_tunnelHandler->addForward(tunnel);
+        logInfo("ssh", "Adding " + description);
+        return true;
+    }
+
+    // Reap a handler whose forwards all failed
+    stopTunnelHandler(false);
 
     // Create and start tunnel handler
-    m_tunnelHandler = std::make_unique<TunnelHandler>(m_session, localPort, remotePort);
+    auto handler = std::make_unique<TunnelHandler>(m_session, tunnel);
+    {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        handler->setRateLimit(m_rateLimit);
+        handler->setRekeyPolicy(m_sessionRekey, m_sessionKeyedAt);
+        handler->setProbe(m_probe);
+        m_tunnelHandler = std::move(handler);
+    }
 
     // Connect callbacks
     m_tunnelHandler->setErrorCallback([](const std::string& error) {
-        std::cerr << "Tunnel error: " << error << std::endl;
+        logError("tunnel", "Tunnel error: " + error);
     });
 
     m_tunnelHandler->start();
 
-    std::cout << "Starting reverse tunnel: remote:" << remotePort << " -> local:" << localPort << std::endl;
+    logInfo("ssh", "Starting " + description);
     return true;
 }
 
-void SSHClient::stopReverseTunnel(int remotePort)
+void SSHClient::stopTunnel(const TunnelKey& key)
+{
+    if (!m_tunnelHandler) {
+        return;
+    }
+
+    m_tunnelHandler->removeForward(key);
+    if (!m_tunnelHandler->hasForwards()) {
+        // Connections already accepted get to finish
+        stopTunnelHandler(isTransportActive());
+        logInfo("ssh", "Tunnel stopped");
+    }
+}
+
+bool SSHClient::isForwarding(const TunnelKey& key) const
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    return m_tunnelHandler && m_tunnelHandler->isForwarding(key);
+}
+
+void SSHClient::applyTunnelChanges(const ConfigDelta& delta)
+{
+    if (!isTransportActive()) {
+        return; // Picked up from the config on the next connect
+    }
+
+    // Add before removing so a moved tunnel is never absent
+    for (const TunnelConfig& tunnel : delta.tunnelsAdded) {
+        startTunnel(tunnel);
+    }
+    for (const TunnelKey& key : delta.tunnelsRemoved) {
+        stopTunnel(key);
+    }
+}
+
+void SSHClient::setRateLimit(const RateLimitConfig& limit)
 {
-    (void)remotePort; // Unused parameter
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_rateLimit = limit;
+    if (m_tunnelHandler) {
+        m_tunnelHandler->setRateLimit(limit);
+    }
+}
 
+void SSHClient::setDrainTimeout(double seconds)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_drainTimeout = seconds;
+}
+
+void SSHClient::setRekeyPolicy(const RekeyConfig& policy)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_rekey = policy;
+}
+
+void SSHClient::setProbe(const ProbeConfig& probe)
+{
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_probe = probe;
     if (m_tunnelHandler) {
-        m_tunnelHandler->stop();
-        m_tunnelHandler->join();
-        m_tunnelHandler.reset();
-        std::cout << "Tunnel stopped" << std::endl;
+        m_tunnelHandler->setProbe(probe);
     }
 }
 
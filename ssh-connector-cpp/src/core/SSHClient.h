@@ -5,10 +5,13 @@
 #include "TunnelHandler.h"
 #include "../config/Config.h"
 
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <mutex>
 #include <string>
 #include <memory>
+#include <vector>
 #include <libssh/libssh.h>
 
 namespace sshconn {
@@ -28,33 +31,84 @@ public:
     void connect();
     void disconnect();
 
+    // Replace the session make-before-break: connect to endpoint and bind the
+    // tunnels there while the current session keeps forwarding, then drain
+    // and close the current one. Returns false, keeping the current session
+    // and all its tunnels, if the new session cannot be opened or one of the
+    // tunnels cannot be bound on it.
+    bool migrate(const ServerEndpoint& endpoint);
+
     // State queries
     ConnectionState state() const { return m_state; }
     std::string errorMessage() const { return m_errorMessage; }
     bool isConnected() const;
 
-    // Tunnel management
+    // Tunnel management; tunnels of either type share the session
     bool startReverseTunnel(int localPort, int remotePort);
-    void stopReverseTunnel(int remotePort);
+    bool startTunnel(const TunnelConfig& tunnel);
+    void stopTunnel(const TunnelKey& key);
+    // True once the tunnel accepts connections
+    bool isForwarding(const TunnelKey& key) const;
+
+    // Apply the tunnel part of a config reload without touching other forwards
+    void applyTunnelChanges(const ConfigDelta& delta);
+
+    // Limit all tunnels combined (per direction); applies to open connections too
+    void setRateLimit(const RateLimitConfig& limit);
+
+    // How long open connections may take to finish when tunnels are stopped
+    // on a live session; 0 closes them at once
+    void setDrainTimeout(double seconds);
 
-    // Connection health
+    // Rekey limits for sessions opened from now on; migrate() to apply them
+    // to a connected client
+    void setRekeyPolicy(const RekeyConfig& policy);
+
+    // End-to-end probe through the relay; runs while any tunnel does
+    void setProbe(const ProbeConfig& probe);
+
+    // Connection health: keepalives going out (and probes answered, if on)
+    // while tunnels run, otherwise whether the transport is up
     bool checkConnection();
 
+    // Server to connect to (defaults to ServerConfig)
+    void setEndpoint(const ServerEndpoint& endpoint) { m_endpoint = endpoint; }
+    const ServerEndpoint& endpoint() const { return m_endpoint; }
+
     // Callback registration
     void setStateCallback(StateCallback cb) { m_stateCallback = std::move(cb); }
 
 private:
     void setState(ConnectionState state, const std::string& errorMessage = std::string());
     bool loadKey(const std::string& keyPath);
+    // Connected and authenticated, or nullptr with error set; keyedAt is
+    // when the first key exchange finished
+    ssh_session openSession(const ServerEndpoint& endpoint, const RekeyConfig& rekey,
+                            std::chrono::steady_clock::time_point& keyedAt, std::string& error);
+    // Start tunnels on session's handler (created if needed) and wait for
+    // their binds; returns the ones that did not bind
+    std::vector<TunnelConfig> bindTunnels(std::unique_ptr<TunnelHandler>& handler, ssh_session session,
+                                          const RekeyConfig& rekey, std::chrono::steady_clock::time_point keyedAt,
+                                          const std::vector<TunnelConfig>& tunnels);
     void cleanup();
+    void stopTunnelHandler(bool drain);
     bool isTransportActive() const;
 
+    ServerEndpoint m_endpoint;
     ssh_session m_session = nullptr;
     ssh_key m_privateKey = nullptr;
     ConnectionState m_state = ConnectionState::Disconnected;
     std::string m_errorMessage;
+    bool m_wasConnected = false;
     mutable std::mutex m_mutex;
 
+    RateLimitConfig m_rateLimit;
+    double m_drainTimeout = 30.0;
+    RekeyConfig m_rekey;
+    RekeyConfig m_sessionRekey; // What m_session was opened with
+    std::chrono::steady_clock::time_point m_sessionKeyedAt; // When m_session's first key exchange finished
+    ProbeConfig m_probe;
+    std::atomic<bool> m_migrating{false};
     std::unique_ptr<TunnelHandler> m_tunnelHandler;
     StateCallback m_stateCallback;
 };
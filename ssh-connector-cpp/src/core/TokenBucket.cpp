@@ -0,0 +1,60 @@
+#include "TokenBucket.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace sshconn {
+
+void TokenBucket::configure(const RateLimitConfig& limit, Clock::time_point now)
+{
+    bool wasLimited = limited();
+    refill(now);
+
+    m_limit = limit;
+    m_capacity = static_cast<double>(limit.burstBytes > 0 ? limit.burstBytes : limit.bytesPerSecond);
+    // A bucket that starts limiting starts full
+    m_tokens = wasLimited ? std::min(m_tokens, m_capacity) : m_capacity;
+    m_lastRefill = now;
+}
+
+void TokenBucket::refill(Clock::time_point now)
+{
+    if (!limited() || now <= m_lastRefill) {
+        return;
+    }
+    double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_tokens = std::min(m_capacity, m_tokens + elapsed * static_cast<double>(m_limit.bytesPerSecond));
+    m_lastRefill = now;
+}
+
+std::size_t TokenBucket::available(Clock::time_point now)
+{
+    if (!limited()) {
+        return std::numeric_limits<std::size_t>::max();
+    }
+    refill(now);
+    return static_cast<std::size_t>(m_tokens);
+}
+
+void TokenBucket::consume(std::size_t bytes)
+{
+    if (limited()) {
+        m_tokens = std::max(0.0, m_tokens - static_cast<double>(bytes));
+    }
+}
+
+TokenBucket::Clock::time_point TokenBucket::readyAt(std::size_t bytes, Clock::time_point now) const
+{
+    if (!limited()) {
+        return now;
+    }
+    double wanted = std::min(static_cast<double>(bytes), m_capacity);
+    double missing = wanted - m_tokens;
+    if (missing <= 0.0) {
+        return now;
+    }
+    auto wait = std::chrono::duration<double>(missing / static_cast<double>(m_limit.bytesPerSecond));
+    return now + std::chrono::duration_cast<Clock::duration>(wait);
+}
+
+} // namespace sshconn
@@ -0,0 +1,43 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include "../config/Config.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace sshconn {
+
+// Byte-granular token bucket. Refills continuously at the configured rate up
+// to the burst size; an unconfigured (rate 0) bucket never limits.
+// Not thread-safe: each bucket is owned by one TunnelHandler thread.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Apply a new limit. The current fill level is kept (capped at the new
+    // burst) so a runtime change neither grants nor revokes a full burst.
+    void configure(const RateLimitConfig& limit, Clock::time_point now);
+    const RateLimitConfig& limit() const { return m_limit; }
+    bool limited() const { return m_limit.bytesPerSecond > 0; }
+
+    // Whole bytes that may be sent now
+    std::size_t available(Clock::time_point now);
+    void consume(std::size_t bytes);
+
+    // Earliest time at which `bytes` (at most one burst) will be available
+    Clock::time_point readyAt(std::size_t bytes, Clock::time_point now) const;
+
+private:
+    void refill(Clock::time_point now);
+
+    RateLimitConfig m_limit;
+    double m_capacity = 0.0;
+    double m_tokens = 0.0;
+    Clock::time_point m_lastRefill{};
+};
+
+} // namespace sshconn
+
+#endif // TOKEN_BUCKET_H
@@ -0,0 +1,153 @@
+#include "TraceLog.h"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace sshconn {
+
+namespace {
+
+// Instant events, in TracePoint order from FirstByteToLocal
+const char* const INSTANT_NAMES[] = {
+    "first byte to local",
+    "first byte to remote",
+    "EOF from remote",
+    "EOF from local",
+};
+
+double micros(std::chrono::steady_clock::duration elapsed)
+{
+    return std::chrono::duration<double, std::micro>(elapsed).count();
+}
+
+} // namespace
+
+TraceLog& TraceLog::instance()
+{
+    static TraceLog log;
+    return log;
+}
+
+TraceLog::TraceLog()
+    : m_origin(Clock::now())
+{
+}
+
+void TraceLog::configure(const TraceConfig& config)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::size_t capacity = static_cast<std::size_t>(config.capacity);
+        if (capacity != m_capacity) {
+            m_ring.clear();
+            m_ring.reserve(config.enabled ? capacity : 0);
+            m_capacity = capacity;
+            m_next = 0;
+        }
+    }
+    m_enabled.store(config.enabled, std::memory_order_relaxed);
+}
+
+std::unique_ptr<ConnectionTrace> TraceLog::begin(int listenPort, TunnelType type, Clock::time_point acceptedAt)
+{
+    if (!enabled()) {
+        return nullptr;
+    }
+    auto trace = std::make_unique<ConnectionTrace>();
+    trace->id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+    trace->listenPort = listenPort;
+    trace->type = type;
+    trace->mark(TracePoint::Accepted, acceptedAt);
+    return trace;
+}
+
+void TraceLog::finish(const ConnectionTrace& trace)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        return;
+    }
+    if (m_ring.size() < m_capacity) {
+        m_ring.push_back(trace);
+        return;
+    }
+    m_ring[m_next] = trace;
+    m_next = (m_next + 1) % m_capacity;
+}
+
+std::vector<ConnectionTrace> TraceLog::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<ConnectionTrace> traces;
+    traces.reserve(m_ring.size());
+    for (std::size_t i = 0; i < m_ring.size(); ++i) {
+        traces.push_back(m_ring[(m_next + i) % m_ring.size()]);
+    }
+    return traces;
+}
+
+std::string TraceLog::chromeTraceJson() const
+{
+    std::vector<ConnectionTrace> traces = snapshot();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() -> std::ostringstream& {
+        if (!first) {
+            out << ",";
+        }
+        first = false;
+        out << "\n";
+        return out;
+    };
+
+    // One row group per tunnel, named once. A remote and a local tunnel can
+    // share a port number, so groups are numbered rather than keyed by port.
+    std::map<TunnelKey, int> pids;
+    for (const ConnectionTrace& trace : traces) {
+        TunnelKey key{trace.type, trace.listenPort};
+        if (pids.count(key) == 0) {
+            int pid = static_cast<int>(pids.size()) + 1;
+            pids[key] = pid;
+            separator() << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+                        << ",\"args\":{\"name\":\"" << tunnelTypeToString(trace.type) << " tunnel "
+                        << trace.listenPort << "\"}}";
+        }
+    }
+
+    for (const ConnectionTrace& trace : traces) {
+        int pid = pids[TunnelKey{trace.type, trace.listenPort}];
+        auto at = [&trace](TracePoint point) { return trace.at[static_cast<std::size_t>(point)]; };
+        Clock::time_point accepted = at(TracePoint::Accepted);
+        Clock::time_point closed = trace.reached(TracePoint::Closed) ? at(TracePoint::Closed) : accepted;
+
+        separator() << "{\"name\":\"connection " << trace.id << "\",\"ph\":\"X\",\"pid\":" << pid
+                    << ",\"tid\":" << trace.id << ",\"ts\":" << micros(accepted - m_origin)
+                    << ",\"dur\":" << micros(closed - accepted)
+                    << ",\"args\":{\"failed\":" << (trace.failed ? "true" : "false") << "}}";
+
+        if (trace.reached(TracePoint::ConnectStarted)) {
+            Clock::time_point started = at(TracePoint::ConnectStarted);
+            Clock::time_point finished = trace.reached(TracePoint::ConnectFinished) ? at(TracePoint::ConnectFinished) : closed;
+            separator() << "{\"name\":\"" << (trace.type == TunnelType::Remote ? "local connect" : "channel open")
+                        << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << trace.id
+                        << ",\"ts\":" << micros(started - m_origin) << ",\"dur\":" << micros(finished - started) << "}";
+        }
+
+        for (std::size_t i = 0; i < sizeof(INSTANT_NAMES) / sizeof(INSTANT_NAMES[0]); ++i) {
+            auto point = static_cast<TracePoint>(static_cast<std::size_t>(TracePoint::FirstByteToLocal) + i);
+            if (trace.reached(point)) {
+                separator() << "{\"name\":\"" << INSTANT_NAMES[i] << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":"
+                            << pid << ",\"tid\":" << trace.id
+                            << ",\"ts\":" << micros(at(point) - m_origin) << "}";
+            }
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+} // namespace sshconn
@@ -0,0 +1,99 @@
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include "../config/Config.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sshconn {
+
+// Steps in a forwarded connection's life. The connect step is the connect to
+// the local target for reverse tunnels and the direct-tcpip channel open for
+// the others; "to local" is the channel -> socket direction.
+enum class TracePoint {
+    Accepted,
+    ConnectStarted,
+    ConnectFinished,
+    FirstByteToLocal,
+    FirstByteToRemote,
+    EofFromRemote,
+    EofFromLocal,
+    Closed
+};
+
+constexpr std::size_t TRACE_POINT_COUNT = static_cast<std::size_t>(TracePoint::Closed) + 1;
+
+// Monotonic timestamps for one connection; a step not reached stays zero
+struct ConnectionTrace {
+    using Clock = std::chrono::steady_clock;
+
+    std::uint64_t id = 0;
+    int listenPort = 0;
+    TunnelType type = TunnelType::Remote;
+    bool failed = false;
+    std::array<Clock::time_point, TRACE_POINT_COUNT> at{};
+
+    // Only the first time counts
+    void mark(TracePoint point, Clock::time_point when)
+    {
+        Clock::time_point& slot = at[static_cast<std::size_t>(point)];
+        if (slot == Clock::time_point{}) {
+            slot = when;
+        }
+    }
+    bool reached(TracePoint point) const { return at[static_cast<std::size_t>(point)] != Clock::time_point{}; }
+};
+
+// Process-wide ring of the most recently closed connections' traces. Tunnel
+// handlers only stamp times while a connection is open and hand the record
+// over when it closes, so tracing costs one lock per connection.
+class TraceLog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static TraceLog& instance();
+
+    // Prevent copying
+    TraceLog(const TraceLog&) = delete;
+    TraceLog& operator=(const TraceLog&) = delete;
+
+    // Enable or disable; a new capacity drops what was recorded
+    void configure(const TraceConfig& config);
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // A new trace for a connection accepted at `acceptedAt`; nullptr when
+    // tracing is off
+    std::unique_ptr<ConnectionTrace> begin(int listenPort, TunnelType type, Clock::time_point acceptedAt);
+    void finish(const ConnectionTrace& trace);
+
+    // Oldest first
+    std::vector<ConnectionTrace> snapshot() const;
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto): one row per
+    // connection, grouped by tunnel
+    std::string chromeTraceJson() const;
+
+private:
+    TraceLog();
+
+    std::atomic<bool> m_enabled{false};
+    std::atomic<std::uint64_t> m_nextId{1};
+    const Clock::time_point m_origin;
+
+    mutable std::mutex m_mutex;
+    std::vector<ConnectionTrace> m_ring;
+    std::size_t m_capacity = 0;
+    std::size_t m_next = 0; // Oldest entry once the ring is full
+};
+
+} // namespace sshconn
+
+#endif // TRACE_LOG_H
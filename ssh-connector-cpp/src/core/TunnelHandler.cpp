@@ -1,6 +1,8 @@
 #include "TunnelHandler.h"
+#include "Logger.h"
+#include "../config/Config.h"
 
-#include <iostream>
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 
@@ -10,8 +12,10 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <sys/socket.h>
+#include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cerrno>
@@ -19,11 +23,222 @@
 
 namespace sshconn {
 
-TunnelHandler::TunnelHandler(ssh_session session, int localPort, int remotePort)
+namespace {
+
+// How long one accept waits while idle; bounds the delay before queued
+// forward changes apply
+constexpr int ACCEPT_TIMEOUT_MS = 250;
+
+// Longest wait on sockets while connections are open. libssh may already hold
+// channel data that no longer shows on the session socket; this bounds how
+// long such data waits.
+constexpr int ACTIVE_WAIT_MS = 10;
+
+// New channels taken per pass, so an accept storm cannot starve open connections
+constexpr int MAX_ACCEPTS_PER_PASS = 16;
+
+// Channels over a tunnel's max_connections wait at most this long, and at most
+// this many per tunnel, before being rejected
+constexpr auto ADMISSION_TIMEOUT = std::chrono::seconds(5);
+constexpr std::size_t MAX_QUEUED_PER_TUNNEL = 32;
+
+// Scheduling. Each pass a connection may move its quantum: its chunk size
+// scaled by its tunnel's priority relative to the highest priority with open
+// connections. Flows whose recent transfers average at most
+// INTERACTIVE_MAX_AVERAGE bytes count as interactive and are served first.
+constexpr std::size_t MIN_QUANTUM = 1024;
+constexpr double INTERACTIVE_MAX_AVERAGE = 512.0;
+constexpr double TRANSFER_AVERAGE_WEIGHT = 0.25;
+
+// Smallest grant a throttled connection waits for, so a slow limit does not
+// turn into one tiny write per pass
+constexpr std::size_t MIN_THROTTLED_GRANT = 4096;
+
+// SOCKS5 (RFC 1928), CONNECT without authentication only
+constexpr unsigned char SOCKS_VERSION = 0x05;
+constexpr unsigned char SOCKS_NO_AUTH = 0x00;
+constexpr unsigned char SOCKS_NO_ACCEPTABLE_METHOD = 0xFF;
+constexpr unsigned char SOCKS_CMD_CONNECT = 0x01;
+constexpr unsigned char SOCKS_ATYP_IPV4 = 0x01;
+constexpr unsigned char SOCKS_ATYP_DOMAIN = 0x03;
+constexpr unsigned char SOCKS_ATYP_IPV6 = 0x04;
+constexpr unsigned char SOCKS_REPLY_SUCCEEDED = 0x00;
+constexpr unsigned char SOCKS_REPLY_GENERAL_FAILURE = 0x01;
+constexpr unsigned char SOCKS_REPLY_HOST_UNREACHABLE = 0x04;
+constexpr unsigned char SOCKS_REPLY_CONNECTION_REFUSED = 0x05;
+constexpr unsigned char SOCKS_REPLY_COMMAND_NOT_SUPPORTED = 0x07;
+constexpr unsigned char SOCKS_REPLY_ADDRESS_NOT_SUPPORTED = 0x08;
+constexpr std::size_t SOCKS_MAX_MESSAGE = 4 + 1 + 255 + 2; // Request with the longest hostname
+
+// ssh_send_keepalive sends keepalive@openssh.com with want_reply and does not
+// wait: libssh drops the answer when it arrives. An answer still on its way
+// when a forward is requested or cancelled would be taken for that request's,
+// so those wait until this long after the last keepalive.
+constexpr auto KEEPALIVE_ANSWER_WAIT = std::chrono::seconds(2);
+
+// The probe's forward binds the relay's loopback only, and its channel is
+// opened to it there
+constexpr const char* PROBE_BIND_ADDRESS = "127.0.0.1";
+
+#ifdef _WIN32
+using PollFd = WSAPOLLFD;
+
+int pollSockets(PollFd* fds, std::size_t count, int timeoutMs)
+{
+    return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs);
+}
+
+bool wouldBlock()
+{
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+bool connectInProgress()
+{
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+using PollFd = struct pollfd;
+
+int pollSockets(PollFd* fds, std::size_t count, int timeoutMs)
+{
+    return poll(fds, static_cast<nfds_t>(count), timeoutMs);
+}
+
+bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+bool connectInProgress()
+{
+    return errno == EINPROGRESS;
+}
+#endif
+
+void setNonBlocking(int sock)
+{
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+// Socket options for a relayed connection
+void configureSocket(int sock)
+{
+    setNonBlocking(sock);
+#ifdef SO_NOSIGPIPE
+    // A write after the peer closed must fail, not raise SIGPIPE
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+// Half-close: the peer reads EOF but may keep sending
+void shutdownSend(int sock)
+{
+#ifdef _WIN32
+    shutdown(sock, SD_SEND);
+#else
+    shutdown(sock, SHUT_WR);
+#endif
+}
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+void closeSocket(int sock)
+{
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+// Whether host is an IPv4 or IPv6 address, which needs no lookup
+bool isNumericHost(const std::string& host)
+{
+    unsigned char address[sizeof(struct in6_addr)];
+    return inet_pton(AF_INET, host.c_str(), address) == 1 || inet_pton(AF_INET6, host.c_str(), address) == 1;
+}
+
+// Numeric address and port of a connected socket's peer
+void peerAddress(int sock, std::string& address, int& port)
+{
+    struct sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    char host[INET6_ADDRSTRLEN] = "127.0.0.1";
+    port = 0;
+    if (getpeername(sock, reinterpret_cast<struct sockaddr*>(&peer), &length) == 0) {
+        if (peer.ss_family == AF_INET) {
+            auto* in = reinterpret_cast<struct sockaddr_in*>(&peer);
+            inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+            port = ntohs(in->sin_port);
+        } else if (peer.ss_family == AF_INET6) {
+            auto* in6 = reinterpret_cast<struct sockaddr_in6*>(&peer);
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            port = ntohs(in6->sin6_port);
+        }
+    }
+    address = host;
+}
+
+// Total length of the SOCKS5 greeting or request whose first bytes are `in`;
+// grows as the header reveals the variable-length parts
+std::size_t socksMessageLength(bool greeting, const std::vector<unsigned char>& in)
+{
+    if (greeting) {
+        return in.size() < 2 ? 2 : 2 + in[1];
+    }
+    if (in.size() < 5) {
+        return 5;
+    }
+    switch (in[3]) {
+        case SOCKS_ATYP_IPV4: return 4 + 4 + 2;
+        case SOCKS_ATYP_IPV6: return 4 + 16 + 2;
+        case SOCKS_ATYP_DOMAIN: return 4 + 1 + in[4] + 2;
+        default: return 5; // Refused once read
+    }
+}
+
+// Whether two settings for one listen port can keep the same listener
+bool sameListener(const TunnelConfig& a, const TunnelConfig& b)
+{
+    if (a.type != b.type) {
+        return false;
+    }
+    return a.listensLocally() ? a.localBindAddress == b.localBindAddress
+                              : a.remoteBindAddress == b.remoteBindAddress;
+}
+
+std::string describeTunnel(const TunnelConfig& tunnel)
+{
+    if (tunnel.type == TunnelType::Dynamic) {
+        return "dynamic " + tunnel.localBindAddress + ":" + std::to_string(tunnel.localPort) + " (SOCKS5)";
+    }
+    if (tunnel.type == TunnelType::Local) {
+        return "local " + tunnel.localBindAddress + ":" + std::to_string(tunnel.localPort) +
+               " -> " + tunnel.remoteHost + ":" + std::to_string(tunnel.remotePort);
+    }
+    return "remote " + tunnel.remoteBindAddress + ":" + std::to_string(tunnel.remotePort) +
+           " -> " + tunnel.localHost + ":" + std::to_string(tunnel.localPort);
+}
+
+} // namespace
+
+TunnelHandler::TunnelHandler(ssh_session session, const TunnelConfig& tunnel)
     : m_session(session)
-    , m_localPort(localPort)
-    , m_remotePort(remotePort)
+    , m_scratch(static_cast<std::size_t>(bufferProfileChunkSize(BufferProfile::Bulk)))
 {
+    addForward(tunnel);
 }
 
 TunnelHandler::~TunnelHandler()
@@ -38,6 +253,8 @@ void TunnelHandler::start()
         return; // Already running
     }
     m_stopRequested.store(false);
+    m_drainRequested.store(false);
+    m_running.store(true);
     m_thread = std::thread(&TunnelHandler::run, this);
 }
 
@@ -46,6 +263,15 @@ void TunnelHandler::stop()
     m_stopRequested.store(true);
 }
 
+void TunnelHandler::drain(std::chrono::milliseconds timeout)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_changesMutex);
+        m_drainTimeout = timeout;
+    }
+    m_drainRequested.store(true);
+}
+
 void TunnelHandler::join()
 {
     if (m_thread.joinable()) {
@@ -53,145 +279,1426 @@ void TunnelHandler::join()
     }
 }
 
-int TunnelHandler::connectToLocalPort()
+void TunnelHandler::addForward(const TunnelConfig& tunnel)
 {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        return -1;
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    m_pendingChanges.push_back({tunnel, false});
+    m_requested[tunnel.key()] = tunnel;
+}
+
+void TunnelHandler::removeForward(const TunnelKey& key)
+{
+    TunnelConfig tunnel;
+    tunnel.type = key.type;
+    if (tunnel.listensLocally()) {
+        tunnel.localPort = key.port;
+    } else {
+        tunnel.remotePort = key.port;
     }
 
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(m_localPort);
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    m_pendingChanges.push_back({tunnel, true});
+    m_requested.erase(key);
+}
 
-    if (::connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-#ifdef _WIN32
-        closesocket(sock);
-#else
-        close(sock);
-#endif
-        return -1;
+bool TunnelHandler::hasForwards() const
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    return !m_requested.empty();
+}
+
+bool TunnelHandler::hasForward(const TunnelKey& key) const
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    return m_requested.count(key) > 0;
+}
+
+bool TunnelHandler::isForwarding(const TunnelKey& key) const
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    return m_active.count(key) > 0;
+}
+
+std::vector<TunnelConfig> TunnelHandler::tunnels() const
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    std::vector<TunnelConfig> result;
+    for (const auto& entry : m_requested) {
+        result.push_back(entry.second);
     }
+    return result;
+}
 
-    return sock;
+void TunnelHandler::setRateLimit(const RateLimitConfig& limit)
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    m_rateLimit = limit;
+    m_rateLimitChanged = true;
 }
 
-void TunnelHandler::forwardData(ssh_channel channel, int localSocket)
+void TunnelHandler::setRekeyPolicy(const RekeyConfig& policy, Clock::time_point keyedAt)
 {
-    constexpr int BUFFER_SIZE = 32768;
-    char buffer[BUFFER_SIZE];
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    m_rekeyPolicy = policy;
+    m_rekeyKeyedAt = keyedAt;
+    m_rekeyPolicyChanged = true;
+}
 
-    // Set socket to non-blocking
-#ifdef _WIN32
-    u_long mode = 1;
-    ioctlsocket(localSocket, FIONBIO, &mode);
-#else
-    int flags = fcntl(localSocket, F_GETFL, 0);
-    fcntl(localSocket, F_SETFL, flags | O_NONBLOCK);
-#endif
+void TunnelHandler::setProbe(const ProbeConfig& probe)
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    m_probeConfig = probe;
+    m_probeChanged = true;
+}
 
-    while (!m_stopRequested.load() && ssh_channel_is_open(channel) && !ssh_channel_is_eof(channel)) {
-        // Channel -> Socket
-        int nbytes = ssh_channel_read_nonblocking(channel, buffer, BUFFER_SIZE, 0);
-        if (nbytes > 0) {
-            int total_sent = 0;
-            while (total_sent < nbytes) {
-                int sent = send(localSocket, buffer + total_sent, nbytes - total_sent, 0);
-                if (sent <= 0) break;
-                total_sent += sent;
-            }
-        } else if (nbytes == SSH_ERROR) {
-            break;
-        }
+void TunnelHandler::applyForwardChanges()
+{
+    std::vector<ForwardChange> changes;
+    bool rateLimitChanged = false;
+    RateLimitConfig rateLimit;
+    bool rekeyPolicyChanged = false;
+    RekeyConfig rekeyPolicy;
+    Clock::time_point rekeyKeyedAt;
+    bool probeChanged = false;
+    ProbeConfig probe;
+    {
+        std::lock_guard<std::mutex> lock(m_changesMutex);
+        changes.swap(m_pendingChanges);
+        rateLimitChanged = m_rateLimitChanged;
+        rateLimit = m_rateLimit;
+        m_rateLimitChanged = false;
+        rekeyPolicyChanged = m_rekeyPolicyChanged;
+        rekeyPolicy = m_rekeyPolicy;
+        rekeyKeyedAt = m_rekeyKeyedAt;
+        m_rekeyPolicyChanged = false;
+        probeChanged = m_probeChanged;
+        probe = m_probeConfig;
+        m_probeChanged = false;
+    }
 
-        // Socket -> Channel
-        int received = recv(localSocket, buffer, BUFFER_SIZE, 0);
-        if (received > 0) {
-            int written = ssh_channel_write(channel, buffer, received);
-            if (written < 0) break;
-        } else if (received == 0) {
-            // Connection closed
-            break;
-#ifdef _WIN32
-        } else if (WSAGetLastError() != WSAEWOULDBLOCK) {
-#else
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-#endif
-            break;
+    auto now = Clock::now();
+    if (rekeyPolicyChanged) {
+        m_rekeyMonitor.configure(rekeyPolicy, rekeyKeyedAt);
+    }
+    if (rateLimitChanged) {
+        m_globalToLocal.configure(rateLimit, now);
+        m_globalToRemote.configure(rateLimit, now);
+        logInfo("tunnel", rateLimit.bytesPerSecond > 0
+                ? "Rate limit for all tunnels: " + std::to_string(rateLimit.bytesPerSecond) + " bytes/s"
+                : std::string("Rate limit for all tunnels removed"));
+    }
+    if (probeChanged && !m_draining) {
+        configureProbe(probe);
+    }
+
+    for (const ForwardChange& change : changes) {
+        const TunnelConfig& tunnel = change.tunnel;
+        TunnelKey key = tunnel.key();
+        if (m_draining) {
+            // Nothing starts on a handler that is shutting down
+            std::lock_guard<std::mutex> lock(m_changesMutex);
+            m_requested.erase(key);
+            continue;
+        }
+        auto it = m_forwards.find(key);
+        if (change.remove) {
+            if (it != m_forwards.end()) {
+                closeForward(key);
+            }
+            continue;
         }
 
-        // Small sleep to avoid busy-waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+        if (it != m_forwards.end()) {
+            Forward& forward = *it->second;
+            if (sameListener(forward.config, tunnel)) {
+                // Same listener: new connections see the new target, open
+                // ones the new limits
+                if (!(forward.config.rateLimit == tunnel.rateLimit)) {
+                    forward.toLocalBucket.configure(tunnel.rateLimit, now);
+                    forward.toRemoteBucket.configure(tunnel.rateLimit, now);
+                }
+                forward.config = tunnel;
+                logInfo("tunnel", "Tunnel updated: " + describeTunnel(tunnel));
+                continue;
+            }
+            closeForward(key);
+        }
 
-    // Cleanup
-    ssh_channel_send_eof(channel);
-    ssh_channel_close(channel);
-    ssh_channel_free(channel);
+        auto forward = std::make_shared<Forward>();
+        forward->config = tunnel;
+        std::string error;
+        if (!openForward(*forward, error)) {
+            {
+                std::lock_guard<std::mutex> lock(m_changesMutex);
+                m_requested.erase(key);
+            }
+            if (m_errorCallback) {
+                m_errorCallback(error);
+            }
+            continue;
+        }
+        forward->metrics = MetricsRegistry::instance().tunnel(tunnelKeyName(key));
+        forward->toLocalBucket.configure(tunnel.rateLimit, now);
+        forward->toRemoteBucket.configure(tunnel.rateLimit, now);
+        m_forwards[key] = forward;
+        {
+            std::lock_guard<std::mutex> lock(m_changesMutex);
+            m_active.insert(key);
+        }
 
-#ifdef _WIN32
-    closesocket(localSocket);
-#else
-    close(localSocket);
-#endif
+        if (m_startedCallback) {
+            m_startedCallback(key);
+        }
+        logInfo("tunnel", "Tunnel started: " + describeTunnel(tunnel));
+    }
 }
 
-void TunnelHandler::run()
+bool TunnelHandler::openForward(Forward& forward, std::string& error)
 {
-    m_running.store(true);
+    const TunnelConfig& tunnel = forward.config;
+    if (tunnel.listensLocally()) {
+        forward.listenSocket = listenLocal(tunnel.localBindAddress, tunnel.localPort);
+        if (forward.listenSocket < 0) {
+            error = "Failed to listen on " + tunnel.localBindAddress + ":" + std::to_string(tunnel.localPort);
+            return false;
+        }
+        return true;
+    }
 
     // Request remote port forwarding
-    int rc = ssh_channel_listen_forward(m_session, "127.0.0.1", m_remotePort, nullptr);
+    awaitKeepaliveAnswer();
+    auto requestedAt = Clock::now();
+    int rc = ssh_channel_listen_forward(m_session, tunnel.remoteBindAddress.c_str(), tunnel.remotePort, nullptr);
     if (rc != SSH_OK) {
-        std::string error = "Failed to request port forward: " + std::string(ssh_get_error(m_session));
-        if (m_errorCallback) {
-            m_errorCallback(error);
-        }
-        m_running.store(false);
+        error = "Failed to request port forward: " + std::string(ssh_get_error(m_session));
+        return false;
+    }
+    MetricsRegistry::instance().session().connectPhase(ConnectPhase::ForwardSetup).record(Clock::now() - requestedAt);
+    return true;
+}
+
+void TunnelHandler::closeForward(TunnelKey key)
+{
+    auto it = m_forwards.find(key);
+    if (it == m_forwards.end()) {
         return;
     }
 
-    if (m_startedCallback) {
-        m_startedCallback(m_remotePort);
+    // Stop accepting; open connections keep the Forward alive
+    Forward& forward = *it->second;
+    if (forward.config.listensLocally()) {
+        closeSocket(forward.listenSocket);
+        forward.listenSocket = -1;
+    } else {
+        awaitKeepaliveAnswer();
+        ssh_channel_cancel_forward(m_session, forward.config.remoteBindAddress.c_str(), forward.config.remotePort);
+    }
+    rejectQueued(forward);
+    std::string description = describeTunnel(forward.config);
+    m_forwards.erase(it);
+    {
+        std::lock_guard<std::mutex> lock(m_changesMutex);
+        m_active.erase(key);
     }
-    std::cout << "Reverse tunnel started: remote:" << m_remotePort << " -> local:" << m_localPort << std::endl;
 
-    // Accept loop
-    while (!m_stopRequested.load()) {
+    if (m_stoppedCallback) {
+        m_stoppedCallback(key);
+    }
+    logInfo("tunnel", "Tunnel stopped: " + description);
+}
+
+bool TunnelHandler::hasLocalForwards() const
+{
+    for (const auto& entry : m_forwards) {
+        if (entry.second->listenSocket >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<TunnelHandler::Forward> TunnelHandler::routeChannel(int destinationPort)
+{
+    if (m_probe.forward && m_probe.forward->config.remotePort == destinationPort) {
+        return m_probe.forward;
+    }
+    auto it = m_forwards.find({TunnelType::Remote, destinationPort});
+    if (it != m_forwards.end()) {
+        return it->second;
+    }
+    // Servers that do not report the bound port: unambiguous with one
+    // reverse forward, counting the probe's
+    std::shared_ptr<Forward> only = m_probe.forward;
+    for (const auto& entry : m_forwards) {
+        if (entry.second->config.type != TunnelType::Remote) {
+            continue;
+        }
+        if (only) {
+            return nullptr;
+        }
+        only = entry.second;
+    }
+    return only;
+}
+
+int TunnelHandler::listenLocal(const std::string& address, int port)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_PASSIVE;
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+
+    int sock = -1;
+    for (struct addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        sock = static_cast<int>(socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+        if (sock < 0) {
+            continue;
+        }
+#ifndef _WIN32
+        // Rebind at once after a restart; on Windows this would allow port theft
+        int reuse = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+        if (bind(sock, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) == 0 && listen(sock, SOMAXCONN) == 0) {
+            break;
+        }
+        closeSocket(sock);
+        sock = -1;
+    }
+    freeaddrinfo(result);
+
+    if (sock >= 0) {
+        setNonBlocking(sock);
+    }
+    return sock;
+}
+
+void TunnelHandler::acceptChannels(int timeoutMs)
+{
+    for (int accepted = 0; accepted < MAX_ACCEPTS_PER_PASS; ++accepted) {
+        int destinationPort = 0;
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-        ssh_channel channel = ssh_channel_accept_forward(m_session, 1000, nullptr);
+        ssh_channel channel = ssh_channel_accept_forward(m_session, accepted == 0 ? timeoutMs : 0, &destinationPort);
 #pragma GCC diagnostic pop
         if (channel == nullptr) {
-            // Timeout or no connection, check if we should continue
-            if (m_stopRequested.load()) break;
-            continue;
+            return;
         }
+        auto acceptedAt = Clock::now();
 
-        // Connect to local port
-        int localSocket = connectToLocalPort();
-        if (localSocket < 0) {
-            std::cerr << "Failed to connect to local port " << m_localPort << std::endl;
+        std::shared_ptr<Forward> forward = routeChannel(destinationPort);
+        if (!forward) {
+            // Forward was cancelled after the server queued this connection
             ssh_channel_close(channel);
             ssh_channel_free(channel);
             continue;
         }
 
-        // Forward data in the current thread (sequential handling)
-        // For production, consider spawning a new thread per connection
-        forwardData(channel, localSocket);
+        Accepted entry;
+        entry.channel = channel;
+        entry.acceptedAt = acceptedAt;
+        admit(forward, entry);
     }
+}
 
-    // Cancel port forwarding
-    ssh_channel_cancel_forward(m_session, "127.0.0.1", m_remotePort);
+void TunnelHandler::acceptLocal()
+{
+    for (const auto& item : m_forwards) {
+        const std::shared_ptr<Forward>& forward = item.second;
+        if (forward->listenSocket < 0) {
+            continue;
+        }
+        for (int accepted = 0; accepted < MAX_ACCEPTS_PER_PASS; ++accepted) {
+            int sock = static_cast<int>(::accept(forward->listenSocket, nullptr, nullptr));
+            if (sock < 0) {
+                break; // Nothing waiting
+            }
+            Accepted entry;
+            entry.socket = sock;
+            entry.acceptedAt = Clock::now();
+            admit(forward, entry);
+        }
+    }
+}
 
-    m_running.store(false);
-    if (m_stoppedCallback) {
-        m_stoppedCallback(m_remotePort);
+void TunnelHandler::admit(const std::shared_ptr<Forward>& forward, const Accepted& accepted)
+{
+    // Admission control: over the limit, wait for a slot or give up
+    int limit = forward->config.maxConnections;
+    if (limit > 0 && (forward->openConnections >= limit || !forward->queue.empty())) {
+        if (forward->queue.size() >= MAX_QUEUED_PER_TUNNEL) {
+            reject(*forward, accepted, "queue full");
+            return;
+        }
+        forward->queue.push_back(accepted);
+        forward->metrics->queuedConnections.increment();
+        return;
+    }
+    openConnection(forward, accepted);
+}
+
+void TunnelHandler::admitQueued()
+{
+    auto now = Clock::now();
+    for (auto& entry : m_forwards) {
+        Forward& forward = *entry.second;
+        while (!forward.queue.empty()) {
+            Accepted queued = forward.queue.front();
+            int limit = forward.config.maxConnections;
+            bool slotFree = limit <= 0 || forward.openConnections < limit;
+            if (!slotFree && now - queued.acceptedAt < ADMISSION_TIMEOUT) {
+                break;
+            }
+
+            forward.queue.pop_front();
+            forward.metrics->queuedConnections.decrement();
+            if (slotFree) {
+                forward.metrics->admissionWait.record(now - queued.acceptedAt);
+                openConnection(entry.second, queued);
+            } else {
+                reject(forward, queued, "timed out waiting for a slot");
+            }
+        }
+    }
+}
+
+void TunnelHandler::rejectQueued(Forward& forward)
+{
+    while (!forward.queue.empty()) {
+        reject(forward, forward.queue.front(), "tunnel stopped");
+        forward.queue.pop_front();
+        forward.metrics->queuedConnections.decrement();
+    }
+}
+
+void TunnelHandler::reject(Forward& forward, const Accepted& accepted, const std::string& reason)
+{
+    // A plain close: the peer sees the connection end without data
+    if (accepted.channel != nullptr) {
+        ssh_channel_close(accepted.channel);
+        ssh_channel_free(accepted.channel);
+    }
+    if (accepted.socket >= 0) {
+        closeSocket(accepted.socket);
+    }
+    forward.metrics->rejectedConnections.add();
+    Logger::instance().log(m_rejectLog, LogLevel::Warning, "tunnel",
+                          "Rejected connection on " + std::string(tunnelTypeToString(forward.config.type)) + ":" +
+                          std::to_string(forward.config.listenPort()) +
+                          " (limit " + std::to_string(forward.config.maxConnections) + "): " + reason);
+}
+
+void TunnelHandler::openConnection(const std::shared_ptr<Forward>& forward, const Accepted& accepted)
+{
+    const TunnelConfig& tunnel = forward->config;
+    TunnelMetrics& metrics = *forward->metrics;
+
+    Connection conn;
+    conn.forward = forward;
+    conn.trace = TraceLog::instance().begin(tunnel.listenPort(), tunnel.type, accepted.acceptedAt);
+    if (tunnel.listensLocally()) {
+        conn.socket = accepted.socket;
+        peerAddress(accepted.socket, conn.originAddress, conn.originPort);
+        configureSocket(conn.socket);
+        if (tunnel.type == TunnelType::Dynamic) {
+            conn.socks = SocksStage::Greeting; // Destination comes from the client
+        } else {
+            conn.targetHost = tunnel.remoteHost;
+            conn.targetPort = tunnel.remotePort;
+            startOpen(conn);
+        }
+    } else {
+        // Connect to the tunnel's target; completes over the following
+        // passes (see continueConnect)
+        conn.channel = accepted.channel;
+        conn.targetHost = tunnel.localHost;
+        conn.targetPort = tunnel.localPort;
+        conn.mark(TracePoint::ConnectStarted, Clock::now());
+        if (isNumericHost(conn.targetHost)) {
+            startConnect(conn, conn.targetHost);
+        } else {
+            conn.connect = ConnectStage::Resolving;
+            resolveTarget(conn, true);
+        }
+    }
+
+    conn.bufferSize = static_cast<std::size_t>(bufferProfileChunkSize(tunnel.bufferProfile));
+    conn.acceptedAt = accepted.acceptedAt;
+    m_connections.push_back(std::move(conn));
+
+    ++forward->openConnections;
+    metrics.connectionsTotal.add();
+    metrics.activeConnections.increment();
+    metrics.interactiveConnections.increment(); // Until its transfers say otherwise
+}
+
+bool TunnelHandler::prepareConnection(Connection& conn)
+{
+    bool progress = false;
+    if (conn.toLocalPending()) {
+        progress |= flushToLocal(conn); // SOCKS replies
+    }
+    if (conn.failed || conn.closing) {
+        return progress; // Refused; closes once the reply is out
+    }
+    if (conn.connect != ConnectStage::None) {
+        progress |= continueConnect(conn);
+    }
+    if (conn.socks != SocksStage::None) {
+        progress |= negotiateSocks(conn);
+    }
+    if (conn.socks == SocksStage::None && conn.opening && !conn.failed && !conn.closing) {
+        progress |= continueOpen(conn);
+    }
+    return progress;
+}
+
+bool TunnelHandler::negotiateSocks(Connection& conn)
+{
+    bool progress = false;
+    bool requested = false;
+
+    // Read exactly one message at a time, so bytes the client sends after
+    // its request stay in the socket until the channel can take them
+    while (conn.socks == SocksStage::Greeting || conn.socks == SocksStage::Request) {
+        bool greeting = conn.socks == SocksStage::Greeting;
+        std::size_t needed = socksMessageLength(greeting, conn.socksInput);
+        if (conn.socksInput.size() < needed) {
+            unsigned char buffer[SOCKS_MAX_MESSAGE];
+            int received = recv(conn.socket, reinterpret_cast<char*>(buffer),
+                                static_cast<int>(needed - conn.socksInput.size()), 0);
+            if (received == 0) {
+                conn.localEof = true;
+                return true;
+            }
+            if (received < 0) {
+                if (!wouldBlock()) {
+                    conn.failed = true;
+                }
+                return progress;
+            }
+            conn.socksInput.insert(conn.socksInput.end(), buffer, buffer + received);
+            progress = true;
+            continue;
+        }
+
+        if (conn.socksInput[0] != SOCKS_VERSION) {
+            conn.failed = true; // Not SOCKS5; nothing sensible to answer
+            return true;
+        }
+        if (greeting) {
+            bool noAuth = std::find(conn.socksInput.begin() + 2, conn.socksInput.end(), SOCKS_NO_AUTH) !=
+                          conn.socksInput.end();
+            unsigned char reply[2] = {SOCKS_VERSION, noAuth ? SOCKS_NO_AUTH : SOCKS_NO_ACCEPTABLE_METHOD};
+            conn.toLocal.assign(reply, reply + sizeof(reply));
+            conn.toLocalIsReply = true;
+            flushToLocal(conn);
+            if (!noAuth) {
+                conn.closing = true;
+                return true;
+            }
+            conn.socks = SocksStage::Request;
+        } else {
+            handleSocksRequest(conn);
+            requested = true;
+            if (conn.closing) {
+                return true;
+            }
+        }
+        conn.socksInput.clear();
+    }
+
+    if (conn.socks == SocksStage::Resolving) {
+        TunnelMetrics& metrics = *conn.forward->metrics;
+        std::string address;
+        switch (m_dnsCache.lookup(conn.targetHost, address, Clock::now())) {
+            case DnsCache::Status::Started:
+                metrics.dnsLookups.add();
+                return true;
+            case DnsCache::Status::Pending:
+                return progress;
+            case DnsCache::Status::Failed:
+                if (requested) {
+                    metrics.dnsCacheHits.add();
+                }
+                socksReply(conn, SOCKS_REPLY_HOST_UNREACHABLE, true);
+                return true;
+            case DnsCache::Status::Resolved:
+                if (requested) {
+                    metrics.dnsCacheHits.add();
+                }
+                conn.targetHost = address;
+                startOpen(conn);
+                return true;
+        }
+    }
+    return progress;
+}
+
+void TunnelHandler::handleSocksRequest(Connection& conn)
+{
+    const std::vector<unsigned char>& in = conn.socksInput;
+    if (in[1] != SOCKS_CMD_CONNECT) {
+        socksReply(conn, SOCKS_REPLY_COMMAND_NOT_SUPPORTED, true);
+        return;
+    }
+
+    char numeric[INET6_ADDRSTRLEN] = "";
+    switch (in[3]) {
+        case SOCKS_ATYP_IPV4:
+            inet_ntop(AF_INET, &in[4], numeric, sizeof(numeric));
+            conn.targetHost = numeric;
+            break;
+        case SOCKS_ATYP_IPV6:
+            inet_ntop(AF_INET6, &in[4], numeric, sizeof(numeric));
+            conn.targetHost = numeric;
+            break;
+        case SOCKS_ATYP_DOMAIN:
+            conn.targetHost.assign(reinterpret_cast<const char*>(&in[5]), in[4]);
+            break;
+        default:
+            socksReply(conn, SOCKS_REPLY_ADDRESS_NOT_SUPPORTED, true);
+            return;
+    }
+    conn.targetPort = (in[in.size() - 2] << 8) | in[in.size() - 1];
+
+    // Hostnames normally go to the server as they are, like ssh -D
+    if (in[3] == SOCKS_ATYP_DOMAIN && conn.forward->config.resolveLocally) {
+        conn.socks = SocksStage::Resolving;
+        return;
+    }
+    startOpen(conn);
+}
+
+void TunnelHandler::socksReply(Connection& conn, unsigned char code, bool close)
+{
+    // The bound address is the server's business; zeros, as most proxies send
+    unsigned char reply[10] = {SOCKS_VERSION, code, 0x00, SOCKS_ATYP_IPV4, 0, 0, 0, 0, 0, 0};
+    conn.toLocal.assign(reply, reply + sizeof(reply));
+    conn.toLocalOffset = 0;
+    conn.toLocalIsReply = true;
+    flushToLocal(conn);
+    if (close) {
+        conn.closing = true;
+    }
+}
+
+void TunnelHandler::startOpen(Connection& conn)
+{
+    // The open completes over the following passes (see continueOpen)
+    conn.socks = SocksStage::None;
+    conn.opening = true;
+    conn.mark(TracePoint::ConnectStarted, Clock::now());
+    conn.channel = ssh_channel_new(m_session);
+    if (conn.channel == nullptr) {
+        failOpen(conn, SOCKS_REPLY_GENERAL_FAILURE);
+    }
+}
+
+bool TunnelHandler::continueOpen(Connection& conn)
+{
+    // Non-blocking for this call only, so waiting for the server's answer
+    // does not stall the other connections; later passes call again
+    ssh_set_blocking(m_session, 0);
+    int rc = ssh_channel_open_forward(conn.channel, conn.targetHost.c_str(), conn.targetPort,
+                                      conn.originAddress.c_str(), conn.originPort);
+    ssh_set_blocking(m_session, 1);
+
+    if (rc == SSH_AGAIN) {
+        return false;
+    }
+    if (rc != SSH_OK) {
+        failOpen(conn, SOCKS_REPLY_CONNECTION_REFUSED);
+        return true;
+    }
+    conn.opening = false;
+    conn.mark(TracePoint::ConnectFinished, Clock::now());
+    if (conn.forward->config.type == TunnelType::Dynamic) {
+        socksReply(conn, SOCKS_REPLY_SUCCEEDED, false);
+    }
+    return true;
+}
+
+void TunnelHandler::failOpen(Connection& conn, unsigned char socksCode)
+{
+    // Left marked as opening: the channel never opened, so no EOF is sent
+    conn.forward->metrics->channelOpenFailures.add();
+    Logger::instance().log(m_openFailureLog, LogLevel::Warning, "tunnel",
+                          "Failed to open channel to " + conn.targetHost + ":" + std::to_string(conn.targetPort) +
+                          ": " + std::string(ssh_get_error(m_session)));
+    if (conn.forward->config.type == TunnelType::Dynamic) {
+        socksReply(conn, socksCode, true);
+    } else {
+        conn.failed = true;
+    }
+}
+
+bool TunnelHandler::resolveTarget(Connection& conn, bool accepted)
+{
+    TunnelMetrics& metrics = *conn.forward->metrics;
+    std::string address;
+    switch (m_dnsCache.lookup(conn.targetHost, address, Clock::now())) {
+        case DnsCache::Status::Started:
+            metrics.dnsLookups.add();
+            return true;
+        case DnsCache::Status::Pending:
+            return false;
+        case DnsCache::Status::Failed:
+            if (accepted) {
+                metrics.dnsCacheHits.add();
+            }
+            failConnect(conn);
+            return true;
+        case DnsCache::Status::Resolved:
+            if (accepted) {
+                metrics.dnsCacheHits.add();
+            }
+            startConnect(conn, address);
+            return true;
+    }
+    return false;
+}
+
+void TunnelHandler::startConnect(Connection& conn, const std::string& address)
+{
+    // Numeric, so this getaddrinfo does not wait on a resolver
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(address.c_str(), std::to_string(conn.targetPort).c_str(), &hints, &result) != 0) {
+        failConnect(conn);
+        return;
+    }
+
+    int rc = -1;
+    bool inProgress = false;
+    conn.socket = static_cast<int>(socket(result->ai_family, result->ai_socktype, result->ai_protocol));
+    if (conn.socket >= 0) {
+        configureSocket(conn.socket);
+        rc = ::connect(conn.socket, result->ai_addr, static_cast<int>(result->ai_addrlen));
+        inProgress = rc != 0 && connectInProgress();
+    }
+    freeaddrinfo(result);
+
+    if (rc == 0) {
+        conn.connect = ConnectStage::None;
+        conn.mark(TracePoint::ConnectFinished, Clock::now());
+    } else if (inProgress) {
+        conn.connect = ConnectStage::Connecting;
+    } else {
+        failConnect(conn);
+    }
+}
+
+bool TunnelHandler::continueConnect(Connection& conn)
+{
+    if (conn.connect == ConnectStage::Resolving) {
+        return resolveTarget(conn, false);
+    }
+
+    // The socket turns writable when the connect is done, either way
+    PollFd pfd{};
+    pfd.fd = conn.socket;
+    pfd.events = POLLOUT;
+    if (pollSockets(&pfd, 1, 0) <= 0) {
+        return false;
+    }
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(conn.socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0 || error != 0) {
+        failConnect(conn);
+        return true;
+    }
+    conn.connect = ConnectStage::None;
+    conn.mark(TracePoint::ConnectFinished, Clock::now());
+    return true;
+}
+
+void TunnelHandler::failConnect(Connection& conn)
+{
+    // Left in its connect stage: the target never answered, so no EOF is sent
+    conn.forward->metrics->localConnectFailures.add();
+    Logger::instance().log(m_connectFailureLog, LogLevel::Warning, "tunnel",
+                          "Failed to connect to " + conn.targetHost + ":" + std::to_string(conn.targetPort));
+    conn.failed = true;
+}
+
+void TunnelHandler::noteFirstByte(Connection& conn)
+{
+    if (!conn.firstByteSeen) {
+        conn.firstByteSeen = true;
+        conn.forward->metrics->firstByteLatency.record(Clock::now() - conn.acceptedAt);
+    }
+}
+
+std::size_t TunnelHandler::grant(TokenBucket& tunnelBucket, TokenBucket& globalBucket, std::size_t wanted,
+                                 Clock::time_point now, Clock::time_point& wakeAt)
+{
+    std::size_t allowed = std::min({wanted, tunnelBucket.available(now), globalBucket.available(now)});
+    if (allowed == wanted) {
+        return allowed;
+    }
+
+    // Hold out for a useful amount instead of trickling single bytes
+    std::size_t minimum = std::min(wanted, MIN_THROTTLED_GRANT);
+    if (allowed >= minimum) {
+        return allowed;
+    }
+    wakeAt = std::min({wakeAt, tunnelBucket.readyAt(minimum, now), globalBucket.readyAt(minimum, now)});
+    return 0;
+}
+
+bool TunnelHandler::flushToLocal(Connection& conn)
+{
+    std::size_t remaining = conn.toLocal.size() - conn.toLocalOffset;
+    int sent = send(conn.socket, conn.toLocal.data() + conn.toLocalOffset, static_cast<int>(remaining), SEND_FLAGS);
+    if (sent < 0) {
+        if (!wouldBlock()) {
+            conn.failed = true;
+        }
+        return false;
+    }
+    conn.toLocalOffset += static_cast<std::size_t>(sent);
+    if (!conn.toLocalIsReply) {
+        conn.forward->metrics->bytesToLocal.add(static_cast<std::uint64_t>(sent));
+    }
+    if (!conn.toLocalPending()) {
+        conn.toLocal.clear();
+        conn.toLocalOffset = 0;
+        conn.toLocalIsReply = false;
+    }
+    return sent > 0;
+}
+
+bool TunnelHandler::serviceConnection(Connection& conn, Clock::time_point& wakeAt)
+{
+    Forward& forward = *conn.forward;
+    TunnelMetrics& metrics = *forward.metrics;
+    auto now = Clock::now();
+    bool progress = false;
+
+    // Channel -> Socket. Nothing more is read while the socket is backed up,
+    // which leaves the channel window to slow the sender down.
+    if (conn.toLocalPending()) {
+        progress |= flushToLocal(conn);
+    }
+    if (!conn.failed && !conn.toLocalPending() && !conn.channelEof && conn.deficit > 0) {
+        std::size_t wanted = std::min(conn.bufferSize, conn.deficit);
+        std::size_t allowed = grant(forward.toLocalBucket, m_globalToLocal, wanted, now, wakeAt);
+        if (allowed == 0) {
+            if (!conn.toLocalThrottled) {
+                metrics.throttledWaits.add();
+            }
+            conn.toLocalThrottled = true;
+        } else {
+            conn.toLocalThrottled = false;
+            int nbytes = ssh_channel_read_nonblocking(conn.channel, m_scratch.data(), static_cast<uint32_t>(allowed), 0);
+            if (nbytes > 0) {
+                if (forward.config.listensLocally()) {
+                    noteFirstByte(conn);
+                }
+                forward.toLocalBucket.consume(static_cast<std::size_t>(nbytes));
+                m_globalToLocal.consume(static_cast<std::size_t>(nbytes));
+                recordTransfer(conn, static_cast<std::size_t>(nbytes));
+                conn.mark(TracePoint::FirstByteToLocal, now);
+                m_rekeyMonitor.recordInbound(static_cast<std::size_t>(nbytes), now);
+                conn.toLocal.assign(m_scratch.data(), m_scratch.data() + nbytes);
+                flushToLocal(conn);
+                progress = true;
+            } else if (nbytes == SSH_EOF || (nbytes == 0 && ssh_channel_is_eof(conn.channel))) {
+                conn.channelEof = true;
+                conn.mark(TracePoint::EofFromRemote, now);
+                progress = true;
+            } else if (nbytes == SSH_ERROR) {
+                conn.failed = true;
+            }
+        }
+    }
+
+    // Socket -> Channel. Reads are sized to the remote window, so the write
+    // below never waits for a window adjust.
+    if (!conn.failed && !conn.localEof && conn.deficit > 0) {
+        uint32_t window = ssh_channel_window_size(conn.channel);
+        if (window == 0) {
+            if (!conn.windowStalled) {
+                metrics.channelWriteStalls.add();
+            }
+            conn.windowStalled = true;
+        } else {
+            conn.windowStalled = false;
+            std::size_t wanted = std::min({conn.bufferSize, conn.deficit, static_cast<std::size_t>(window)});
+            std::size_t allowed = grant(forward.toRemoteBucket, m_globalToRemote, wanted, now, wakeAt);
+            if (allowed == 0) {
+                if (!conn.toRemoteThrottled) {
+                    metrics.throttledWaits.add();
+                }
+                conn.toRemoteThrottled = true;
+            } else {
+                conn.toRemoteThrottled = false;
+                int received = recv(conn.socket, m_scratch.data(), static_cast<int>(allowed), 0);
+                if (received > 0) {
+                    if (forward.config.type == TunnelType::Remote) {
+                        noteFirstByte(conn);
+                    }
+                    forward.toRemoteBucket.consume(static_cast<std::size_t>(received));
+                    m_globalToRemote.consume(static_cast<std::size_t>(received));
+                    recordTransfer(conn, static_cast<std::size_t>(received));
+                    conn.mark(TracePoint::FirstByteToRemote, now);
+                    int written = ssh_channel_write(conn.channel, m_scratch.data(), static_cast<uint32_t>(received));
+                    if (written < 0) {
+                        conn.failed = true;
+                    } else {
+                        metrics.bytesToRemote.add(static_cast<std::uint64_t>(written));
+                        m_rekeyMonitor.recordOutbound(static_cast<std::size_t>(written), now);
+                    }
+                    progress = true;
+                } else if (received == 0) {
+                    // Local side is done sending; it may still read
+                    conn.localEof = true;
+                    conn.mark(TracePoint::EofFromLocal, now);
+                    if (ssh_channel_send_eof(conn.channel) != SSH_OK) {
+                        conn.failed = true;
+                    }
+                    progress = true;
+                } else if (!wouldBlock()) {
+                    conn.failed = true;
+                }
+            }
+        }
+    }
+
+    // Channel EOF reaches the local side once everything before it has
+    if (conn.channelEof && !conn.localShutdown && !conn.toLocalPending() && !conn.failed) {
+        shutdownSend(conn.socket);
+        conn.localShutdown = true;
+        progress = true;
+    }
+    // A channel the server closed takes no more data either
+    if (conn.channelEof && !conn.localEof && !conn.closing && ssh_channel_is_closed(conn.channel)) {
+        conn.closing = true;
+        progress = true;
+    }
+
+    return progress;
+}
+
+void TunnelHandler::recordTransfer(Connection& conn, std::size_t bytes)
+{
+    conn.deficit -= std::min(conn.deficit, bytes);
+    conn.movedThisPass = true;
+    conn.averageTransfer += TRANSFER_AVERAGE_WEIGHT * (static_cast<double>(bytes) - conn.averageTransfer);
+
+    bool interactive = conn.averageTransfer <= INTERACTIVE_MAX_AVERAGE;
+    if (interactive != conn.interactive) {
+        conn.interactive = interactive;
+        if (interactive) {
+            conn.forward->metrics->interactiveConnections.increment();
+        } else {
+            conn.forward->metrics->interactiveConnections.decrement();
+        }
+    }
+}
+
+bool TunnelHandler::servicePass(Clock::time_point& wakeAt)
+{
+    int maxPriority = TunnelLimits::PRIORITY_MIN;
+    for (const Connection& conn : m_connections) {
+        maxPriority = std::max(maxPriority, conn.forward->config.priority);
+    }
+
+    // Interactive flows first, so their small writes are not queued on the
+    // session behind bulk chunks; the rest in rotating order
+    std::vector<std::list<Connection>::iterator> order;
+    order.reserve(m_connections.size());
+    for (auto it = m_connections.begin(); it != m_connections.end(); ++it) {
+        order.push_back(it);
+    }
+    std::stable_partition(order.begin(), order.end(), [](std::list<Connection>::iterator it) {
+        return it->interactive;
+    });
+
+    bool progress = false;
+    for (auto it : order) {
+        Connection& conn = *it;
+        if (!conn.relaying()) {
+            // SOCKS negotiation, then the channel open
+            progress |= prepareConnection(conn);
+        }
+
+        if (conn.relaying()) {
+            // Deficit round robin, weighted by tunnel priority. An unused
+            // deficit is capped at one chunk so an idle flow cannot save up.
+            std::size_t quantum = conn.bufferSize * static_cast<std::size_t>(conn.forward->config.priority) /
+                                  static_cast<std::size_t>(maxPriority);
+            conn.deficit = std::min(conn.deficit + std::max(quantum, MIN_QUANTUM), conn.bufferSize);
+            conn.movedThisPass = false;
+
+            progress |= serviceConnection(conn, wakeAt);
+            if (!conn.movedThisPass) {
+                conn.deficit = 0; // Nothing to send: not backlogged
+            }
+        }
+
+        if (conn.finished()) {
+            if (m_draining) {
+                ++m_drainedConnections;
+                conn.forward->metrics->drainedConnections.add();
+            }
+            closeConnection(conn);
+            m_connections.erase(it);
+            progress = true;
+        }
+    }
+
+    // Start the next pass with the next connection
+    if (m_connections.size() > 1) {
+        m_connections.splice(m_connections.end(), m_connections, m_connections.begin());
+    }
+    return progress;
+}
+
+bool TunnelHandler::Connection::finished() const
+{
+    if (failed) {
+        return true;
+    }
+    if (closing) {
+        return !toLocalPending();
+    }
+    if (!relaying()) {
+        return localEof; // Client left during the handshake or the open
+    }
+    return localEof && localShutdown;
+}
+
+void TunnelHandler::closeConnection(Connection& conn)
+{
+    if (conn.channel != nullptr) {
+        if (!conn.opening && conn.connect == ConnectStage::None && !conn.localEof) {
+            ssh_channel_send_eof(conn.channel);
+        }
+        ssh_channel_close(conn.channel);
+        ssh_channel_free(conn.channel);
+    }
+    if (conn.socket >= 0) {
+        closeSocket(conn.socket);
+    }
+
+    --conn.forward->openConnections;
+    TunnelMetrics& metrics = *conn.forward->metrics;
+    metrics.activeConnections.decrement();
+    if (conn.interactive) {
+        metrics.interactiveConnections.decrement();
+    }
+    metrics.connectionDuration.record(Clock::now() - conn.acceptedAt);
+
+    if (conn.trace) {
+        conn.trace->failed = conn.failed;
+        conn.trace->mark(TracePoint::Closed, Clock::now());
+        TraceLog::instance().finish(*conn.trace);
+    }
+}
+
+void TunnelHandler::waitForActivity(Clock::time_point wakeAt)
+{
+    // Data libssh has already buffered does not show on the session socket
+    for (const Connection& conn : m_connections) {
+        if (conn.relaying() && !conn.channelEof && !conn.toLocalPending() && !conn.toLocalThrottled &&
+            ssh_channel_poll(conn.channel, 0) != 0) {
+            return;
+        }
+    }
+    std::vector<PollFd> fds;
+    fds.reserve(m_connections.size() + m_forwards.size() + 1);
+
+    int sessionSocket = static_cast<int>(ssh_get_fd(m_session));
+    if (sessionSocket >= 0) {
+        PollFd pfd{};
+        pfd.fd = sessionSocket;
+        pfd.events = POLLIN;
+        fds.push_back(pfd);
+    }
+    for (const auto& entry : m_forwards) {
+        if (entry.second->listenSocket >= 0) {
+            PollFd pfd{};
+            pfd.fd = entry.second->listenSocket;
+            pfd.events = POLLIN;
+            fds.push_back(pfd);
+        }
+    }
+    for (const Connection& conn : m_connections) {
+        PollFd pfd{};
+        pfd.fd = conn.socket;
+        if (conn.toLocalPending() || conn.connect == ConnectStage::Connecting) {
+            pfd.events |= POLLOUT;
+        }
+        bool wantsInput = conn.relaying()
+            ? !conn.windowStalled && !conn.toRemoteThrottled
+            : (conn.socks == SocksStage::Greeting || conn.socks == SocksStage::Request) && !conn.closing;
+        if (!conn.localEof && wantsInput) {
+            pfd.events |= POLLIN;
+        }
+        if (pfd.events != 0) {
+            fds.push_back(pfd);
+        }
+    }
+
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - Clock::now()).count();
+    int timeoutMs = static_cast<int>(std::max<long long>(0, remaining));
+    if (sessionSocket < 0) {
+        // Cannot see channel data arrive; fall back to a short sleep
+        timeoutMs = std::min(timeoutMs, 1);
+    }
+    if (fds.empty()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return;
+    }
+    pollSockets(fds.data(), fds.size(), timeoutMs);
+}
+
+void TunnelHandler::run()
+{
+    applyForwardChanges();
+    if (m_forwards.empty()) {
+        // The initial forward was refused (already reported via the error callback)
+        m_running.store(false);
+        return;
+    }
+
+    auto lastKeepalive = Clock::now();
+    const auto keepaliveInterval = std::chrono::seconds(ServerConfig::KEEPALIVE_INTERVAL);
+
+    // Event loop
+    while (!m_stopRequested.load()) {
+        if (m_drainRequested.load() && !m_draining) {
+            beginDrain();
+        }
+        if (m_draining && (m_connections.empty() || Clock::now() >= m_drainDeadline)) {
+            break;
+        }
+
+        applyForwardChanges();
+
+        // This thread drives the session, so keepalives are sent from here
+        auto now = Clock::now();
+        if (now - lastKeepalive >= keepaliveInterval) {
+            lastKeepalive = now;
+            sendKeepalive(now);
+        }
+
+        // Time the round trip while the key exchange is under way: the next
+        // probe goes now unless one is already in flight
+        if (m_rekeyMonitor.poll(now) && m_probe.responder && m_probe.channel == nullptr) {
+            m_probe.nextAt = now;
+            m_probe.forRekey = true;
+        }
+
+        // The probe's channel is driven like an open connection while in flight
+        auto probeWakeAt = Clock::now() + std::chrono::milliseconds(ACTIVE_WAIT_MS);
+        bool probeProgress = serviceProbe(now, probeWakeAt);
+        bool probing = m_probe.channel != nullptr;
+
+        // Idle: block in accept, or in poll when local listeners need
+        // watching too. Busy: only pick up connections already waiting.
+        bool listening = hasLocalForwards();
+        acceptChannels(m_connections.empty() && !listening && !probing ? ACCEPT_TIMEOUT_MS : 0);
+        acceptLocal();
+        admitQueued();
+        if (m_connections.empty()) {
+            if (probing) {
+                if (!probeProgress) {
+                    waitForActivity(probeWakeAt);
+                }
+            } else if (listening) {
+                waitForActivity(Clock::now() + std::chrono::milliseconds(ACCEPT_TIMEOUT_MS));
+            }
+            continue;
+        }
+
+        auto wakeAt = std::min(Clock::now() + std::chrono::milliseconds(ACTIVE_WAIT_MS), probeWakeAt);
+        if (m_draining) {
+            wakeAt = std::min(wakeAt, m_drainDeadline);
+        }
+        bool progress = servicePass(wakeAt) || probeProgress;
+
+        if (!progress) {
+            waitForActivity(wakeAt);
+        }
+    }
+
+    // Whatever is still open is cut off mid-transfer
+    std::size_t aborted = m_connections.size();
+    for (Connection& conn : m_connections) {
+        conn.forward->metrics->abortedConnections.add();
+        closeConnection(conn);
+    }
+    m_connections.clear();
+
+    closeProbeChannel();
+    closeProbeForward();
+    while (!m_forwards.empty()) {
+        closeForward(m_forwards.begin()->first);
+    }
+    m_probe.responder.reset();
+    // The session may get another handler, whose first forward request must
+    // not be handed the answer to this one's keepalive
+    awaitKeepaliveAnswer();
+
+    if (m_draining && m_drainedConnections + aborted > 0) {
+        logInfo("tunnel", "Drain finished: " + std::to_string(m_drainedConnections) + " connections completed, " +
+                std::to_string(aborted) + " aborted");
+    } else if (aborted > 0) {
+        logInfo("tunnel", "Stopped with " + std::to_string(aborted) + " connections open");
+    }
+
+    m_running.store(false);
+}
+
+void TunnelHandler::beginDrain()
+{
+    std::chrono::milliseconds timeout;
+    {
+        std::lock_guard<std::mutex> lock(m_changesMutex);
+        timeout = m_drainTimeout;
+        m_requested.clear();
+    }
+    m_draining = true;
+    m_drainDeadline = Clock::now() + timeout;
+    closeProbeChannel(); // Not a connection to wait for
+    closeProbeForward();
+
+    // Listeners close, remote forwards are cancelled and queued connections
+    // rejected; the open ones keep their Forward alive
+    while (!m_forwards.empty()) {
+        closeForward(m_forwards.begin()->first);
+    }
+    if (!m_connections.empty()) {
+        logInfo("tunnel", "Draining " + std::to_string(m_connections.size()) + " connections for up to " +
+                std::to_string(timeout.count()) + " ms");
+    }
+}
+
+void TunnelHandler::sendKeepalive(Clock::time_point now)
+{
+    m_keepaliveSentAt = now;
+    bool failed = ssh_send_keepalive(m_session) != SSH_OK || !ssh_is_connected(m_session);
+    if (failed && !m_keepaliveFailed) {
+        logWarning("ssh", "Keepalive not sent: " + std::string(ssh_get_error(m_session)));
+    }
+    m_keepaliveFailed = failed;
+    updateResponsive();
+}
+
+void TunnelHandler::awaitKeepaliveAnswer()
+{
+    // Rare: forward requests are few and keepalives a minute apart
+    auto answeredBy = m_keepaliveSentAt + KEEPALIVE_ANSWER_WAIT;
+    if (Clock::now() < answeredBy) {
+        std::this_thread::sleep_until(answeredBy);
+    }
+}
+
+void TunnelHandler::updateResponsive()
+{
+    bool responsive = !m_keepaliveFailed && m_probe.failuresInARow < ServerConfig::KEEPALIVE_COUNT_MAX;
+    if (m_responsive.exchange(responsive) != responsive) {
+        if (responsive) {
+            logInfo("ssh", "Session responsive again");
+        } else {
+            logWarning("ssh", m_keepaliveFailed ? std::string("Session unresponsive: keepalives cannot be sent")
+                                                : "Session unresponsive: " +
+                                                  std::to_string(m_probe.failuresInARow) + " probes failed in a row");
+        }
+    }
+}
+
+void TunnelHandler::configureProbe(const ProbeConfig& config)
+{
+    // Take the old probe down completely, then start over
+    closeProbeChannel();
+    closeProbeForward();
+    if (m_probe.responder) {
+        m_probe.responder.reset();
+        if (!config.enabled) {
+            logInfo("probe", "End-to-end probe stopped");
+        }
+    }
+    m_probe.config = config;
+    if (!config.enabled) {
+        return;
+    }
+
+    auto responder = std::make_unique<EchoResponder>();
+    if (!responder->start()) {
+        return; // Reported by the responder
+    }
+    m_probe.responder = std::move(responder);
+    m_probe.nextAt = Clock::now();
+    logInfo("probe", "Probing relay port " + std::to_string(config.remotePort) + " every " +
+            std::to_string(static_cast<long long>(config.interval * 1000)) + " ms");
+}
+
+bool TunnelHandler::openProbeForward()
+{
+    // Bound lazily and retried every interval, so a port the relay still
+    // holds for an old session is picked up once released
+    if (m_probe.forward) {
+        return true;
+    }
+
+    auto forward = std::make_shared<Forward>();
+    forward->config.remoteBindAddress = PROBE_BIND_ADDRESS;
+    forward->config.remotePort = m_probe.config.remotePort;
+    forward->config.localHost = "127.0.0.1";
+    forward->config.localPort = m_probe.responder->port();
+    forward->config.bufferProfile = BufferProfile::Interactive;
+    std::string error;
+    if (!openForward(*forward, error)) {
+        MetricsRegistry::instance().session().probeFailures.add();
+        Logger::instance().log(m_probeFailureLog, LogLevel::Warning, "probe", "Probe forward not bound: " + error);
+        return false;
+    }
+    // Not registered: the probe's echo connections are not tunnel traffic
+    // and show only in the session's probe series
+    forward->metrics = std::make_shared<TunnelMetrics>();
+    m_probe.forward = forward;
+    logInfo("probe", "Probe forward started: " + describeTunnel(forward->config));
+    return true;
+}
+
+void TunnelHandler::closeProbeForward()
+{
+    if (!m_probe.forward) {
+        return;
+    }
+    // Echo connections already accepted keep the Forward alive
+    awaitKeepaliveAnswer();
+    ssh_channel_cancel_forward(m_session, PROBE_BIND_ADDRESS, m_probe.forward->config.remotePort);
+    logInfo("probe", "Probe forward stopped: " + describeTunnel(m_probe.forward->config));
+    m_probe.forward.reset();
+}
+
+bool TunnelHandler::serviceProbe(Clock::time_point now, Clock::time_point& wakeAt)
+{
+    if (!m_probe.responder || m_draining) {
+        return false;
+    }
+    SessionMetrics& metrics = MetricsRegistry::instance().session();
+
+    if (m_probe.channel == nullptr) {
+        if (now < m_probe.nextAt) {
+            return false;
+        }
+        m_probe.nextAt = now + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(m_probe.config.interval));
+        metrics.probes.add();
+        if (!openProbeForward()) {
+            m_probe.forRekey = false;
+            return false;
+        }
+        m_probe.channel = ssh_channel_new(m_session);
+        if (m_probe.channel == nullptr) {
+            failProbe("no channel");
+            return false;
+        }
+        m_probe.opening = true;
+        m_probe.startedAt = now;
+        m_probe.payload = "sshconn-probe " + std::to_string(++m_probe.sequence) + "\n";
+        m_probe.echoed.clear();
+    }
+
+    auto deadline = m_probe.startedAt + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(m_probe.config.timeout));
+    if (now >= deadline) {
+        failProbe(m_probe.opening ? "channel open timed out" : "echo timed out");
+        return true;
+    }
+    wakeAt = std::min(wakeAt, deadline);
+
+    if (m_probe.opening) {
+        // Completes over later passes, as for local forwards (see continueOpen)
+        ssh_set_blocking(m_session, 0);
+        int rc = ssh_channel_open_forward(m_probe.channel, PROBE_BIND_ADDRESS, m_probe.config.remotePort,
+                                          "127.0.0.1", 0);
+        ssh_set_blocking(m_session, 1);
+        if (rc == SSH_AGAIN) {
+            return false;
+        }
+        if (rc != SSH_OK) {
+            failProbe("channel open failed: " + std::string(ssh_get_error(m_session)));
+            return true;
+        }
+        m_probe.opening = false;
+        int length = static_cast<int>(m_probe.payload.size());
+        if (ssh_channel_write(m_probe.channel, m_probe.payload.data(), static_cast<uint32_t>(length)) != length) {
+            failProbe("write failed");
+        }
+        return true;
+    }
+
+    char buffer[64];
+    int received = ssh_channel_read_nonblocking(m_probe.channel, buffer, sizeof(buffer), 0);
+    if (received < 0 || (received == 0 && ssh_channel_is_eof(m_probe.channel))) {
+        failProbe("closed before the echo");
+        return true;
+    }
+    if (received == 0) {
+        return false;
+    }
+    m_probe.echoed.append(buffer, static_cast<std::size_t>(received));
+    if (m_probe.echoed.size() < m_probe.payload.size()) {
+        return true;
+    }
+    if (m_probe.echoed.compare(0, m_probe.payload.size(), m_probe.payload) != 0) {
+        failProbe("echo did not match");
+        return true;
+    }
+
+    auto elapsed = Clock::now() - m_probe.startedAt;
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    metrics.lastProbeLatencyMicros.store(static_cast<std::uint64_t>(micros), std::memory_order_relaxed);
+    metrics.probeLatency.record(elapsed);
+    if (m_probe.forRekey) {
+        m_rekeyMonitor.recordProbe(elapsed);
+    }
+    logDebug("probe", "Probe " + std::to_string(m_probe.sequence) + ": " + std::to_string(micros) + " us");
+    closeProbeChannel();
+    m_probe.failuresInARow = 0;
+    updateResponsive();
+    return true;
+}
+
+void TunnelHandler::failProbe(const std::string& reason)
+{
+    MetricsRegistry::instance().session().probeFailures.add();
+    Logger::instance().log(m_probeFailureLog, LogLevel::Warning, "probe",
+                          "Probe through relay port " + std::to_string(m_probe.config.remotePort) +
+                          " failed: " + reason);
+    closeProbeChannel();
+    ++m_probe.failuresInARow;
+    updateResponsive();
+}
+
+void TunnelHandler::closeProbeChannel()
+{
+    if (m_probe.channel == nullptr) {
+        return;
     }
-    std::cout << "Reverse tunnel stopped: remote:" << m_remotePort << std::endl;
+    ssh_channel_close(m_probe.channel);
+    ssh_channel_free(m_probe.channel);
+    m_probe.channel = nullptr;
+    m_probe.opening = false;
+    m_probe.forRekey = false;
 }
 
 } // namespace sshconn
@@ -1,43 +1,311 @@
 #ifndef TUNNEL_HANDLER_H
 #define TUNNEL_HANDLER_H
 
+#include "DnsCache.h"
+#include "EchoResponder.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "RekeyMonitor.h"
+#include "TokenBucket.h"
+#include "TraceLog.h"
+#include "../config/Config.h"
+
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <thread>
+#include <vector>
 #include <libssh/libssh.h>
 
 namespace sshconn {
 
+// Drives one SSH session's forwards from a single thread. Reverse forwards
+// accept forwarded channels and route each by its remote port to a local
+// target; local forwards accept on a local listener and open a direct-tcpip
+// channel per connection, and dynamic forwards do the same to whatever
+// destination each connection's SOCKS5 CONNECT request names. All kinds share
+// one relay loop that never blocks on one connection: sockets are
+// non-blocking, local connects and channel opens complete across passes,
+// channel writes are sized to the remote window, and a connection held
+// back by a rate limit is skipped until its tokens refill. Connections share
+// each pass by weighted deficit round robin on their tunnel's priority, with
+// interactive flows served first. Connections beyond a tunnel's
+// max_connections wait in a bounded queue. Forwards are keyed by listen port
+// and can be added, retargeted or removed while running; changes are applied
+// by the handler thread between passes. stop() closes everything at once;
+// drain() stops accepting first and gives open connections time to finish.
 class TunnelHandler {
 public:
     using ErrorCallback = std::function<void(const std::string&)>;
-    using StartedCallback = std::function<void(int)>;
-    using StoppedCallback = std::function<void(int)>;
+    using StartedCallback = std::function<void(const TunnelKey&)>;
+    using StoppedCallback = std::function<void(const TunnelKey&)>;
 
-    TunnelHandler(ssh_session session, int localPort, int remotePort);
+    TunnelHandler(ssh_session session, const TunnelConfig& tunnel);
     ~TunnelHandler();
 
     void start();
     void stop();
+    // Close all forwards, then let open connections finish for up to timeout
+    // before closing the rest and stopping; join() waits for it
+    void drain(std::chrono::milliseconds timeout);
     void join();
     bool isRunning() const { return m_running.load(); }
+    // False once a keepalive cannot be sent, or with the probe on, once
+    // KEEPALIVE_COUNT_MAX probes in a row have failed; true again when both
+    // recover
+    bool isResponsive() const { return m_responsive.load(); }
+
+    // Add a forward, or update the settings of an existing one (same type
+    // and listen port)
+    void addForward(const TunnelConfig& tunnel);
+    // Cancel a forward; connections already accepted on it are left to finish
+    void removeForward(const TunnelKey& key);
+    // True while any forward is requested (applied or pending)
+    bool hasForwards() const;
+    bool hasForward(const TunnelKey& key) const;
+    // True once the forward listens; false while pending, after it failed or
+    // after it was closed
+    bool isForwarding(const TunnelKey& key) const;
+    // The forwards requested, to recreate them on another session
+    std::vector<TunnelConfig> tunnels() const;
+
+    // Limit all forwards combined, per direction; takes effect on the next pass
+    void setRateLimit(const RateLimitConfig& limit);
+
+    // Rekey limits the session was opened with, to measure forwarding
+    // around each rekey; keyedAt is when its first key exchange finished,
+    // where the limits start counting
+    void setRekeyPolicy(const RekeyConfig& policy, std::chrono::steady_clock::time_point keyedAt);
+
+    // End-to-end probe: a reverse forward of probe.remotePort to a built-in
+    // echo responder, and a direct-tcpip channel to it through the relay
+    // every interval, timed from open to echo. Not one of tunnels().
+    void setProbe(const ProbeConfig& probe);
 
     void setErrorCallback(ErrorCallback cb) { m_errorCallback = std::move(cb); }
     void setStartedCallback(StartedCallback cb) { m_startedCallback = std::move(cb); }
     void setStoppedCallback(StoppedCallback cb) { m_stoppedCallback = std::move(cb); }
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    // Where a dynamic forward's connection is in the SOCKS5 exchange
+    enum class SocksStage {
+        None,      // Done, or not a SOCKS connection
+        Greeting,  // Waiting for the method list
+        Request,   // Waiting for the CONNECT request
+        Resolving  // Waiting for the DNS cache (resolve_locally)
+    };
+
+    // Where a reverse forward's connection is in the connect to its local
+    // target
+    enum class ConnectStage {
+        None,       // Connected, or not a reverse forward
+        Resolving,  // Waiting for the DNS cache
+        Connecting  // Waiting for the non-blocking connect
+    };
+
+    // An accepted connection not yet forwarded: a channel for reverse
+    // forwards, a local socket for the others
+    struct Accepted {
+        ssh_channel channel = nullptr;
+        int socket = -1;
+        Clock::time_point acceptedAt;
+    };
+
+    struct Forward {
+        TunnelConfig config;
+        std::shared_ptr<TunnelMetrics> metrics;
+        int listenSocket = -1; // Local forwards
+        // Shared by the forward's connections; per direction
+        TokenBucket toLocalBucket;
+        TokenBucket toRemoteBucket;
+        int openConnections = 0;
+        std::deque<Accepted> queue; // Waiting for a max_connections slot
+    };
+
+    // The probe's own forward and channel; one channel at a time. The
+    // forward is kept apart from m_forwards, so it never shares a key with
+    // a tunnel.
+    struct Probe {
+        ProbeConfig config;
+        std::unique_ptr<EchoResponder> responder; // While enabled
+        std::shared_ptr<Forward> forward;         // While bound
+        ssh_channel channel = nullptr;            // While in flight
+        bool opening = false;
+        Clock::time_point startedAt;
+        Clock::time_point nextAt;
+        std::uint64_t sequence = 0;
+        std::string payload;
+        std::string echoed;
+        bool forRekey = false;    // Started as a rekey began
+        int failuresInARow = 0;
+    };
+
+    struct ForwardChange {
+        TunnelConfig tunnel;
+        bool remove;
+    };
+
+    // One forwarded channel and its local socket
+    struct Connection {
+        ssh_channel channel = nullptr;
+        int socket = -1;
+        // Kept alive by the connection if its forward is removed meanwhile
+        std::shared_ptr<Forward> forward;
+        std::size_t bufferSize = 0;
+        Clock::time_point acceptedAt;
+        bool firstByteSeen = false;
+        std::unique_ptr<ConnectionTrace> trace; // While tracing is on
+
+        void mark(TracePoint point, Clock::time_point when)
+        {
+            if (trace) {
+                trace->mark(point, when);
+            }
+        }
+
+        // Local and dynamic forwards: the channel's destination, and whether
+        // its direct-tcpip open is still in progress
+        std::string targetHost;
+        int targetPort = 0;
+        bool opening = false;
+        std::string originAddress;
+        int originPort = 0;
+
+        // Dynamic forwards: SOCKS5 negotiation, ahead of the channel open
+        SocksStage socks = SocksStage::None;
+        std::vector<unsigned char> socksInput;
+
+        // Reverse forwards: the connect to the local target, which completes
+        // across passes like a channel open
+        ConnectStage connect = ConnectStage::None;
+
+        bool relaying() const { return socks == SocksStage::None && !opening && connect == ConnectStage::None; }
+        bool finished() const;
+
+        // Channel bytes the local socket did not take yet, or a SOCKS reply,
+        // which is not counted as forwarded
+        std::vector<char> toLocal;
+        std::size_t toLocalOffset = 0;
+        bool toLocalIsReply = false;
+
+        // Each direction ends on its own: channel EOF becomes a half-close of
+        // the socket once pending bytes are out, socket EOF a channel EOF.
+        // The connection closes when both have ended.
+        bool channelEof = false;
+        bool localEof = false;
+        bool localShutdown = false;
+        bool closing = false; // Ends once pending bytes are out, whatever the other direction
+        bool failed = false;
+
+        // Scheduling state (see servicePass)
+        std::size_t deficit = 0;
+        bool movedThisPass = false;
+        double averageTransfer = 0.0;
+        bool interactive = true;
+
+        // Reasons the connection was skipped in the last pass
+        bool toLocalThrottled = false;
+        bool toRemoteThrottled = false;
+        bool windowStalled = false;
+
+        bool toLocalPending() const { return toLocalOffset < toLocal.size(); }
+    };
+
     void run();
-    void forwardData(ssh_channel channel, int localSocket);
-    int connectToLocalPort();
+    void beginDrain();
+    void sendKeepalive(Clock::time_point now);
+    void awaitKeepaliveAnswer();
+    void updateResponsive();
+    void configureProbe(const ProbeConfig& config);
+    bool openProbeForward();
+    void closeProbeForward();
+    bool serviceProbe(Clock::time_point now, Clock::time_point& wakeAt);
+    void failProbe(const std::string& reason);
+    void closeProbeChannel();
+    void applyForwardChanges();
+    bool openForward(Forward& forward, std::string& error);
+    void closeForward(TunnelKey key); // By value: callers pass keys from m_forwards
+    bool hasLocalForwards() const;
+    std::shared_ptr<Forward> routeChannel(int destinationPort);
+    void acceptChannels(int timeoutMs);
+    void acceptLocal();
+    void admit(const std::shared_ptr<Forward>& forward, const Accepted& accepted);
+    void admitQueued();
+    void rejectQueued(Forward& forward);
+    void reject(Forward& forward, const Accepted& accepted, const std::string& reason);
+    void openConnection(const std::shared_ptr<Forward>& forward, const Accepted& accepted);
+    bool prepareConnection(Connection& conn);
+    bool negotiateSocks(Connection& conn);
+    void handleSocksRequest(Connection& conn);
+    void socksReply(Connection& conn, unsigned char code, bool close);
+    void startOpen(Connection& conn);
+    bool continueOpen(Connection& conn);
+    void failOpen(Connection& conn, unsigned char socksCode);
+    bool resolveTarget(Connection& conn, bool accepted);
+    void startConnect(Connection& conn, const std::string& address);
+    bool continueConnect(Connection& conn);
+    void failConnect(Connection& conn);
+    void noteFirstByte(Connection& conn);
+    bool servicePass(Clock::time_point& wakeAt);
+    bool serviceConnection(Connection& conn, Clock::time_point& wakeAt);
+    void recordTransfer(Connection& conn, std::size_t bytes);
+    bool flushToLocal(Connection& conn);
+    std::size_t grant(TokenBucket& tunnelBucket, TokenBucket& globalBucket, std::size_t wanted,
+                      Clock::time_point now, Clock::time_point& wakeAt);
+    void closeConnection(Connection& conn);
+    void waitForActivity(Clock::time_point wakeAt);
+    int listenLocal(const std::string& address, int port);
 
     ssh_session m_session;
-    int m_localPort;
-    int m_remotePort;
     std::atomic<bool> m_running{false};
     std::atomic<bool> m_stopRequested{false};
+    std::atomic<bool> m_drainRequested{false};
+    std::atomic<bool> m_responsive{true};
     std::thread m_thread;
+    LogRateLimiter m_connectFailureLog{5, std::chrono::seconds(60)};
+    LogRateLimiter m_rejectLog{5, std::chrono::seconds(60)};
+    LogRateLimiter m_openFailureLog{5, std::chrono::seconds(60)};
+    LogRateLimiter m_probeFailureLog{5, std::chrono::seconds(60)};
+
+    // Owned by the handler thread
+    std::map<TunnelKey, std::shared_ptr<Forward>> m_forwards;
+    std::list<Connection> m_connections;
+    TokenBucket m_globalToLocal;
+    TokenBucket m_globalToRemote;
+    std::vector<char> m_scratch;
+    DnsCache m_dnsCache;
+    RekeyMonitor m_rekeyMonitor;
+    Clock::time_point m_keepaliveSentAt{};
+    bool m_keepaliveFailed = false;
+    Probe m_probe;
+    bool m_draining = false;
+    Clock::time_point m_drainDeadline;
+    std::size_t m_drainedConnections = 0;
+
+    // Requested changes, queued for the handler thread
+    mutable std::mutex m_changesMutex;
+    std::vector<ForwardChange> m_pendingChanges;
+    std::map<TunnelKey, TunnelConfig> m_requested;
+    std::set<TunnelKey> m_active;
+    RateLimitConfig m_rateLimit;
+    bool m_rateLimitChanged = false;
+    RekeyConfig m_rekeyPolicy;
+    Clock::time_point m_rekeyKeyedAt;
+    bool m_rekeyPolicyChanged = false;
+    ProbeConfig m_probeConfig;
+    bool m_probeChanged = false;
+    std::chrono::milliseconds m_drainTimeout{0};
 
     ErrorCallback m_errorCallback;
     StartedCallback m_startedCallback;
@@ -1,11 +1,12 @@
 #include "ui/fltk/MainWindow.h"
 #include "config/ConfigManager.h"
+#include "config/PathResolver.h"
+#include "core/Logger.h"
 
 #include <FL/Fl.H>
 #include <FL/fl_ask.H>
 #include <libssh/libssh.h>
 #include <filesystem>
-#include <iostream>
 #include <sstream>
 
 #ifdef _WIN32
@@ -22,13 +23,14 @@ int main(int argc, char* argv[])
     if (wsaResult != 0) {
         std::ostringstream oss;
         oss << "Winsock initialization failed with error: " << wsaResult;
-        std::cerr << oss.str() << std::endl;
+        sshconn::logError("main", oss.str());
+        sshconn::Logger::instance().shutdown();
         fl_alert("%s", oss.str().c_str());
         return 1;
     }
-    std::cout << "Winsock initialized: version "
-              << (int)LOBYTE(wsaData.wVersion) << "."
-              << (int)HIBYTE(wsaData.wVersion) << std::endl;
+    sshconn::logInfo("main", "Winsock initialized: version "
+                     + std::to_string(LOBYTE(wsaData.wVersion)) + "."
+                     + std::to_string(HIBYTE(wsaData.wVersion)));
 #endif
 
     // Initialize libssh
@@ -36,7 +38,8 @@ int main(int argc, char* argv[])
     if (sshResult != SSH_OK) {
         std::ostringstream oss;
         oss << "libssh initialization failed with error code: " << sshResult;
-        std::cerr << oss.str() << std::endl;
+        sshconn::logError("main", oss.str());
+        sshconn::Logger::instance().shutdown();
 #ifdef _WIN32
         fl_alert("%s\n\nThis may be caused by missing Visual C++ Runtime.\nPlease install VC++ Redistributable.", oss.str().c_str());
         WSACleanup();
@@ -45,7 +48,7 @@ int main(int argc, char* argv[])
 #endif
         return 1;
     }
-    std::cout << "libssh initialized: version " << ssh_version(0) << std::endl;
+    sshconn::logInfo("main", std::string("libssh initialized: version ") + ssh_version(0));
 
     // Set executable directory for portable key search
     if (argc > 0 && argv[0]) {
@@ -53,17 +56,29 @@ int main(int argc, char* argv[])
         sshconn::ConfigManager::setExecutableDir(exePath.parent_path().string());
     }
 
+    // Rediscover config and key locations when files appear or go away
+    sshconn::PathResolver::instance().startWatching();
+
     // Enable multithreading support for Fl::awake()
     Fl::lock();
 
-    sshconn::MainWindow window;
-    window.show(argc, argv);
+    int result = 0;
+    {
+        // Scoped so the window disconnects, and logs doing so, before
+        // libssh and the logger are shut down below
+        sshconn::MainWindow window;
+        window.show(argc, argv);
+        result = Fl::run();
+    }
 
-    int result = Fl::run();
+    sshconn::PathResolver::instance().stopWatching();
 
     // Cleanup libssh
     ssh_finalize();
 
+    // Write out anything still queued
+    sshconn::Logger::instance().shutdown();
+
 #ifdef _WIN32
     WSACleanup();
 #endif
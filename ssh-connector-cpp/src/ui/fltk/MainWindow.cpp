@@ -1,17 +1,18 @@
 #include "MainWindow.h"
 #include "../../config/Config.h"
+#include "../../core/Logger.h"
+#include "../../core/TraceLog.h"
 
 #include <FL/Fl.H>
 #include <FL/fl_draw.H>
 
-#include <iostream>
 #include <sstream>
 
 namespace sshconn {
 
 // Window dimensions
 constexpr int WINDOW_WIDTH = 360;
-constexpr int WINDOW_HEIGHT = 280;
+constexpr int WINDOW_HEIGHT = 390;
 constexpr int MARGIN = 15;
 constexpr int LABEL_HEIGHT = 20;
 constexpr int INPUT_HEIGHT = 25;
@@ -19,30 +20,73 @@ constexpr int BUTTON_HEIGHT = 35;
 constexpr int GROUP_LABEL_HEIGHT = 20;
 constexpr int ROW_SPACING = 8;
 
+// State changes reach the widgets at most this often (~30 Hz)
+constexpr auto UI_FRAME_INTERVAL = std::chrono::milliseconds(33);
+
+// The dashboard reads the counters on this period, whatever the traffic
+constexpr double DASHBOARD_SAMPLE_SECONDS = 1.0;
+
+// Keys of commands that supersede a queued command of the same kind
+const char* const CONNECTION_COMMAND = "connection";
+const char* const MIGRATE_COMMAND = "migrate";
+
+const Fl_Color COLOR_GRAY = FL_DARK3;
+const Fl_Color COLOR_BLUE = fl_rgb_color(0, 122, 255); // macOS blue
+const Fl_Color COLOR_RED = fl_rgb_color(220, 53, 69);
+
 MainWindow::MainWindow()
     : Fl_Window(WINDOW_WIDTH, WINDOW_HEIGHT, "SSH Tunnel Connector")
     , m_sshClient(std::make_unique<SSHClient>())
+    , m_executor(std::make_unique<CommandExecutor>())
 {
+    // One worker runs connects, disconnects and tunnel changes in order
+    m_executor->start();
+
     // Load configuration
     m_configManager.load();
+    Logger::instance().configure(m_configManager.config().logging);
+    TraceLog::instance().configure(m_configManager.config().trace);
+    applyMetricsConfig();
 
     setupUi();
     connectSignals();
 
+    // Writes happen in the background, coalesced and only when changed
+    m_configPersister = std::make_unique<ConfigPersister>(m_configManager);
+    m_configPersister->start();
+
+    // Pick up edits to config.json while running
+    m_configWatcher = std::make_unique<ConfigWatcher>(m_configManager.configPath());
+    m_configWatcher->setChangeCallback([this]() {
+        Fl::awake(onConfigChanged, this);
+    });
+    m_configWatcher->start();
+
+    Fl::add_timeout(DASHBOARD_SAMPLE_SECONDS, onDashboardSample, this);
+
     // Center window on screen
     position((Fl::w() - w()) / 2, (Fl::h() - h()) / 2);
 }
 
 MainWindow::~MainWindow()
 {
+    Fl::remove_timeout(onUiRefresh, this);
+    Fl::remove_timeout(onDashboardSample, this);
+    m_configWatcher->stop();
     m_stopReconnect.store(true);
 
+    // No worker command may outlive the window
+    m_executor->cancelPending();
+    m_executor->stop();
+
     if (m_sshClient->isConnected()) {
-        m_sshClient->stopReverseTunnel(static_cast<int>(m_remotePortSpin->value()));
+        m_sshClient->setDrainTimeout(0);
+        m_sshClient->stopTunnel({TunnelType::Remote, static_cast<int>(m_remotePortSpin->value())});
         m_sshClient->disconnect();
     }
 
-    m_configManager.save();
+    m_configPersister->schedule(m_configManager.config());
+    m_configPersister->stop();
 }
 
 void MainWindow::setupUi()
@@ -87,7 +131,7 @@ void MainWindow::setupUi()
     m_localPortSpin->type(FL_INT_INPUT);
     m_localPortSpin->minimum(PortRange::LOCAL_PORT_MIN);
     m_localPortSpin->maximum(PortRange::LOCAL_PORT_MAX);
-    m_localPortSpin->value(m_configManager.config().tunnel.localPort);
+    m_localPortSpin->value(m_configManager.config().primaryTunnel().localPort);
     m_localPortSpin->textsize(12);
     y += INPUT_HEIGHT + ROW_SPACING;
 
@@ -100,28 +144,39 @@ void MainWindow::setupUi()
     m_remotePortSpin->type(FL_INT_INPUT);
     m_remotePortSpin->minimum(PortRange::REMOTE_PORT_MIN);
     m_remotePortSpin->maximum(PortRange::REMOTE_PORT_MAX);
-    m_remotePortSpin->value(m_configManager.config().tunnel.remotePort);
+    m_remotePortSpin->value(m_configManager.config().primaryTunnel().remotePort);
     m_remotePortSpin->textsize(12);
     y += INPUT_HEIGHT + MARGIN;
 
     // Status label (taller to fit error messages)
     int statusHeight = 40;
-    m_statusLabel = new Fl_Box(MARGIN, y, contentWidth, statusHeight, "Disconnected");
+    m_shownView.status = "Disconnected";
+    m_shownView.statusColor = COLOR_GRAY;
+    m_statusLabel = new Fl_Box(MARGIN, y, contentWidth, statusHeight);
+    m_statusLabel->copy_label(m_shownView.status.c_str());
     m_statusLabel->align(FL_ALIGN_CENTER | FL_ALIGN_INSIDE | FL_ALIGN_WRAP);
-    m_statusLabel->labelcolor(FL_DARK3);
+    m_statusLabel->labelcolor(m_shownView.statusColor);
     m_statusLabel->labelsize(11);
     y += statusHeight + ROW_SPACING;
 
     // Connect button
     int buttonWidth = 120;
     int buttonX = (WINDOW_WIDTH - buttonWidth) / 2;
-    m_connectBtn = new Fl_Button(buttonX, y, buttonWidth, BUTTON_HEIGHT, "Connect");
+    m_shownView.button = "Connect";
+    m_shownView.buttonColor = COLOR_BLUE;
+    m_connectBtn = new Fl_Button(buttonX, y, buttonWidth, BUTTON_HEIGHT);
+    m_connectBtn->copy_label(m_shownView.button.c_str());
     m_connectBtn->box(FL_FLAT_BOX);
-    m_connectBtn->color(fl_rgb_color(0, 122, 255)); // macOS blue
+    m_connectBtn->color(m_shownView.buttonColor);
     m_connectBtn->labelcolor(FL_WHITE);
     m_connectBtn->labelfont(FL_BOLD);
     m_connectBtn->labelsize(13);
     m_connectBtn->clear_visible_focus(); // Remove dotted focus rectangle
+    y += BUTTON_HEIGHT + MARGIN;
+
+    // Live session and tunnel figures
+    m_dashboard = new TunnelDashboard(MARGIN, y, contentWidth, WINDOW_HEIGHT - y - MARGIN);
+    updateDashboardTunnels();
 
     end(); // End adding widgets to window
 }
@@ -149,26 +204,46 @@ void MainWindow::onConnectClick(Fl_Widget* /*w*/, void* data)
 
 void MainWindow::scheduleUiUpdate(ConnectionState state, const std::string& error)
 {
+    bool wake;
     {
         std::lock_guard<std::mutex> lock(m_pendingStateMutex);
         m_pendingState = state;
         m_pendingError = error;
         m_hasPendingUpdate = true;
+        wake = !m_refreshScheduled;
+        m_refreshScheduled = true;
     }
 
-    // Schedule UI update on main thread
-    Fl::awake(onAwake, this);
+    // One wakeup per frame; later states overwrite the pending one
+    if (wake) {
+        Fl::awake(onAwake, this);
+    }
 }
 
 void MainWindow::onAwake(void* data)
 {
     MainWindow* win = static_cast<MainWindow*>(data);
 
+    // Apply now unless the last refresh was less than a frame ago
+    auto due = win->m_lastRefresh + UI_FRAME_INTERVAL;
+    auto now = std::chrono::steady_clock::now();
+    if (now >= due) {
+        onUiRefresh(data);
+    } else {
+        Fl::add_timeout(std::chrono::duration<double>(due - now).count(), onUiRefresh, data);
+    }
+}
+
+void MainWindow::onUiRefresh(void* data)
+{
+    MainWindow* win = static_cast<MainWindow*>(data);
+
     ConnectionState state;
     std::string error;
 
     {
         std::lock_guard<std::mutex> lock(win->m_pendingStateMutex);
+        win->m_refreshScheduled = false;
         if (!win->m_hasPendingUpdate) {
             return;
         }
@@ -177,28 +252,126 @@ void MainWindow::onAwake(void* data)
         win->m_hasPendingUpdate = false;
     }
 
+    win->m_lastRefresh = std::chrono::steady_clock::now();
     win->updateUiState(state, error);
 }
 
+void MainWindow::onConfigChanged(void* data)
+{
+    static_cast<MainWindow*>(data)->reloadConfig();
+}
+
+void MainWindow::onDashboardSample(void* data)
+{
+    static_cast<MainWindow*>(data)->m_dashboard->sample();
+    Fl::repeat_timeout(DASHBOARD_SAMPLE_SECONDS, onDashboardSample, data);
+}
+
+void MainWindow::updateDashboardTunnels()
+{
+    std::vector<std::string> names;
+    for (const TunnelConfig& tunnel : m_configManager.config().activeTunnels()) {
+        names.push_back(tunnelKeyName(tunnel.key()));
+    }
+    m_dashboard->setTunnels(names);
+}
+
+void MainWindow::applyMetricsConfig()
+{
+    if (m_metricsServer) {
+        m_metricsServer->stop();
+        m_metricsServer.reset();
+    }
+    if (m_configManager.config().metrics.enabled) {
+        m_metricsServer = std::make_unique<MetricsServer>(m_configManager.config().metrics.port);
+        m_metricsServer->start();
+    }
+}
+
+void MainWindow::reloadConfig()
+{
+    AppConfig updated;
+    if (!m_configManager.readConfig(updated)) {
+        return; // Keep running with the last good config
+    }
+
+    if (updated == m_configManager.config()) {
+        return; // Typically our own write
+    }
+    ConfigDelta delta = diffConfig(m_configManager.config(), updated);
+    m_configManager.config() = updated;
+    logInfo("config", "Configuration reloaded");
+
+    if (delta.loggingChanged) {
+        Logger::instance().configure(updated.logging);
+    }
+    if (delta.traceChanged) {
+        TraceLog::instance().configure(updated.trace);
+    }
+    if (delta.rateLimitChanged) {
+        m_sshClient->setRateLimit(updated.rateLimit);
+    }
+    if (delta.drainTimeoutChanged) {
+        m_sshClient->setDrainTimeout(updated.drainTimeout);
+    }
+    if (delta.probeChanged) {
+        m_sshClient->setProbe(updated.probe);
+    }
+    if (delta.rekeyChanged) {
+        m_sshClient->setRekeyPolicy(updated.rekey);
+        // Rekey limits are fixed per session: hand over to a new one
+        if (m_sshClient->isConnected()) {
+            m_executor->submit(MIGRATE_COMMAND, [this]() {
+                m_sshClient->migrate(m_sshClient->endpoint());
+            });
+        }
+    }
+    if (delta.metricsChanged) {
+        applyMetricsConfig();
+    }
+    if (delta.tunnelsChanged()) {
+        m_localPortSpin->value(updated.primaryTunnel().localPort);
+        m_remotePortSpin->value(updated.primaryTunnel().remotePort);
+        updateDashboardTunnels();
+
+        // Only the changed forwards are touched; the session stays up
+        if (m_sshClient->isConnected()) {
+            // Unkeyed: every delta builds on the one before
+            m_executor->submit([this, delta]() {
+                m_sshClient->applyTunnelChanges(delta);
+            });
+        }
+    }
+}
+
 void MainWindow::doConnect()
 {
     int localPort = static_cast<int>(m_localPortSpin->value());
     int remotePort = static_cast<int>(m_remotePortSpin->value());
 
-    // Save config
-    m_configManager.config().tunnel.localPort = localPort;
-    m_configManager.config().tunnel.remotePort = remotePort;
-    m_configManager.save();
+    // Save config off the UI thread
+    m_configManager.config().primaryTunnel().localPort = localPort;
+    m_configManager.config().primaryTunnel().remotePort = remotePort;
+    m_configPersister->schedule(m_configManager.config());
+    updateDashboardTunnels();
 
     m_stopReconnect.store(false);
-
-    // Connect in background thread
-    std::thread([this, localPort, remotePort]() {
+    m_sshClient->setRateLimit(m_configManager.config().rateLimit);
+    m_sshClient->setDrainTimeout(m_configManager.config().drainTimeout);
+    m_sshClient->setRekeyPolicy(m_configManager.config().rekey);
+    m_sshClient->setProbe(m_configManager.config().probe);
+
+    // Connect on the worker; all active tunnels share the session. A connect
+    // or disconnect still queued from an earlier click is superseded.
+    std::vector<TunnelConfig> tunnels = m_configManager.config().activeTunnels();
+    m_executor->submit(CONNECTION_COMMAND, [this, tunnels]() {
         m_sshClient->connect();
         if (m_sshClient->isConnected()) {
-            m_sshClient->startReverseTunnel(localPort, remotePort);
+            for (const TunnelConfig& tunnel : tunnels) {
+                m_sshClient->startTunnel(tunnel);
+            }
         }
-    }).detach();
+    });
 }
 
 void MainWindow::doDisconnect()
@@ -206,61 +379,91 @@ void MainWindow::doDisconnect()
     m_stopReconnect.store(true);
     int remotePort = static_cast<int>(m_remotePortSpin->value());
 
-    // Disconnect in background thread
-    std::thread([this, remotePort]() {
-        m_sshClient->stopReverseTunnel(remotePort);
+    // Disconnect on the worker, after whatever it is running
+    m_executor->submit(CONNECTION_COMMAND, [this, remotePort]() {
+        m_sshClient->stopTunnel({TunnelType::Remote, remotePort});
         m_sshClient->disconnect();
-    }).detach();
+    });
 }
 
 void MainWindow::updateUiState(ConnectionState state, const std::string& error)
 {
+    UiView view = m_shownView;
     switch (state) {
         case ConnectionState::Connected:
-            m_statusLabel->copy_label("Connected");
-            m_statusLabel->labelcolor(fl_rgb_color(40, 167, 69)); // Green
-            m_connectBtn->copy_label("Disconnect");
-            m_connectBtn->color(fl_rgb_color(220, 53, 69)); // Red
-            m_connectBtn->activate();
-            m_localPortSpin->deactivate();
-            m_remotePortSpin->deactivate();
+            view.status = "Connected";
+            view.statusColor = fl_rgb_color(40, 167, 69); // Green
+            view.statusTooltip.clear();
+            view.button = "Disconnect";
+            view.buttonColor = COLOR_RED;
+            view.buttonActive = true;
+            view.portsActive = false;
             break;
 
         case ConnectionState::Disconnected:
-            m_statusLabel->copy_label("Disconnected");
-            m_statusLabel->labelcolor(FL_DARK3); // Gray
-            m_connectBtn->copy_label("Connect");
-            m_connectBtn->color(fl_rgb_color(0, 122, 255)); // Blue
-            m_connectBtn->activate();
-            m_localPortSpin->activate();
-            m_remotePortSpin->activate();
+            view.status = "Disconnected";
+            view.statusColor = COLOR_GRAY;
+            view.statusTooltip.clear();
+            view.button = "Connect";
+            view.buttonColor = COLOR_BLUE;
+            view.buttonActive = true;
+            view.portsActive = true;
             break;
 
         case ConnectionState::Connecting:
-            m_statusLabel->copy_label("Connecting...");
-            m_statusLabel->labelcolor(fl_rgb_color(255, 152, 0)); // Orange
-            m_connectBtn->deactivate();
+            view.status = "Connecting...";
+            view.statusColor = fl_rgb_color(255, 152, 0); // Orange
+            view.statusTooltip.clear();
+            view.buttonActive = false;
+            break;
+
+        case ConnectionState::Error:
+            // Show full error in status (wrapped), and on hover
+            view.status = "Error: " + error;
+            view.statusColor = COLOR_RED;
+            view.statusTooltip = error;
+            view.button = "Connect";
+            view.buttonColor = COLOR_BLUE;
+            view.buttonActive = true;
+            view.portsActive = true;
             break;
+    }
 
-        case ConnectionState::Error: {
-            std::string statusText = "Error: " + error;
-            // Log full error to console
-            std::cerr << "Connection error: " << error << std::endl;
-            // Show full error in status (wrapped)
-            m_statusLabel->copy_label(statusText.c_str());
-            m_statusLabel->tooltip(error.c_str()); // Full error on hover
-            m_statusLabel->labelcolor(fl_rgb_color(220, 53, 69)); // Red
-            m_connectBtn->copy_label("Connect");
-            m_connectBtn->color(fl_rgb_color(0, 122, 255)); // Blue
+    // Redraw only the widgets whose look changed, not the whole window
+    if (view.status != m_shownView.status || view.statusColor != m_shownView.statusColor) {
+        if (state == ConnectionState::Error) {
+            logError("ui", "Connection error: " + error);
+        }
+        m_statusLabel->copy_label(view.status.c_str());
+        m_statusLabel->labelcolor(view.statusColor);
+        m_statusLabel->redraw_label(); // No box: the window repaints behind it
+    }
+    if (view.statusTooltip != m_shownView.statusTooltip) {
+        m_statusLabel->copy_tooltip(view.statusTooltip.empty() ? nullptr : view.statusTooltip.c_str());
+    }
+    if (view.button != m_shownView.button || view.buttonColor != m_shownView.buttonColor) {
+        m_connectBtn->copy_label(view.button.c_str());
+        m_connectBtn->color(view.buttonColor);
+        m_connectBtn->redraw();
+    }
+    if (view.buttonActive != m_shownView.buttonActive) {
+        // activate() and deactivate() redraw the widget themselves
+        if (view.buttonActive) {
             m_connectBtn->activate();
+        } else {
+            m_connectBtn->deactivate();
+        }
+    }
+    if (view.portsActive != m_shownView.portsActive) {
+        if (view.portsActive) {
             m_localPortSpin->activate();
             m_remotePortSpin->activate();
-            break;
+        } else {
+            m_localPortSpin->deactivate();
+            m_remotePortSpin->deactivate();
         }
     }
-
-    // Redraw the window to show changes
-    redraw();
+    m_shownView = view;
 }
 
 int MainWindow::handle(int event)
@@ -269,12 +472,21 @@ int MainWindow::handle(int event)
         // Handle window close
         m_stopReconnect.store(true);
 
+        // Drop queued clicks and wait out the command in flight; a connect
+        // cannot be interrupted but gives up after its timeout
+        m_executor->cancelPending();
+        m_executor->stop();
+
         if (m_sshClient->isConnected()) {
-            m_sshClient->stopReverseTunnel(static_cast<int>(m_remotePortSpin->value()));
+            // Exiting: do not hold the window open for transfers
+            m_sshClient->setDrainTimeout(0);
+            m_sshClient->stopTunnel({TunnelType::Remote, static_cast<int>(m_remotePortSpin->value())});
             m_sshClient->disconnect();
         }
 
-        m_configManager.save();
+        // Exiting: write now rather than after the debounce
+        m_configPersister->schedule(m_configManager.config());
+        m_configPersister->flush();
         return 1; // Allow close
     }
 
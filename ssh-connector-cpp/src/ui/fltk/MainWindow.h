@@ -1,8 +1,13 @@
 #ifndef MAIN_WINDOW_H
 #define MAIN_WINDOW_H
 
+#include "../../core/CommandExecutor.h"
+#include "../../core/MetricsServer.h"
 #include "../../core/SSHClient.h"
 #include "../../config/ConfigManager.h"
+#include "../../config/ConfigPersister.h"
+#include "../../config/ConfigWatcher.h"
+#include "TunnelDashboard.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Window.H>
@@ -11,8 +16,9 @@
 #include <FL/Fl_Spinner.H>
 #include <FL/Fl_Group.H>
 
+#include <chrono>
 #include <memory>
-#include <thread>
+#include <string>
 #include <atomic>
 #include <mutex>
 
@@ -32,19 +38,44 @@ private:
     void doConnect();
     void doDisconnect();
     void updateUiState(ConnectionState state, const std::string& error);
+    void applyMetricsConfig();
+    void reloadConfig();
+    void updateDashboardTunnels();
 
-    // Schedule UI update from worker thread
+    // Schedule UI update from worker thread. Only the latest state is kept,
+    // and the UI thread applies it at most once per frame however many
+    // arrive.
     void scheduleUiUpdate(ConnectionState state, const std::string& error);
 
     // Static callbacks (FLTK pattern)
     static void onConnectClick(Fl_Widget* w, void* data);
     static void onAwake(void* data);
+    static void onUiRefresh(void* data);
+    static void onConfigChanged(void* data);
+    static void onDashboardSample(void* data);
+
+    // What the widgets show; updateUiState touches only what differs
+    struct UiView {
+        std::string status;
+        Fl_Color statusColor = FL_DARK3;
+        std::string statusTooltip;
+        std::string button;
+        Fl_Color buttonColor = FL_BACKGROUND_COLOR;
+        bool buttonActive = true;
+        bool portsActive = true;
+    };
 
     // Configuration
     ConfigManager m_configManager;
+    std::unique_ptr<ConfigPersister> m_configPersister;
+    std::unique_ptr<ConfigWatcher> m_configWatcher;
 
-    // SSH client
+    // SSH client, and the worker that runs its blocking calls
     std::unique_ptr<SSHClient> m_sshClient;
+    std::unique_ptr<CommandExecutor> m_executor;
+
+    // Optional /metrics endpoint
+    std::unique_ptr<MetricsServer> m_metricsServer;
 
     // UI elements
     Fl_Box* m_serverLabel = nullptr;
@@ -52,6 +83,8 @@ private:
     Fl_Spinner* m_remotePortSpin = nullptr;
     Fl_Box* m_statusLabel = nullptr;
     Fl_Button* m_connectBtn = nullptr;
+    TunnelDashboard* m_dashboard = nullptr;
+    UiView m_shownView;
 
     // Threading
     std::atomic<bool> m_stopReconnect{false};
@@ -61,6 +94,8 @@ private:
     ConnectionState m_pendingState = ConnectionState::Disconnected;
     std::string m_pendingError;
     bool m_hasPendingUpdate = false;
+    bool m_refreshScheduled = false; // An awake or frame timeout is on its way
+    std::chrono::steady_clock::time_point m_lastRefresh; // UI thread only
 };
 
 } // namespace sshconn
@@ -0,0 +1,181 @@
+#include "TunnelDashboard.h"
+
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace sshconn {
+
+namespace {
+
+constexpr int PADDING = 6;
+constexpr int HEADER_HEIGHT = 18;
+constexpr int ROW_HEIGHT = 20;
+constexpr int NAME_WIDTH = 48;
+constexpr int VALUE_WIDTH = 110;
+constexpr int FONT_SIZE = 11;
+
+// Sparklines scale to their own peak, but not below this, so an idle tunnel
+// stays flat instead of magnifying a few bytes
+constexpr double MIN_SCALE = 1024.0;
+
+std::string formatRate(double bytesPerSecond)
+{
+    static const char* units[] = {"B/s", "KB/s", "MB/s", "GB/s"};
+    int unit = 0;
+    while (bytesPerSecond >= 1024.0 && unit < 3) {
+        bytesPerSecond /= 1024.0;
+        ++unit;
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f %s" : "%.1f %s", bytesPerSecond, units[unit]);
+    return buffer;
+}
+
+} // namespace
+
+TunnelDashboard::TunnelDashboard(int x, int y, int w, int h)
+    : Fl_Widget(x, y, w, h)
+{
+    box(FL_THIN_DOWN_BOX);
+    color(FL_BACKGROUND2_COLOR);
+}
+
+void TunnelDashboard::setTunnels(const std::vector<std::string>& names)
+{
+    // Keep the history of tunnels that stay
+    std::vector<Series> series;
+    for (const std::string& name : names) {
+        auto it = std::find_if(m_series.begin(), m_series.end(), [&](const Series& s) { return s.name == name; });
+        if (it != m_series.end()) {
+            series.push_back(std::move(*it));
+            continue;
+        }
+        Series added;
+        added.name = name;
+        added.metrics = MetricsRegistry::instance().tunnel(name);
+        added.lastBytes = added.metrics->bytesToLocal.value() + added.metrics->bytesToRemote.value();
+        series.push_back(std::move(added));
+    }
+    m_series = std::move(series);
+    redraw();
+}
+
+void TunnelDashboard::sample()
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - m_lastSample).count();
+    bool first = m_lastSample == std::chrono::steady_clock::time_point();
+    m_lastSample = now;
+
+    SessionMetrics& session = MetricsRegistry::instance().session();
+    std::uint64_t rtt = session.lastProbeLatencyMicros.load(std::memory_order_relaxed);
+    std::uint64_t reconnects = session.reconnects.value();
+    bool changed = rtt != m_rttMicros || reconnects != m_reconnects;
+    m_rttMicros = rtt;
+    m_reconnects = reconnects;
+
+    for (Series& series : m_series) {
+        std::uint64_t bytes = series.metrics->bytesToLocal.value() + series.metrics->bytesToRemote.value();
+        double rate = first || seconds <= 0.0 ? 0.0 : static_cast<double>(bytes - series.lastBytes) / seconds;
+        series.lastBytes = bytes;
+
+        // An all-zero history scrolls into itself: nothing to redraw
+        double& slot = series.rates[series.next];
+        changed |= series.nonZero > 0 || rate > 0.0;
+        series.nonZero += (rate > 0.0) - (slot > 0.0);
+        slot = rate;
+        series.next = (series.next + 1) % HISTORY;
+
+        std::int64_t active = series.metrics->activeConnections.value();
+        changed |= active != series.active;
+        series.active = active;
+    }
+
+    if (changed) {
+        redraw();
+    }
+}
+
+void TunnelDashboard::draw()
+{
+    draw_box();
+    fl_push_clip(x() + PADDING, y() + PADDING / 2, w() - 2 * PADDING, h() - PADDING);
+    fl_font(FL_HELVETICA, FONT_SIZE);
+
+    // Session line
+    char header[96];
+    if (m_rttMicros > 0) {
+        std::snprintf(header, sizeof(header), "Probe RTT %.1f ms    Reconnects %llu",
+                      static_cast<double>(m_rttMicros) / 1000.0, static_cast<unsigned long long>(m_reconnects));
+    } else {
+        std::snprintf(header, sizeof(header), "Probe RTT -    Reconnects %llu",
+                      static_cast<unsigned long long>(m_reconnects));
+    }
+    fl_color(FL_FOREGROUND_COLOR);
+    fl_draw(header, x() + PADDING, y() + PADDING / 2, w() - 2 * PADDING, HEADER_HEIGHT,
+            FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+    // Tunnel rows, as many as fit; the last one notes any left out
+    int top = y() + PADDING / 2 + HEADER_HEIGHT;
+    int rows = std::max(0, (y() + h() - PADDING / 2 - top) / ROW_HEIGHT);
+    int shown = static_cast<int>(m_series.size());
+    if (shown > rows) {
+        shown = std::max(0, rows - 1);
+    }
+    int sparkX = x() + PADDING + NAME_WIDTH;
+    int sparkWidth = w() - 2 * PADDING - NAME_WIDTH - VALUE_WIDTH;
+
+    for (int i = 0; i < shown; ++i) {
+        const Series& series = m_series[static_cast<std::size_t>(i)];
+        int rowY = top + i * ROW_HEIGHT;
+
+        std::string name = ":" + series.name;
+        fl_color(FL_FOREGROUND_COLOR);
+        fl_draw(name.c_str(), x() + PADDING, rowY, NAME_WIDTH, ROW_HEIGHT, FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+        drawSparkline(series, sparkX, rowY + 3, sparkWidth, ROW_HEIGHT - 6);
+
+        double current = series.rates[(series.next + HISTORY - 1) % HISTORY];
+        std::string value = formatRate(current) + "  " + std::to_string(series.active) + " conn";
+        fl_color(FL_FOREGROUND_COLOR);
+        fl_draw(value.c_str(), sparkX + sparkWidth, rowY, VALUE_WIDTH, ROW_HEIGHT,
+                FL_ALIGN_RIGHT | FL_ALIGN_INSIDE);
+    }
+    if (shown < static_cast<int>(m_series.size())) {
+        std::string more = "+" + std::to_string(m_series.size() - static_cast<std::size_t>(shown)) + " more";
+        fl_color(FL_INACTIVE_COLOR);
+        fl_draw(more.c_str(), x() + PADDING, top + shown * ROW_HEIGHT, w() - 2 * PADDING, ROW_HEIGHT,
+                FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+    }
+
+    fl_pop_clip();
+}
+
+void TunnelDashboard::drawSparkline(const Series& series, int x, int y, int w, int h) const
+{
+    if (w <= 1 || h <= 1) {
+        return;
+    }
+
+    double peak = MIN_SCALE;
+    for (double rate : series.rates) {
+        peak = std::max(peak, rate);
+    }
+
+    // Baseline, then oldest to newest left to right
+    fl_color(FL_LIGHT2);
+    fl_line(x, y + h - 1, x + w - 1, y + h - 1);
+    fl_color(fl_rgb_color(0, 122, 255));
+    fl_begin_line();
+    for (int i = 0; i < HISTORY; ++i) {
+        double rate = series.rates[(series.next + static_cast<std::size_t>(i)) % HISTORY];
+        double px = x + static_cast<double>(i) * (w - 1) / (HISTORY - 1);
+        double py = y + (h - 1) * (1.0 - rate / peak);
+        fl_vertex(px, py);
+    }
+    fl_end_line();
+}
+
+} // namespace sshconn
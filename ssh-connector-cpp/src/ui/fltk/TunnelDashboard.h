@@ -0,0 +1,58 @@
+#ifndef TUNNEL_DASHBOARD_H
+#define TUNNEL_DASHBOARD_H
+
+#include "../../core/Metrics.h"
+
+#include <FL/Fl_Widget.H>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sshconn {
+
+// Compact live view of the session and its tunnels: probe RTT and
+// reconnects, then one row per tunnel with its active connections and a
+// throughput sparkline. Fed only by sample(), which reads the metrics
+// registry; the owner calls it on a fixed timer, so the cost of drawing does
+// not grow with traffic.
+class TunnelDashboard : public Fl_Widget {
+public:
+    static constexpr int HISTORY = 60; // Samples per sparkline
+
+    TunnelDashboard(int x, int y, int w, int h);
+
+    // Tunnels to show, by metrics name (listen port), in display order
+    void setTunnels(const std::vector<std::string>& names);
+
+    // Read the counters and redraw if anything visible changed
+    void sample();
+
+protected:
+    void draw() override;
+
+private:
+    struct Series {
+        std::string name;
+        std::shared_ptr<TunnelMetrics> metrics;
+        std::uint64_t lastBytes = 0;
+        std::array<double, HISTORY> rates{}; // Bytes/s, both directions; ring
+        std::size_t next = 0;                // Oldest sample, overwritten next
+        int nonZero = 0;                     // Samples in rates above zero
+        std::int64_t active = 0;
+    };
+
+    void drawSparkline(const Series& series, int x, int y, int w, int h) const;
+
+    std::vector<Series> m_series;
+    std::chrono::steady_clock::time_point m_lastSample;
+    std::uint64_t m_rttMicros = 0;
+    std::uint64_t m_reconnects = 0;
+};
+
+} // namespace sshconn
+
+#endif // TUNNEL_DASHBOARD_H
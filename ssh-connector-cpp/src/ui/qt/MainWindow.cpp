@@ -1,5 +1,7 @@
 #include "MainWindow.h"
 #include "../../config/Config.h"
+#include "../../core/Logger.h"
+#include "../../core/TraceLog.h"
 
 #include <QApplication>
 #include <QVBoxLayout>
@@ -7,22 +9,60 @@
 #include <QGroupBox>
 #include <QCloseEvent>
 #include <QThread>
-#include <thread>
+#include <algorithm>
 
 namespace sshconn {
 
+namespace {
+
+// State changes reach the widgets at most this often (~30 Hz)
+constexpr auto UI_FRAME_INTERVAL = std::chrono::milliseconds(33);
+
+// Keys of commands that supersede a queued command of the same kind
+const char* const CONNECTION_COMMAND = "connection";
+const char* const MIGRATE_COMMAND = "migrate";
+
+} // namespace
+
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent)
     , m_sshClient(std::make_unique<SSHClient>())
+    , m_executor(std::make_unique<CommandExecutor>())
 {
+    // One worker runs connects, disconnects and tunnel changes in order
+    m_executor->start();
+
     // Load configuration
     m_configManager.load();
+    Logger::instance().configure(m_configManager.config().logging);
+    TraceLog::instance().configure(m_configManager.config().trace);
+    applyMetricsConfig();
 
     setupUi();
     connectSignals();
+
+    // Writes happen in the background, coalesced and only when changed
+    m_configPersister = std::make_unique<ConfigPersister>(m_configManager);
+    m_configPersister->start();
+
+    // Pick up edits to config.json while running
+    m_configWatcher = std::make_unique<ConfigWatcher>(m_configManager.configPath());
+    m_configWatcher->setChangeCallback([this]() {
+        QMetaObject::invokeMethod(this, [this]() {
+            reloadConfig();
+        }, Qt::QueuedConnection);
+    });
+    m_configWatcher->start();
 }
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow()
+{
+    // No worker command may outlive the window
+    m_executor->cancelPending();
+    m_executor->stop();
+    m_configWatcher->stop();
+    m_configPersister->stop();
+}
 
 void MainWindow::setupUi()
 {
@@ -55,7 +95,7 @@ void MainWindow::setupUi()
     localLayout->addWidget(new QLabel("Local Port:", portGroup));
     m_localPortSpin = new QSpinBox(portGroup);
     m_localPortSpin->setRange(PortRange::LOCAL_PORT_MIN, PortRange::LOCAL_PORT_MAX);
-    m_localPortSpin->setValue(m_configManager.config().tunnel.localPort);
+    m_localPortSpin->setValue(m_configManager.config().primaryTunnel().localPort);
     localLayout->addWidget(m_localPortSpin);
     portLayout->addLayout(localLayout);
 
@@ -64,19 +104,23 @@ void MainWindow::setupUi()
     remoteLayout->addWidget(new QLabel("Remote Port:", portGroup));
     m_remotePortSpin = new QSpinBox(portGroup);
     m_remotePortSpin->setRange(PortRange::REMOTE_PORT_MIN, PortRange::REMOTE_PORT_MAX);
-    m_remotePortSpin->setValue(m_configManager.config().tunnel.remotePort);
+    m_remotePortSpin->setValue(m_configManager.config().primaryTunnel().remotePort);
     remoteLayout->addWidget(m_remotePortSpin);
     portLayout->addLayout(remoteLayout);
 
     layout->addWidget(portGroup);
 
     // Status
-    m_statusLabel = new QLabel("Status: Disconnected", central);
+    m_shownView.status = "Status: Disconnected";
+    m_shownView.statusStyle = "color: gray;";
+    m_shownView.button = "Connect";
+    m_statusLabel = new QLabel(m_shownView.status, central);
+    m_statusLabel->setStyleSheet(m_shownView.statusStyle);
     m_statusLabel->setAlignment(Qt::AlignCenter);
     layout->addWidget(m_statusLabel);
 
     // Connect button
-    m_connectBtn = new QPushButton("Connect", central);
+    m_connectBtn = new QPushButton(m_shownView.button, central);
     m_connectBtn->setMinimumHeight(40);
     layout->addWidget(m_connectBtn);
 }
@@ -87,15 +131,66 @@ void MainWindow::connectSignals()
     QObject::connect(m_connectBtn, &QPushButton::clicked,
                      this, &MainWindow::toggleConnection);
 
-    // SSH state changes - use a lambda to bridge std::function callback to Qt slot
+    // Coalesced state updates are applied when the frame timer fires
+    m_uiRefreshTimer = new QTimer(this);
+    m_uiRefreshTimer->setSingleShot(true);
+    QObject::connect(m_uiRefreshTimer, &QTimer::timeout,
+                     this, &MainWindow::refreshUi);
+
+    // SSH state changes arrive on worker threads
     m_sshClient->setStateCallback([this](ConnectionState state, const std::string& error) {
-        // Use QMetaObject::invokeMethod for thread-safe slot invocation
-        QMetaObject::invokeMethod(this, [this, state, error]() {
-            onStateChanged(state, error);
-        }, Qt::QueuedConnection);
+        scheduleUiUpdate(state, error);
     });
 }
 
+void MainWindow::scheduleUiUpdate(ConnectionState state, const std::string& error)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingStateMutex);
+        m_pendingState = state;
+        m_pendingError = error;
+        m_hasPendingUpdate = true;
+        wake = !m_refreshScheduled;
+        m_refreshScheduled = true;
+    }
+
+    // One queued call per frame; later states overwrite the pending one
+    if (wake) {
+        QMetaObject::invokeMethod(this, [this]() {
+            scheduleUiRefresh();
+        }, Qt::QueuedConnection);
+    }
+}
+
+void MainWindow::scheduleUiRefresh()
+{
+    // Apply now unless the last refresh was less than a frame ago
+    auto remaining = m_lastRefresh + UI_FRAME_INTERVAL - std::chrono::steady_clock::now();
+    auto delayMs = std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count();
+    m_uiRefreshTimer->start(static_cast<int>(std::max<long long>(0, delayMs)));
+}
+
+void MainWindow::refreshUi()
+{
+    ConnectionState state;
+    std::string error;
+
+    {
+        std::lock_guard<std::mutex> lock(m_pendingStateMutex);
+        m_refreshScheduled = false;
+        if (!m_hasPendingUpdate) {
+            return;
+        }
+        state = m_pendingState;
+        error = m_pendingError;
+        m_hasPendingUpdate = false;
+    }
+
+    m_lastRefresh = std::chrono::steady_clock::now();
+    updateUiState(state, error);
+}
+
 void MainWindow::toggleConnection()
 {
     if (m_sshClient->isConnected()) {
@@ -110,20 +205,95 @@ void MainWindow::doConnect()
     int localPort = m_localPortSpin->value();
     int remotePort = m_remotePortSpin->value();
 
-    // Save config
-    m_configManager.config().tunnel.localPort = localPort;
-    m_configManager.config().tunnel.remotePort = remotePort;
-    m_configManager.save();
+    // Save config off the UI thread
+    m_configManager.config().primaryTunnel().localPort = localPort;
+    m_configManager.config().primaryTunnel().remotePort = remotePort;
+    m_configPersister->schedule(m_configManager.config());
 
     m_stopReconnect.store(false);
-
-    // Connect in background thread
-    std::thread([this, localPort, remotePort]() {
+    m_sshClient->setRateLimit(m_configManager.config().rateLimit);
+    m_sshClient->setDrainTimeout(m_configManager.config().drainTimeout);
+    m_sshClient->setRekeyPolicy(m_configManager.config().rekey);
+    m_sshClient->setProbe(m_configManager.config().probe);
+
+    // Connect on the worker; all active tunnels share the session. A connect
+    // or disconnect still queued from an earlier click is superseded.
+    std::vector<TunnelConfig> tunnels = m_configManager.config().activeTunnels();
+    m_executor->submit(CONNECTION_COMMAND, [this, tunnels]() {
         m_sshClient->connect();
         if (m_sshClient->isConnected()) {
-            m_sshClient->startReverseTunnel(localPort, remotePort);
+            for (const TunnelConfig& tunnel : tunnels) {
+                m_sshClient->startTunnel(tunnel);
+            }
         }
-    }).detach();
+    });
+}
+
+void MainWindow::applyMetricsConfig()
+{
+    if (m_metricsServer) {
+        m_metricsServer->stop();
+        m_metricsServer.reset();
+    }
+    if (m_configManager.config().metrics.enabled) {
+        m_metricsServer = std::make_unique<MetricsServer>(m_configManager.config().metrics.port);
+        m_metricsServer->start();
+    }
+}
+
+void MainWindow::reloadConfig()
+{
+    AppConfig updated;
+    if (!m_configManager.readConfig(updated)) {
+        return; // Keep running with the last good config
+    }
+
+    if (updated == m_configManager.config()) {
+        return; // Typically our own write
+    }
+    ConfigDelta delta = diffConfig(m_configManager.config(), updated);
+    m_configManager.config() = updated;
+    logInfo("config", "Configuration reloaded");
+
+    if (delta.loggingChanged) {
+        Logger::instance().configure(updated.logging);
+    }
+    if (delta.traceChanged) {
+        TraceLog::instance().configure(updated.trace);
+    }
+    if (delta.rateLimitChanged) {
+        m_sshClient->setRateLimit(updated.rateLimit);
+    }
+    if (delta.drainTimeoutChanged) {
+        m_sshClient->setDrainTimeout(updated.drainTimeout);
+    }
+    if (delta.probeChanged) {
+        m_sshClient->setProbe(updated.probe);
+    }
+    if (delta.rekeyChanged) {
+        m_sshClient->setRekeyPolicy(updated.rekey);
+        // Rekey limits are fixed per session: hand over to a new one
+        if (m_sshClient->isConnected()) {
+            m_executor->submit(MIGRATE_COMMAND, [this]() {
+                m_sshClient->migrate(m_sshClient->endpoint());
+            });
+        }
+    }
+    if (delta.metricsChanged) {
+        applyMetricsConfig();
+    }
+    if (delta.tunnelsChanged()) {
+        m_localPortSpin->setValue(updated.primaryTunnel().localPort);
+        m_remotePortSpin->setValue(updated.primaryTunnel().remotePort);
+
+        // Only the changed forwards are touched; the session stays up
+        if (m_sshClient->isConnected()) {
+            // Unkeyed: every delta builds on the one before
+            m_executor->submit([this, delta]() {
+                m_sshClient->applyTunnelChanges(delta);
+            });
+        }
+    }
 }
 
 void MainWindow::doDisconnect()
@@ -131,66 +301,87 @@ void MainWindow::doDisconnect()
     m_stopReconnect.store(true);
     int remotePort = m_remotePortSpin->value();
 
-    // Disconnect in background thread
-    std::thread([this, remotePort]() {
-        m_sshClient->stopReverseTunnel(remotePort);
+    // Disconnect on the worker, after whatever it is running
+    m_executor->submit(CONNECTION_COMMAND, [this, remotePort]() {
+        m_sshClient->stopTunnel({TunnelType::Remote, remotePort});
         m_sshClient->disconnect();
-    }).detach();
-}
-
-void MainWindow::onStateChanged(ConnectionState state, const std::string& error)
-{
-    updateUiState(state, error);
+    });
 }
 
 void MainWindow::updateUiState(ConnectionState state, const std::string& error)
 {
+    UiView view = m_shownView;
     switch (state) {
         case ConnectionState::Connected:
-            m_statusLabel->setText("Status: Connected");
-            m_statusLabel->setStyleSheet("color: green; font-weight: bold;");
-            m_connectBtn->setText("Disconnect");
-            m_connectBtn->setEnabled(true);
-            m_localPortSpin->setEnabled(false);
-            m_remotePortSpin->setEnabled(false);
+            view.status = "Status: Connected";
+            view.statusStyle = "color: green; font-weight: bold;";
+            view.button = "Disconnect";
+            view.buttonEnabled = true;
+            view.portsEnabled = false;
             break;
 
         case ConnectionState::Disconnected:
-            m_statusLabel->setText("Status: Disconnected");
-            m_statusLabel->setStyleSheet("color: gray;");
-            m_connectBtn->setText("Connect");
-            m_connectBtn->setEnabled(true);
-            m_localPortSpin->setEnabled(true);
-            m_remotePortSpin->setEnabled(true);
+            view.status = "Status: Disconnected";
+            view.statusStyle = "color: gray;";
+            view.button = "Connect";
+            view.buttonEnabled = true;
+            view.portsEnabled = true;
             break;
 
         case ConnectionState::Connecting:
-            m_statusLabel->setText("Status: Connecting...");
-            m_statusLabel->setStyleSheet("color: orange;");
-            m_connectBtn->setEnabled(false);
+            view.status = "Status: Connecting...";
+            view.statusStyle = "color: orange;";
+            view.buttonEnabled = false;
             break;
 
         case ConnectionState::Error:
-            m_statusLabel->setText(QString("Status: Error - %1").arg(QString::fromStdString(error)));
-            m_statusLabel->setStyleSheet("color: red;");
-            m_connectBtn->setText("Connect");
-            m_connectBtn->setEnabled(true);
-            m_localPortSpin->setEnabled(true);
-            m_remotePortSpin->setEnabled(true);
+            view.status = QString("Status: Error - %1").arg(QString::fromStdString(error));
+            view.statusStyle = "color: red;";
+            view.button = "Connect";
+            view.buttonEnabled = true;
+            view.portsEnabled = true;
             break;
     }
+
+    // Touch only what changed: a style sheet change re-polishes the widget
+    if (view.status != m_shownView.status) {
+        m_statusLabel->setText(view.status);
+    }
+    if (view.statusStyle != m_shownView.statusStyle) {
+        m_statusLabel->setStyleSheet(view.statusStyle);
+    }
+    if (view.button != m_shownView.button) {
+        m_connectBtn->setText(view.button);
+    }
+    if (view.buttonEnabled != m_shownView.buttonEnabled) {
+        m_connectBtn->setEnabled(view.buttonEnabled);
+    }
+    if (view.portsEnabled != m_shownView.portsEnabled) {
+        m_localPortSpin->setEnabled(view.portsEnabled);
+        m_remotePortSpin->setEnabled(view.portsEnabled);
+    }
+    m_shownView = view;
 }
 
 void MainWindow::closeEvent(QCloseEvent* event)
 {
     m_stopReconnect.store(true);
 
+    // Drop queued clicks and wait out the command in flight; a connect
+    // cannot be interrupted but gives up after its timeout
+    m_executor->cancelPending();
+    m_executor->stop();
+
     if (m_sshClient->isConnected()) {
-        m_sshClient->stopReverseTunnel(m_remotePortSpin->value());
+        // Exiting: do not hold the window open for transfers
+        m_sshClient->setDrainTimeout(0);
+        m_sshClient->stopTunnel({TunnelType::Remote, m_remotePortSpin->value()});
         m_sshClient->disconnect();
     }
 
-    m_configManager.save();
+    // Exiting: write now rather than after the debounce
+    m_configPersister->schedule(m_configManager.config());
+    m_configPersister->flush();
     event->accept();
 }
 
@@ -1,15 +1,23 @@
 #ifndef MAIN_WINDOW_QT_H
 #define MAIN_WINDOW_QT_H
 
+#include "../../core/CommandExecutor.h"
+#include "../../core/MetricsServer.h"
 #include "../../core/SSHClient.h"
 #include "../../config/ConfigManager.h"
+#include "../../config/ConfigPersister.h"
+#include "../../config/ConfigWatcher.h"
 
 #include <QMainWindow>
 #include <QLabel>
 #include <QSpinBox>
 #include <QPushButton>
+#include <QTimer>
+#include <chrono>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <string>
 
 namespace sshconn {
 
@@ -25,7 +33,7 @@ protected:
 
 private slots:
     void toggleConnection();
-    void onStateChanged(ConnectionState state, const std::string& error);
+    void refreshUi();
 
 private:
     void setupUi();
@@ -33,12 +41,35 @@ private:
     void doConnect();
     void doDisconnect();
     void updateUiState(ConnectionState state, const std::string& error);
+    void applyMetricsConfig();
+    void reloadConfig();
+
+    // Schedule UI update from worker thread. Only the latest state is kept,
+    // and the UI thread applies it at most once per frame however many
+    // arrive.
+    void scheduleUiUpdate(ConnectionState state, const std::string& error);
+    void scheduleUiRefresh();
+
+    // What the widgets show; updateUiState touches only what differs
+    struct UiView {
+        QString status;
+        QString statusStyle;
+        QString button;
+        bool buttonEnabled = true;
+        bool portsEnabled = true;
+    };
 
     // Configuration
     ConfigManager m_configManager;
+    std::unique_ptr<ConfigPersister> m_configPersister;
+    std::unique_ptr<ConfigWatcher> m_configWatcher;
 
-    // SSH client
+    // SSH client, and the worker that runs its blocking calls
     std::unique_ptr<SSHClient> m_sshClient;
+    std::unique_ptr<CommandExecutor> m_executor;
+
+    // Optional /metrics endpoint
+    std::unique_ptr<MetricsServer> m_metricsServer;
 
     // UI elements
     QLabel* m_serverLabel = nullptr;
@@ -46,9 +77,19 @@ private:
     QSpinBox* m_remotePortSpin = nullptr;
     QLabel* m_statusLabel = nullptr;
     QPushButton* m_connectBtn = nullptr;
+    UiView m_shownView;
+    QTimer* m_uiRefreshTimer = nullptr;
 
     // Threading
     std::atomic<bool> m_stopReconnect{false};
+
+    // Pending UI update state (for thread-safe updates)
+    std::mutex m_pendingStateMutex;
+    ConnectionState m_pendingState = ConnectionState::Disconnected;
+    std::string m_pendingError;
+    bool m_hasPendingUpdate = false;
+    bool m_refreshScheduled = false; // A refresh is queued or its timer runs
+    std::chrono::steady_clock::time_point m_lastRefresh; // UI thread only
 };
 
 } // namespace sshconn